@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace restio {
+
+/**
+ * @brief A shared pointer slot which can be read and replaced concurrently.
+ *
+ * Used to publish immutable snapshots (RCU style): readers load() the current value and keep it
+ * as long as they need it, writers build a new object and store() it.
+ */
+template <typename T> class AtomicSharedPtr {
+public:
+    AtomicSharedPtr(std::shared_ptr<T> value = {}) : value_(std::move(value)) { }
+
+    AtomicSharedPtr(const AtomicSharedPtr &)            = delete;
+    AtomicSharedPtr &operator=(const AtomicSharedPtr &) = delete;
+
+#ifdef __cpp_lib_atomic_shared_ptr
+    inline std::shared_ptr<T> load() const { return value_.load(std::memory_order_acquire); }
+    inline void               store(std::shared_ptr<T> value) { value_.store(std::move(value), std::memory_order_release); }
+
+private:
+    std::atomic<std::shared_ptr<T>> value_;
+#else
+    inline std::shared_ptr<T> load() const { return std::atomic_load_explicit(&value_, std::memory_order_acquire); }
+    inline void               store(std::shared_ptr<T> value)
+    {
+        std::atomic_store_explicit(&value_, std::move(value), std::memory_order_release);
+    }
+
+private:
+    std::shared_ptr<T> value_;
+#endif
+};
+
+} // namespace restio
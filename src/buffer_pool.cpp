@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <vector>
+
+namespace restio {
+
+namespace {
+
+    constexpr std::size_t min_class_bits = 12; // 4KB
+    constexpr std::size_t max_class_bits = 16; // 64KB
+    constexpr std::size_t class_count    = max_class_bits - min_class_bits + 1;
+    constexpr std::size_t max_per_class  = 64; // per thread
+
+    std::atomic<std::size_t> borrowedBuffers { 0 };
+    std::atomic<std::size_t> pooledBuffers { 0 };
+    std::atomic<std::size_t> pooledBytes { 0 };
+
+    struct ThreadCache {
+        // a class holds buffers of capacity [2^(min_class_bits + i), 2^(min_class_bits + i + 1))
+        std::array<std::vector<boost::beast::flat_buffer>, class_count> classes;
+
+        ~ThreadCache()
+        {
+            for (auto const &buffers : classes) {
+                for (auto const &buffer : buffers) {
+                    pooledBytes -= buffer.capacity();
+                }
+                pooledBuffers -= buffers.size();
+            }
+        }
+    };
+
+    thread_local ThreadCache cache;
+
+} // namespace
+
+boost::beast::flat_buffer BufferPool::borrow(std::size_t capacity)
+{
+    borrowedBuffers++;
+    // the first class all the buffers of which are large enough
+    std::size_t bits = std::max<std::size_t>(std::bit_width(std::max<std::size_t>(capacity, 1) - 1), min_class_bits);
+    for (auto i = bits - min_class_bits; i < class_count; i++) {
+        auto &buffers = cache.classes[i];
+        if (!buffers.empty()) {
+            auto buffer = std::move(buffers.back());
+            buffers.pop_back();
+            pooledBuffers--;
+            pooledBytes -= buffer.capacity();
+            return buffer;
+        }
+    }
+    boost::beast::flat_buffer buffer;
+    buffer.reserve(std::max(capacity, std::size_t(1) << min_class_bits));
+    return buffer;
+}
+
+void BufferPool::release(boost::beast::flat_buffer &buffer)
+{
+    if (!buffer.capacity()) {
+        return;
+    }
+    borrowedBuffers--;
+    buffer.clear();
+    auto bits = std::size_t(std::bit_width(buffer.capacity()) - 1);
+    if (bits >= min_class_bits && bits <= max_class_bits) {
+        auto &buffers = cache.classes[bits - min_class_bits];
+        if (buffers.size() < max_per_class) {
+            pooledBuffers++;
+            pooledBytes += buffer.capacity();
+            buffers.push_back(std::move(buffer)); // leaves it with no memory
+            return;
+        }
+    }
+    buffer.shrink_to_fit();
+}
+
+BufferPool::Stats BufferPool::stats() { return { borrowedBuffers, pooledBuffers, pooledBytes }; }
+
+} // namespace restio
@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include <boost/beast/core/flat_buffer.hpp>
+
+#include <cstddef>
+
+namespace restio {
+
+/**
+ * @brief Read buffers cached per thread by capacity (powers of two from 4KB to 64KB).
+ *
+ * Sessions borrow a buffer only while a request is being read, so idle keep-alive connections don't hold any.
+ * A buffer may be released on another thread than it was borrowed on. Larger buffers are freed on release.
+ */
+class BufferPool {
+public:
+    // of all the threads
+    struct Stats {
+        std::size_t borrowed = 0; // in use by sessions
+        std::size_t pooled   = 0; // cached for reuse
+        std::size_t bytes    = 0; // capacity of the cached ones
+    };
+
+    // a buffer of at least the capacity. the smallest cached one fitting or a new one
+    static boost::beast::flat_buffer borrow(std::size_t capacity);
+
+    // takes the memory of a borrowed buffer. the buffer is left empty. does nothing if it has no memory
+    static void release(boost::beast::flat_buffer &buffer);
+
+    static Stats stats();
+};
+
+// returns the buffer to the pool when the scope ends
+class BufferLease {
+public:
+    explicit BufferLease(boost::beast::flat_buffer &buffer) : buffer_(buffer) { }
+    ~BufferLease() { BufferPool::release(buffer_); }
+
+    BufferLease(const BufferLease &)            = delete;
+    BufferLease &operator=(const BufferLease &) = delete;
+
+private:
+    boost::beast::flat_buffer &buffer_;
+};
+
+} // namespace restio
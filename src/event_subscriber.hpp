@@ -0,0 +1,66 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace restio {
+
+/**
+ * @brief Queue of serialized events of an SSE client.
+ *
+ * Events are pushed from any thread. The session writing them waits on signal on its strand.
+ */
+class EventSubscriber : public std::enable_shared_from_this<EventSubscriber> {
+public:
+    using Event = std::shared_ptr<const std::string>;
+
+    EventSubscriber(const boost::asio::any_io_executor &executor, std::size_t maxQueued);
+
+    // false if the subscriber is evicted since it's too slow
+    bool push(const Event &event);
+
+    // everything queued so far
+    std::vector<Event> take();
+
+    bool evicted() const;
+
+    boost::asio::steady_timer signal; // cancelled when events arrive
+
+private:
+    mutable std::mutex mutex_;
+    std::deque<Event>  queue_;
+    std::size_t        maxQueued_;
+    bool               evicted_ = false;
+};
+
+} // namespace restio
@@ -37,54 +37,97 @@ constexpr http::verb max_verb = http::verb(255);
 HttpHandlerStore::HttpHandlerStore(const std::string &base_path) :
     base_path_(boost::trim_right_copy_if(base_path, boost::is_any_of("/")))
 {
+    publish({});
 }
 
 void HttpHandlerStore::add(http::verb verb, std::string &&path, RequestHandler &&handler)
 {
     boost::trim_if(path, boost::is_any_of("/"));
-    auto  nodes = &nodes_;
-    Node *node  = nullptr;
+    std::vector<std::string> parts;
     for (auto pit = boost::make_split_iterator(path, boost::first_finder("/", boost::is_equal()));
          pit != decltype(pit)();
          ++pit) {
-        std::string part               = copy_range<std::string>(*pit);
-        auto const &[nodeIt, inserted] = nodes->try_emplace(std::move(part), std::make_unique<Node>());
-        if (inserted) {
-            nodeIt->second->handlers.reserve(4); // for get/post/put/delete
-        }
-        node  = nodeIt->second.get();
-        nodes = &(node->children);
+        parts.push_back(copy_range<std::string>(*pit));
+    }
+    if (parts.empty()) {
+        parts.emplace_back();
+    }
+    auto shared_handler = std::make_shared<const RequestHandler>(std::move(handler));
+
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    publish(add_helper(snapshot_.load()->nodes_, parts, verb, std::move(shared_handler)));
+}
+
+HttpHandlerStore::NodeMap HttpHandlerStore::add_helper(const NodeMap                        &nmap,
+                                                       std::span<const std::string>          parts,
+                                                       http::verb                            verb,
+                                                       std::shared_ptr<const RequestHandler> handler)
+{
+    NodeMap result = nmap; // untouched subtrees are shared with the previous snapshot
+    auto    nit    = nmap.find(parts[0]);
+    auto    node   = nit == nmap.end() ? std::make_shared<Node>() : std::make_shared<Node>(*nit->second);
+    if (nit == nmap.end()) {
+        node->handlers.reserve(4); // for get/post/put/delete
+    }
+    if (parts.size() == 1) {
+        node->handlers[verb] = std::move(handler);
+    } else {
+        node->children = add_helper(node->children, parts.subspan(1), verb, std::move(handler));
+    }
+    result[parts[0]] = std::move(node);
+    return result;
+}
+
+void HttpHandlerStore::remove(http::verb verb, const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto                        nodes = snapshot_.load()->nodes_;
+    if (remove_helper(verb, path, nodes)) {
+        publish(std::move(nodes));
     }
-    node->handlers[verb] = std::move(handler);
 }
 
-void HttpHandlerStore::remove(http::verb verb, const std::string &path) { remove_helper(verb, path, nodes_); }
+void HttpHandlerStore::clear()
+{
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    publish({});
+}
 
-void HttpHandlerStore::remove_helper(http::verb verb, std::string_view path_tail, NodeMap &nmap)
+bool HttpHandlerStore::remove_helper(http::verb verb, std::string_view path_tail, NodeMap &nmap)
 {
-    auto pit  = std::find_if(path_tail.begin(), path_tail.end(), boost::is_any_of(std::string_view("/?#")));
-    auto part = std::string(std::string_view(path_tail.begin(), pit));
-    auto nit  = nmap.find(part);
+    auto ppos = path_tail.find_first_of("/?#");
+    auto nit  = nmap.find(std::string(path_tail.substr(0, ppos)));
     if (nit == nmap.end()) {
-        return;
+        return false;
     }
-    Node *node          = nit->second.get();
-    bool  is_final_part = pit == path_tail.end() || *pit != '/';
+    auto node          = std::make_shared<Node>(*nit->second);
+    bool is_final_part = ppos == std::string_view::npos || path_tail[ppos] != '/';
     if (is_final_part) {
-        auto hit = node->handlers.find(verb);
-        if (hit != node->handlers.end()) {
-            node->handlers.erase(hit);
+        if (!node->handlers.erase(verb)) {
+            return false;
         }
-    } else {
-        remove_helper(verb, path_tail.substr(pit + 1 - path_tail.data()), node->children);
+    } else if (!remove_helper(verb, path_tail.substr(ppos + 1), node->children)) {
+        return false;
     }
     if (node->handlers.empty() && node->children.empty()) {
         nmap.erase(nit);
+    } else {
+        nit->second = std::move(node);
     }
+    return true;
+}
+
+void HttpHandlerStore::publish(NodeMap &&nodes)
+{
+    snapshot_.store(std::shared_ptr<const Snapshot>(new Snapshot(base_path_, std::move(nodes))));
+}
+
+HttpHandlerStore::LookupResult HttpHandlerStore::lookup(const http::request<http::string_body> &req) const
+{
+    return snapshot_.load()->lookup(req);
 }
 
-std::optional<std::pair<std::string_view, std::reference_wrapper<const RequestHandler>>>
-HttpHandlerStore::lookup(const http::request<http::string_body> &req) const
+HttpHandlerStore::LookupResult HttpHandlerStore::Snapshot::lookup(const http::request<http::string_body> &req) const
 {
     auto req_target = req.target();
     auto result     = lookup_node(req.method(), { req_target.data(), req_target.size() });
@@ -96,7 +139,7 @@ HttpHandlerStore::lookup(const http::request<http::string_body> &req) const
 }
 
 std::optional<std::tuple<std::string_view, const HttpHandlerStore::Node *, const RequestHandler *>>
-HttpHandlerStore::lookup_node(http::verb req_verb, std::string_view req_target) const
+HttpHandlerStore::Snapshot::lookup_node(http::verb req_verb, std::string_view req_target) const
 {
     if (nodes_.empty()) {
         return std::nullopt;
@@ -141,7 +184,7 @@ HttpHandlerStore::lookup_node(http::verb req_verb, std::string_view req_target)
         auto       handlerIt = get_handler(node);
         if (handlerIt != node->handlers.end()) {
             lastMatchingNode    = node;
-            lastMatchingHandler = &handlerIt->second;
+            lastMatchingHandler = handlerIt->second.get();
             path_tail           = req_target.substr(ppos);
         }
         nodes = &node->children;
@@ -158,7 +201,7 @@ HttpHandlerStore::lookup_node(http::verb req_verb, std::string_view req_target)
             auto       handlerIt = get_handler(node);
             if (handlerIt != node->handlers.end()) {
                 lastMatchingNode    = node;
-                lastMatchingHandler = &handlerIt->second;
+                lastMatchingHandler = handlerIt->second.get();
                 path_tail           = req_target;
             }
         }
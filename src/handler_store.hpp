@@ -24,16 +24,45 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include "atomic_shared_ptr.hpp"
 #include "restio_http_server.hpp"
 
 #include <map>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <tuple>
 
 namespace restio {
 
+/**
+ * @brief Routing table of http handlers
+ *
+ * Routes are published as immutable snapshots. add() / remove() build a new table and swap it in,
+ * so lookups never lock and may run concurrently with modifications on other threads.
+ */
 class HttpHandlerStore {
+    struct Node;
+    using NodeMap = std::unordered_map<std::string, std::shared_ptr<const Node>>;
+
 public:
+    using LookupResult = std::optional<std::pair<std::string_view, std::reference_wrapper<const RequestHandler>>>;
+
+    class Snapshot {
+    public:
+        LookupResult lookup(const http::request<http::string_body> &req) const;
+
+    private:
+        friend class HttpHandlerStore;
+        Snapshot(const std::string &base_path, NodeMap &&nodes) : base_path_(base_path), nodes_(std::move(nodes)) { }
+
+        std::optional<std::tuple<std::string_view, const Node *, const RequestHandler *>>
+        lookup_node(http::verb verb, std::string_view path) const;
+
+        std::string base_path_;
+        NodeMap     nodes_;
+    };
+
     HttpHandlerStore(const std::string &base_path = {});
 
     inline void add(std::string &&path, RequestHandler &&handler)
@@ -43,29 +72,40 @@ public:
     void        add(http::verb verb, std::string &&path, RequestHandler &&handler);
     inline void remove(const std::string &path) { remove(http::verb::unknown, path); }
     void        remove(http::verb verb, const std::string &path);
-    inline void clear() { nodes_.clear(); }
+    void        clear();
 
     inline const std::string &path() const { return base_path_; }
 
-    std::optional<std::pair<std::string_view, std::reference_wrapper<const RequestHandler>>>
-    lookup(const http::request<http::string_body> &req) const;
+    /**
+     * @brief current routing table. Keep it while using handlers found in it.
+     */
+    inline std::shared_ptr<const Snapshot> snapshot() const { return snapshot_.load(); }
+
+    /**
+     * @brief lookup in the current routing table
+     *
+     * The result is valid until the store is modified. Use snapshot() if routes may change concurrently.
+     */
+    LookupResult lookup(const http::request<http::string_body> &req) const;
 
 private:
-    struct Node;
-    using NodeMap    = std::unordered_map<std::string, std::unique_ptr<Node>>;
-    using HandlerMap = std::unordered_map<http::verb, RequestHandler>;
+    using HandlerMap = std::unordered_map<http::verb, std::shared_ptr<const RequestHandler>>;
     struct Node {
         HandlerMap handlers;
         NodeMap    children;
     };
 
-    void remove_helper(http::verb verb, std::string_view path_part, NodeMap &nmap);
+    static NodeMap add_helper(const NodeMap                        &nmap,
+                              std::span<const std::string>          parts,
+                              http::verb                            verb,
+                              std::shared_ptr<const RequestHandler> handler);
+    static bool    remove_helper(http::verb verb, std::string_view path_part, NodeMap &nmap);
 
-    std::optional<std::tuple<std::string_view, const Node *, const RequestHandler *>>
-    lookup_node(http::verb verb, std::string_view path) const;
+    void publish(NodeMap &&nodes);
 
-    std::string base_path_;
-    NodeMap     nodes_;
+    std::string                     base_path_;
+    std::mutex                      write_mutex_;
+    AtomicSharedPtr<const Snapshot> snapshot_;
 };
 
 } // namespace restio
@@ -0,0 +1,462 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "hpack.hpp"
+
+#include <array>
+#include <unordered_map>
+
+namespace restio {
+
+namespace {
+
+    constexpr std::size_t entry_overhead = 32; // added to the size of each table entry (RFC 7541 4.1)
+
+    constexpr std::pair<std::string_view, std::string_view> static_table[] = {
+        { ":authority", "" },
+        { ":method", "GET" },
+        { ":method", "POST" },
+        { ":path", "/" },
+        { ":path", "/index.html" },
+        { ":scheme", "http" },
+        { ":scheme", "https" },
+        { ":status", "200" },
+        { ":status", "204" },
+        { ":status", "206" },
+        { ":status", "304" },
+        { ":status", "400" },
+        { ":status", "404" },
+        { ":status", "500" },
+        { "accept-charset", "" },
+        { "accept-encoding", "gzip, deflate" },
+        { "accept-language", "" },
+        { "accept-ranges", "" },
+        { "accept", "" },
+        { "access-control-allow-origin", "" },
+        { "age", "" },
+        { "allow", "" },
+        { "authorization", "" },
+        { "cache-control", "" },
+        { "content-disposition", "" },
+        { "content-encoding", "" },
+        { "content-language", "" },
+        { "content-length", "" },
+        { "content-location", "" },
+        { "content-range", "" },
+        { "content-type", "" },
+        { "cookie", "" },
+        { "date", "" },
+        { "etag", "" },
+        { "expect", "" },
+        { "expires", "" },
+        { "from", "" },
+        { "host", "" },
+        { "if-match", "" },
+        { "if-modified-since", "" },
+        { "if-none-match", "" },
+        { "if-range", "" },
+        { "if-unmodified-since", "" },
+        { "last-modified", "" },
+        { "link", "" },
+        { "location", "" },
+        { "max-forwards", "" },
+        { "proxy-authenticate", "" },
+        { "proxy-authorization", "" },
+        { "range", "" },
+        { "referer", "" },
+        { "refresh", "" },
+        { "retry-after", "" },
+        { "server", "" },
+        { "set-cookie", "" },
+        { "strict-transport-security", "" },
+        { "transfer-encoding", "" },
+        { "user-agent", "" },
+        { "vary", "" },
+        { "via", "" },
+        { "www-authenticate", "" },    };
+    constexpr std::size_t static_table_size = sizeof(static_table) / sizeof(static_table[0]);
+
+    // RFC 7541 Appendix B. Codes are right-aligned, the last one is EOS
+    constexpr std::uint32_t huffman_codes[257] = {
+        0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+        0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+        0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+        0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+        0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+        0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+        0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+        0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+        0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+        0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+        0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+        0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+        0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+        0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+        0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+        0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+        0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+        0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+        0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+        0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+        0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+        0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+        0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+        0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+        0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+        0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+        0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+        0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+        0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+        0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+        0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+        0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+        0x3fffffff,
+    };
+
+    constexpr std::uint8_t huffman_lengths[257] = {
+        13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+        28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+        6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+        5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+        13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+        7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+        15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+        6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+        20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+        24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+        22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+        21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+        26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+        19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+        20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+        26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+        30,
+    };
+
+    constexpr unsigned eos = 256;
+
+    /*
+     * The code is canonical: codes of the same length are consecutive and, left-aligned, shorter codes sort
+     * before longer ones. So the length of the next code is the shortest one whose range covers the leading bits.
+     */
+    class HuffmanTable {
+    public:
+        static constexpr unsigned min_length = 5;
+        static constexpr unsigned max_length = 30;
+
+        HuffmanTable()
+        {
+            std::array<unsigned, max_length + 1> count {};
+            for (auto length : huffman_lengths) {
+                count[length]++;
+            }
+            std::uint32_t code  = 0;
+            unsigned      index = 0;
+            for (unsigned length = min_length; length <= max_length; length++) {
+                code           = code << (length == min_length ? 0 : 1);
+                first_[length]  = code;
+                offset_[length] = index;
+                code += count[length];
+                limit_[length] = code;
+                index += count[length];
+            }
+            std::array<unsigned, max_length + 1> next = offset_;
+            for (unsigned length = min_length; length <= max_length; length++) {
+                for (unsigned symbol = 0; symbol <= eos; symbol++) {
+                    if (huffman_lengths[symbol] == length) {
+                        symbols_[next[length]++] = std::uint16_t(symbol);
+                    }
+                }
+            }
+        }
+
+        // bits are left-aligned. returns the symbol and sets length, or returns eos + 1 if available bits don't
+        // contain a complete code
+        unsigned lookup(std::uint64_t bits, unsigned available, unsigned &length) const
+        {
+            for (length = min_length; length <= max_length && length <= available; length++) {
+                auto code = std::uint32_t(bits >> (64 - length));
+                if (code < limit_[length]) {
+                    return symbols_[offset_[length] + code - first_[length]];
+                }
+            }
+            return eos + 1;
+        }
+
+    private:
+        std::array<std::uint32_t, max_length + 1> first_ {};
+        std::array<std::uint32_t, max_length + 1> limit_ {};
+        std::array<unsigned, max_length + 1>      offset_ {};
+        std::array<std::uint16_t, eos + 1>        symbols_ {};
+    };
+
+    const HuffmanTable &huffmanTable()
+    {
+        static const HuffmanTable table;
+        return table;
+    }
+
+    // RFC 7541 5.1. false if the input ends too early or the value is unreasonably big
+    bool decodeInteger(std::string_view &in, unsigned prefixBits, std::uint64_t &value)
+    {
+        if (in.empty()) {
+            return false;
+        }
+        std::uint8_t mask = (1 << prefixBits) - 1;
+        value             = std::uint8_t(in[0]) & mask;
+        in.remove_prefix(1);
+        if (value < mask) {
+            return true;
+        }
+        for (unsigned shift = 0; !in.empty(); shift += 7) {
+            if (shift > 28) {
+                return false;
+            }
+            std::uint8_t byte = in[0];
+            in.remove_prefix(1);
+            value += std::uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool decodeString(std::string_view &in, std::string &out)
+    {
+        if (in.empty()) {
+            return false;
+        }
+        bool          huffman = std::uint8_t(in[0]) & 0x80;
+        std::uint64_t length;
+        if (!decodeInteger(in, 7, length) || length > in.size()) {
+            return false;
+        }
+        auto data = in.substr(0, length);
+        in.remove_prefix(length);
+        if (huffman) {
+            out.clear();
+            return huffmanDecode(data, out);
+        }
+        out.assign(data);
+        return true;
+    }
+
+    void encodeInteger(std::uint64_t value, unsigned prefixBits, std::uint8_t flags, std::string &out)
+    {
+        std::uint8_t mask = (1 << prefixBits) - 1;
+        if (value < mask) {
+            out += char(flags | value);
+            return;
+        }
+        out += char(flags | mask);
+        value -= mask;
+        while (value >= 0x80) {
+            out += char((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        out += char(value);
+    }
+
+    void encodeString(std::string_view value, std::string &out)
+    {
+        encodeInteger(value.size(), 7, 0, out);
+        out += value;
+    }
+
+    // index of the first static entry with the name, 0 if there is none
+    unsigned staticNameIndex(std::string_view name)
+    {
+        static const auto indices = [] {
+            std::unordered_map<std::string_view, unsigned> indices;
+            for (unsigned i = static_table_size; i > 0; i--) {
+                indices[static_table[i - 1].first] = i;
+            }
+            return indices;
+        }();
+        auto it = indices.find(name);
+        return it == indices.end() ? 0 : it->second;
+    }
+
+} // namespace
+
+bool huffmanDecode(std::string_view in, std::string &out)
+{
+    auto const   &table     = huffmanTable();
+    std::uint64_t bits      = 0; // left-aligned
+    unsigned      available = 0;
+    std::size_t   pos       = 0;
+    for (;;) {
+        while (available <= 56 && pos < in.size()) {
+            bits |= std::uint64_t(std::uint8_t(in[pos++])) << (56 - available);
+            available += 8;
+        }
+        if (available == 0) {
+            return true;
+        }
+        unsigned length;
+        auto     symbol = table.lookup(bits, available, length);
+        if (symbol == eos) {
+            return false; // EOS must not be encoded explicitly
+        }
+        if (symbol > eos) {
+            // the rest has to be padding: less than a byte of the most significant bits of EOS, i.e. ones
+            return pos == in.size() && available < 8 && (bits >> (64 - available)) == (1u << available) - 1;
+        }
+        out += char(symbol);
+        bits <<= length;
+        available -= length;
+    }
+}
+
+HpackDecoder::Result
+HpackDecoder::decode(std::string_view block, std::vector<HeaderField> &fields, std::size_t maxListSize)
+{
+    std::size_t listSize = 0;
+    bool        first    = true;
+    fields.clear();
+    while (!block.empty()) {
+        std::uint8_t  byte = block[0];
+        std::uint64_t index;
+        HeaderField   decoded;
+        if (byte & 0x80) { // indexed field
+            if (!decodeInteger(block, 7, index) || !field(index, decoded)) {
+                return Result::Malformed;
+            }
+        } else if ((byte & 0xe0) == 0x20) { // dynamic table size update. allowed only at the beginning
+            if (!first || !decodeInteger(block, 5, index) || index > default_table_size) {
+                return Result::Malformed;
+            }
+            maxSize_ = index;
+            evict(maxSize_);
+            continue;
+        } else { // literal
+            bool     indexing   = byte & 0x40;
+            unsigned prefixBits = indexing ? 6 : 4;
+            if (!decodeInteger(block, prefixBits, index)) {
+                return Result::Malformed;
+            }
+            if (index ? !field(index, decoded) : !decodeString(block, decoded.first)) {
+                return Result::Malformed;
+            }
+            if (!decodeString(block, decoded.second)) {
+                return Result::Malformed;
+            }
+            if (indexing) {
+                insert(decoded);
+            }
+        }
+        first = false;
+        // the rest of the block is still decoded to keep the table in sync with the peer's encoder
+        listSize += decoded.first.size() + decoded.second.size() + entry_overhead;
+        if (listSize <= maxListSize) {
+            fields.push_back(std::move(decoded));
+        }
+    }
+    if (listSize > maxListSize) {
+        fields.clear();
+        return Result::TooLarge;
+    }
+    return Result::Ok;
+}
+
+bool HpackDecoder::field(std::uint64_t index, HeaderField &out) const
+{
+    if (index == 0) {
+        return false;
+    }
+    if (index <= static_table_size) {
+        auto const &[name, value] = static_table[index - 1];
+        out.first.assign(name);
+        out.second.assign(value);
+        return true;
+    }
+    index -= static_table_size + 1;
+    if (index >= table_.size()) {
+        return false;
+    }
+    out = table_[index];
+    return true;
+}
+
+void HpackDecoder::insert(HeaderField field)
+{
+    auto size = field.first.size() + field.second.size() + entry_overhead;
+    evict(size > maxSize_ ? 0 : maxSize_ - size);
+    if (size <= maxSize_) { // an entry bigger than the table just empties it
+        size_ += size;
+        table_.push_front(std::move(field));
+    }
+}
+
+void HpackDecoder::evict(std::size_t maxSize)
+{
+    while (size_ > maxSize) {
+        auto const &last = table_.back();
+        size_ -= last.first.size() + last.second.size() + entry_overhead;
+        table_.pop_back();
+    }
+}
+
+void HpackEncoder::encodeStatus(unsigned status, std::string &out)
+{
+    // :status entries of the static table
+    switch (status) {
+    case 200:
+        out += char(0x80 | 8);
+        return;
+    case 204:
+        out += char(0x80 | 9);
+        return;
+    case 206:
+        out += char(0x80 | 10);
+        return;
+    case 304:
+        out += char(0x80 | 11);
+        return;
+    case 400:
+        out += char(0x80 | 12);
+        return;
+    case 404:
+        out += char(0x80 | 13);
+        return;
+    case 500:
+        out += char(0x80 | 14);
+        return;
+    default:
+        encode(":status", std::to_string(status), out);
+    }
+}
+
+void HpackEncoder::encode(std::string_view name, std::string_view value, std::string &out)
+{
+    auto index = staticNameIndex(name);
+    encodeInteger(index, 4, 0, out); // literal without indexing
+    if (!index) {
+        encodeString(name, out);
+    }
+    encodeString(value, out);
+}
+
+} // namespace restio
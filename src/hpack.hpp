@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace restio {
+
+using HeaderField = std::pair<std::string, std::string>;
+
+/**
+ * @brief HPACK (RFC 7541) decoder of HTTP/2 header blocks.
+ *
+ * Keeps the dynamic table of a connection, so all the blocks received on the connection have to pass through
+ * the same decoder in order.
+ */
+class HpackDecoder {
+public:
+    static constexpr std::size_t default_table_size = 4096;
+
+    // Malformed is a connection error. The decoder is out of sync with the peer then.
+    enum class Result { Ok, TooLarge, Malformed };
+
+    /**
+     * @brief decodes a complete header block (HEADERS and its CONTINUATIONs)
+     * @param maxListSize - limit of the decoded fields size, counted as RFC 7540 does for MAX_HEADER_LIST_SIZE.
+     *                      No fields are returned if it's exceeded.
+     */
+    Result decode(std::string_view block, std::vector<HeaderField> &fields, std::size_t maxListSize);
+
+private:
+    // copies the entry of the static or the dynamic table. the value is copied too even if only the name is needed
+    bool field(std::uint64_t index, HeaderField &out) const;
+    void insert(HeaderField field);
+    void evict(std::size_t maxSize);
+
+    std::deque<HeaderField> table_; // newest first
+    std::size_t             size_    = 0;
+    std::size_t             maxSize_ = default_table_size;
+};
+
+/**
+ * @brief HPACK encoder of response headers.
+ *
+ * Stateless: fields are written as literals without indexing, with names taken from the static table when
+ * possible. Response headers of a REST service are mostly unique, so the dynamic table wouldn't pay off.
+ */
+class HpackEncoder {
+public:
+    static void encodeStatus(unsigned status, std::string &out);
+    // name has to be lowercase
+    static void encode(std::string_view name, std::string_view value, std::string &out);
+};
+
+// decodes a Huffman-coded string literal. false if it's malformed
+bool huffmanDecode(std::string_view in, std::string &out);
+
+} // namespace restio
@@ -0,0 +1,895 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "hpack.hpp"
+#include "response_serializer.hpp"
+#include "restio_http_server.hpp"
+#include "restio_log.hpp"
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/core.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stop_token>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace restio {
+
+namespace http2 {
+
+    // sent by the client before anything else (RFC 7540 3.5)
+    constexpr std::string_view preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    enum class FrameType : std::uint8_t {
+        Data         = 0x0,
+        Headers      = 0x1,
+        Priority     = 0x2,
+        RstStream    = 0x3,
+        Settings     = 0x4,
+        PushPromise  = 0x5,
+        Ping         = 0x6,
+        GoAway       = 0x7,
+        WindowUpdate = 0x8,
+        Continuation = 0x9
+    };
+
+    namespace flags {
+        constexpr std::uint8_t end_stream  = 0x1;
+        constexpr std::uint8_t ack         = 0x1;
+        constexpr std::uint8_t end_headers = 0x4;
+        constexpr std::uint8_t padded      = 0x8;
+        constexpr std::uint8_t priority    = 0x20;
+    }
+
+    enum class Setting : std::uint16_t {
+        HeaderTableSize      = 0x1,
+        EnablePush           = 0x2,
+        MaxConcurrentStreams = 0x3,
+        InitialWindowSize    = 0x4,
+        MaxFrameSize         = 0x5,
+        MaxHeaderListSize    = 0x6
+    };
+
+    enum class ErrorCode : std::uint32_t {
+        NoError          = 0x0,
+        ProtocolError    = 0x1,
+        InternalError    = 0x2,
+        FlowControlError = 0x3,
+        StreamClosed     = 0x5,
+        FrameSizeError   = 0x6,
+        RefusedStream    = 0x7,
+        Cancel           = 0x8,
+        CompressionError = 0x9,
+        EnhanceYourCalm  = 0xb
+    };
+
+    constexpr std::size_t   frame_header_size   = 9;
+    constexpr std::uint32_t default_window_size = 65535;
+    constexpr std::uint32_t default_frame_size  = 16384;
+    constexpr std::uint32_t max_frame_size      = (1 << 24) - 1;
+    constexpr std::int64_t  max_window_size     = (std::int64_t(1) << 31) - 1;
+
+} // namespace http2
+
+/**
+ * @brief HTTP/2 connection over the stream of an http session (RFC 7540).
+ *
+ * Requests of the streams are handled concurrently. Each one is passed to
+ * `awaitable<bool> dispatch(Request &, Response &, std::stop_source)` which fills the response or returns false
+ * if the stream was cancelled meanwhile. Stop is requested if the client resets the stream or the connection ends.
+ *
+ * Everything runs on the executor of the session which has to be a strand. Frames queued while a write is
+ * in progress go with the next single write. Server push and priorities are not supported.
+ */
+template <typename Stream, typename Dispatch> class Http2Session {
+public:
+    /**
+     * @param buffer - bytes read already, starting with the connection preface
+     */
+    Http2Session(Stream                          &stream,
+                 boost::beast::flat_buffer       &buffer,
+                 const HttpServer::Http2Options &options,
+                 Dispatch                         dispatch,
+                 boost::asio::any_io_executor     executor) :
+        stream_(stream),
+        buffer_(buffer), options_(options), dispatch_(std::move(dispatch)), executor_(executor), signal_(executor),
+        writerDone_(executor), handlersDone_(executor)
+    {
+    }
+
+    // serves the connection till it's closed by either side
+    boost::asio::awaitable<void> run()
+    {
+        using namespace http2;
+        using boost::asio::use_awaitable;
+
+        buffer_.consume(preface.size());
+        recvWindow_ = connectionWindow();
+        sendSettings();
+        writing_ = true;
+        boost::asio::co_spawn(executor_, writeLoop(), boost::asio::detached);
+
+        boost::system::error_code ec;
+        while (!closing_) {
+            if (buffer_.size() >= frame_header_size) {
+                if (frameLength() > options_.maxFrameSize) {
+                    connectionError(ErrorCode::FrameSizeError);
+                    break;
+                }
+                if (buffer_.size() >= frame_header_size + frameLength()) {
+                    auto  data = static_cast<const std::uint8_t *>(buffer_.data().data());
+                    Frame frame { FrameType(data[3]),
+                                  data[4],
+                                  readUint32(data + 5) & 0x7fffffff,
+                                  { reinterpret_cast<const char *>(data) + frame_header_size, frameLength() } };
+                    bool  ok = onFrame(frame);
+                    buffer_.consume(frame_header_size + frame.payload.size());
+                    if (!ok) {
+                        break;
+                    }
+                    continue;
+                }
+            }
+            auto missing = buffer_.size() < frame_header_size ? frame_header_size - buffer_.size()
+                                                              : frame_header_size + frameLength() - buffer_.size();
+            auto n       = co_await stream_.async_read_some(
+                buffer_.prepare(std::max<std::size_t>(missing, default_frame_size)),
+                boost::asio::redirect_error(use_awaitable, ec));
+            buffer_.commit(n);
+            if (ec || closing_) {
+                break;
+            }
+        }
+        if (ec && ec != boost::asio::error::eof && ec != boost::asio::error::operation_aborted) {
+            RESTIO_DEBUG("HTTP/2 session failed: " << ec.message());
+        }
+
+        // nobody waits for the responses anymore
+        for (auto &[streamId, stream] : streams_) {
+            stream->stop.request_stop();
+        }
+        if (handlers_) {
+            handlersDone_.expires_at(boost::asio::steady_timer::time_point::max());
+            co_await handlersDone_.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+        }
+        closing_ = true; // GOAWAY and other queued frames are still written
+        if (writing_) {
+            signal_.cancel();
+            writerDone_.expires_at(boost::asio::steady_timer::time_point::max());
+            co_await writerDone_.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+        }
+    }
+
+    /**
+     * @brief GOAWAY and close the connection once the open streams are answered. Newer streams are refused.
+     * @param force - close right now and stop the handlers
+     */
+    void drain(bool force)
+    {
+        if (!draining_) {
+            draining_ = true;
+            std::string payload;
+            appendUint32(payload, lastStreamId_);
+            appendUint32(payload, std::uint32_t(http2::ErrorCode::NoError));
+            queueFrame(http2::FrameType::GoAway, 0, 0, payload);
+        }
+        if (force) {
+            for (auto &[streamId, stream] : streams_) {
+                stream->stop.request_stop();
+            }
+            closing_ = true;
+            boost::beast::get_lowest_layer(stream_).close();
+        } else if (streams_.empty()) {
+            stopReading();
+        }
+    }
+
+private:
+    // the response body is sent from the response itself
+    struct StreamState {
+        std::uint32_t    id;
+        Request          request;
+        Response         response;
+        std::stop_source stop;
+        std::int64_t     sendWindow;
+        std::int64_t     recvWindow;
+        std::size_t      recvUnacked  = 0; // DATA received since the last WINDOW_UPDATE
+        std::size_t      sent         = 0; // of the response body
+        bool             remoteClosed = false;
+        bool             dispatched   = false;
+        bool             closed       = false;
+    };
+    using StreamPtr = std::shared_ptr<StreamState>;
+
+    struct Frame {
+        http2::FrameType type;
+        std::uint8_t     flags;
+        std::uint32_t    streamId;
+        std::string_view payload;
+    };
+
+    // a write is started when this much is queued even if some streams could send more
+    static constexpr std::size_t outbox_limit = 64 * 1024;
+    // the same as Beast's default limit for HTTP/1 requests
+    static constexpr std::size_t max_request_body = 1024 * 1024;
+
+    static std::uint32_t readUint32(const std::uint8_t *data)
+    {
+        return std::uint32_t(data[0]) << 24 | std::uint32_t(data[1]) << 16 | std::uint32_t(data[2]) << 8 | data[3];
+    }
+
+    static void appendUint32(std::string &out, std::uint32_t value)
+    {
+        char bytes[] = { char(value >> 24), char(value >> 16), char(value >> 8), char(value) };
+        out.append(bytes, sizeof(bytes));
+    }
+
+    std::uint32_t connectionWindow() const
+    {
+        return std::max(options_.initialWindowSize, http2::default_window_size);
+    }
+
+    // the window of a new stream. till our SETTINGS are acknowledged the client may assume the default one
+    std::int64_t streamWindow() const
+    {
+        return settingsAcked_ ? options_.initialWindowSize : connectionWindow();
+    }
+
+    std::size_t frameLength() const
+    {
+        auto data = static_cast<const std::uint8_t *>(buffer_.data().data());
+        return std::size_t(data[0]) << 16 | std::size_t(data[1]) << 8 | data[2];
+    }
+
+    void appendFrameHeader(std::size_t length, http2::FrameType type, std::uint8_t flags, std::uint32_t streamId)
+    {
+        char header[] = { char(length >> 16), char(length >> 8), char(length), char(type), char(flags) };
+        outbox_.append(header, sizeof(header));
+        appendUint32(outbox_, streamId);
+    }
+
+    void queueFrame(http2::FrameType type, std::uint8_t flags, std::uint32_t streamId, std::string_view payload)
+    {
+        appendFrameHeader(payload.size(), type, flags, streamId);
+        outbox_.append(payload);
+        signal_.cancel();
+    }
+
+    void sendSettings()
+    {
+        using http2::Setting;
+        std::string payload;
+        auto        add = [&payload](Setting id, std::uint32_t value) {
+            payload += char(std::uint16_t(id) >> 8);
+            payload += char(std::uint16_t(id));
+            appendUint32(payload, value);
+        };
+        add(Setting::EnablePush, 0);
+        add(Setting::MaxConcurrentStreams, options_.maxConcurrentStreams);
+        add(Setting::InitialWindowSize, options_.initialWindowSize);
+        add(Setting::MaxFrameSize, options_.maxFrameSize);
+        add(Setting::MaxHeaderListSize, options_.maxHeaderListSize);
+        queueFrame(http2::FrameType::Settings, 0, 0, payload);
+        if (options_.initialWindowSize > http2::default_window_size) {
+            // the connection window can't be changed by SETTINGS
+            sendWindowUpdate(0, options_.initialWindowSize - http2::default_window_size);
+        }
+    }
+
+    void sendWindowUpdate(std::uint32_t streamId, std::uint32_t increment)
+    {
+        std::string payload;
+        appendUint32(payload, increment);
+        queueFrame(http2::FrameType::WindowUpdate, 0, streamId, payload);
+    }
+
+    void resetStream(std::uint32_t streamId, http2::ErrorCode code)
+    {
+        std::string payload;
+        appendUint32(payload, std::uint32_t(code));
+        queueFrame(http2::FrameType::RstStream, 0, streamId, payload);
+    }
+
+    // queues GOAWAY. the caller stops reading then
+    bool connectionError(http2::ErrorCode code)
+    {
+        RESTIO_DEBUG("HTTP/2 connection error " << std::uint32_t(code));
+        std::string payload;
+        appendUint32(payload, lastStreamId_);
+        appendUint32(payload, std::uint32_t(code));
+        queueFrame(http2::FrameType::GoAway, 0, 0, payload);
+        return false;
+    }
+
+    StreamState *findStream(std::uint32_t id)
+    {
+        auto it = streams_.find(id);
+        return it == streams_.end() ? nullptr : it->second.get();
+    }
+
+    void closeStream(StreamState &stream)
+    {
+        stream.closed = true;
+        std::erase_if(sending_, [&stream](auto const &s) { return s.get() == &stream; });
+        streams_.erase(stream.id); // the last reference may be in the handler
+        if (draining_ && streams_.empty()) {
+            stopReading();
+        }
+    }
+
+    // false if the client resets streams more often than allowed
+    bool countReset()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - resetsSince_ >= std::chrono::seconds(1)) {
+            resetsSince_ = now;
+            resets_      = 0;
+        }
+        return ++resets_ <= options_.maxResetsPerSecond;
+    }
+
+    // the reader gets eof. unlike cancel() the writes in progress are not affected
+    void stopReading()
+    {
+        boost::system::error_code ec;
+        closing_ = true;
+        boost::beast::get_lowest_layer(stream_).socket().shutdown(boost::asio::socket_base::shutdown_receive, ec);
+    }
+
+    // returns false on a connection error
+    bool onFrame(const Frame &frame)
+    {
+        using namespace http2;
+        if (headerStream_ && frame.type != FrameType::Continuation) {
+            return connectionError(ErrorCode::ProtocolError); // a header block has to be contiguous
+        }
+        switch (frame.type) {
+        case FrameType::Data:
+            return onData(frame);
+        case FrameType::Headers:
+            return onHeaders(frame);
+        case FrameType::Continuation:
+            if (!headerStream_ || frame.streamId != headerStream_) {
+                return connectionError(ErrorCode::ProtocolError);
+            }
+            return appendHeaderBlock(frame.payload, frame.flags);
+        case FrameType::Settings:
+            return onSettings(frame);
+        case FrameType::Ping:
+            if (frame.streamId || frame.payload.size() != 8) {
+                return connectionError(frame.streamId ? ErrorCode::ProtocolError : ErrorCode::FrameSizeError);
+            }
+            if (!(frame.flags & flags::ack)) {
+                queueFrame(FrameType::Ping, flags::ack, 0, frame.payload);
+            }
+            return true;
+        case FrameType::WindowUpdate:
+            return onWindowUpdate(frame);
+        case FrameType::RstStream:
+            if (!frame.streamId || frame.payload.size() != 4) {
+                return connectionError(frame.streamId ? ErrorCode::FrameSizeError : ErrorCode::ProtocolError);
+            }
+            if (auto stream = findStream(frame.streamId)) {
+                stream->stop.request_stop();
+                closeStream(*stream);
+                if (!countReset()) {
+                    return connectionError(ErrorCode::EnhanceYourCalm); // rapid reset (CVE-2023-44487)
+                }
+            }
+            return true;
+        case FrameType::GoAway:
+            RESTIO_TRACE("HTTP/2 client is going away");
+            return true; // the client closes the connection once it gets the responses it waits for
+        case FrameType::PushPromise:
+            return connectionError(ErrorCode::ProtocolError); // clients can't push
+        default:
+            return true; // PRIORITY and unknown frames are ignored
+        }
+    }
+
+    // strips padding and priority. false if the frame is malformed
+    static bool framePayload(const Frame &frame, std::string_view &payload)
+    {
+        payload = frame.payload;
+        std::size_t padding = 0;
+        if (frame.flags & http2::flags::padded) {
+            if (payload.empty()) {
+                return false;
+            }
+            padding = std::uint8_t(payload[0]);
+            payload.remove_prefix(1);
+        }
+        if (frame.type == http2::FrameType::Headers && (frame.flags & http2::flags::priority)) {
+            if (payload.size() < 5) {
+                return false;
+            }
+            payload.remove_prefix(5);
+        }
+        if (padding > payload.size()) {
+            return false;
+        }
+        payload.remove_suffix(padding);
+        return true;
+    }
+
+    bool onSettings(const Frame &frame)
+    {
+        using namespace http2;
+        if (frame.streamId) {
+            return connectionError(ErrorCode::ProtocolError);
+        }
+        if (frame.flags & flags::ack) {
+            settingsAcked_ = true;
+            return true;
+        }
+        if (frame.payload.size() % 6) {
+            return connectionError(ErrorCode::FrameSizeError);
+        }
+        auto data = reinterpret_cast<const std::uint8_t *>(frame.payload.data());
+        for (std::size_t i = 0; i < frame.payload.size(); i += 6) {
+            auto id    = Setting(std::uint16_t(data[i]) << 8 | data[i + 1]);
+            auto value = readUint32(data + i + 2);
+            if (id == Setting::InitialWindowSize) {
+                if (value > max_window_size) {
+                    return connectionError(ErrorCode::FlowControlError);
+                }
+                // applies to the open streams too
+                auto delta = std::int64_t(value) - peerInitialWindow_;
+                for (auto &[streamId, stream] : streams_) {
+                    if (stream->sendWindow + delta > max_window_size) {
+                        return connectionError(ErrorCode::FlowControlError);
+                    }
+                    stream->sendWindow += delta;
+                }
+                peerInitialWindow_ = value;
+            } else if (id == Setting::MaxFrameSize) {
+                if (value < default_frame_size || value > max_frame_size) {
+                    return connectionError(ErrorCode::ProtocolError);
+                }
+                peerMaxFrameSize_ = value;
+            }
+            // the encoder doesn't use the dynamic table, so HEADER_TABLE_SIZE doesn't matter
+        }
+        queueFrame(FrameType::Settings, flags::ack, 0, {});
+        pump();
+        return true;
+    }
+
+    bool onWindowUpdate(const Frame &frame)
+    {
+        using namespace http2;
+        if (frame.payload.size() != 4) {
+            return connectionError(ErrorCode::FrameSizeError);
+        }
+        auto increment = readUint32(reinterpret_cast<const std::uint8_t *>(frame.payload.data())) & 0x7fffffff;
+        if (!frame.streamId) {
+            if (!increment || sendWindow_ + increment > max_window_size) {
+                return connectionError(increment ? ErrorCode::FlowControlError : ErrorCode::ProtocolError);
+            }
+            sendWindow_ += increment;
+        } else if (auto stream = findStream(frame.streamId)) {
+            if (!increment || stream->sendWindow + increment > max_window_size) {
+                stream->stop.request_stop();
+                resetStream(stream->id, increment ? ErrorCode::FlowControlError : ErrorCode::ProtocolError);
+                closeStream(*stream);
+                return true;
+            }
+            stream->sendWindow += increment;
+        }
+        pump();
+        return true;
+    }
+
+    bool onHeaders(const Frame &frame)
+    {
+        using namespace http2;
+        std::string_view payload;
+        if (!frame.streamId || !framePayload(frame, payload)) {
+            return connectionError(ErrorCode::ProtocolError);
+        }
+        headerStream_     = frame.streamId;
+        headerEndStream_  = frame.flags & flags::end_stream;
+        headerBlock_.clear();
+        return appendHeaderBlock(payload, frame.flags);
+    }
+
+    bool appendHeaderBlock(std::string_view fragment, std::uint8_t frameFlags)
+    {
+        if (headerBlock_.size() + fragment.size() > options_.maxHeaderListSize) {
+            return connectionError(http2::ErrorCode::EnhanceYourCalm);
+        }
+        headerBlock_.append(fragment);
+        if (!(frameFlags & http2::flags::end_headers)) {
+            return true;
+        }
+        auto streamId = headerStream_;
+        headerStream_ = 0;
+        return onHeaderBlock(streamId);
+    }
+
+    bool onHeaderBlock(std::uint32_t streamId)
+    {
+        using namespace http2;
+        auto result = decoder_.decode(headerBlock_, fields_, options_.maxHeaderListSize);
+        if (result == HpackDecoder::Result::Malformed) {
+            return connectionError(ErrorCode::CompressionError);
+        }
+
+        if (streamId <= lastStreamId_) {
+            // trailers. they are not passed to the handler
+            auto stream = findStream(streamId);
+            if (!stream) {
+                return true; // refused or answered early and closed by us, the client may not know yet (RFC 7540 5.1)
+            }
+            if (stream->remoteClosed || !headerEndStream_) {
+                return connectionError(ErrorCode::ProtocolError);
+            }
+            stream->remoteClosed = true;
+            startStream(streams_[streamId]);
+            return true;
+        }
+        if (!(streamId & 1)) {
+            return connectionError(ErrorCode::ProtocolError); // even ids are for server initiated streams
+        }
+        if (draining_) {
+            resetStream(streamId, ErrorCode::RefusedStream); // sent before GOAWAY arrived. retried elsewhere
+            return true;
+        }
+        lastStreamId_ = streamId;
+        // handlers of the streams reset by the client may be still running, they count too
+        if (streams_.size() >= options_.maxConcurrentStreams || handlers_ >= options_.maxConcurrentStreams) {
+            resetStream(streamId, ErrorCode::RefusedStream);
+            return true;
+        }
+
+        auto stream          = std::make_shared<StreamState>();
+        stream->id           = streamId;
+        stream->sendWindow   = peerInitialWindow_;
+        stream->recvWindow   = streamWindow();
+        stream->remoteClosed = headerEndStream_;
+        streams_.emplace(streamId, stream);
+        if (result == HpackDecoder::Result::TooLarge) {
+            respond(*stream, http::status::request_header_fields_too_large);
+            return true;
+        }
+        if (!makeRequest(stream->request)) {
+            stream->stop.request_stop();
+            resetStream(streamId, ErrorCode::ProtocolError);
+            closeStream(*stream);
+            return true;
+        }
+        if (stream->remoteClosed) {
+            startStream(stream);
+        }
+        return true;
+    }
+
+    // builds an HTTP/1.1 alike request of the decoded fields. false if the request is malformed (RFC 9113 8.2)
+    bool makeRequest(Request &request)
+    {
+        bool        hasMethod = false;
+        bool        hasPath   = false;
+        std::string cookie; // may be split to several fields, has to be joined (RFC 7540 8.1.2.5)
+        request.version(20);
+        for (auto &[name, value] : fields_) {
+            if (name.starts_with(':')) {
+                if (name == ":method") {
+                    request.method_string(value);
+                    hasMethod = true;
+                } else if (name == ":path") {
+                    request.target(value);
+                    hasPath = !value.empty();
+                } else if (name == ":authority") {
+                    request.set(http::field::host, value);
+                }
+                continue;
+            }
+            if (std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; })) {
+                return false;
+            }
+            if (name == "connection" || name == "keep-alive" || name == "proxy-connection"
+                || name == "transfer-encoding" || name == "upgrade" || (name == "te" && value != "trailers")) {
+                return false; // connection specific
+            }
+            if (name == "cookie") {
+                cookie += cookie.empty() ? "" : "; ";
+                cookie += value;
+                continue;
+            }
+            request.insert(name, value);
+        }
+        if (!cookie.empty()) {
+            request.set(http::field::cookie, cookie);
+        }
+        return hasMethod && hasPath;
+    }
+
+    bool onData(const Frame &frame)
+    {
+        using namespace http2;
+        std::string_view payload;
+        if (!frame.streamId || !framePayload(frame, payload)) {
+            return connectionError(ErrorCode::ProtocolError);
+        }
+        // flow control counts padding too
+        if (frame.payload.size() > recvWindow_) {
+            return connectionError(ErrorCode::FlowControlError);
+        }
+        recvWindow_ -= frame.payload.size();
+        if (recvWindow_ <= connectionWindow() / 2) {
+            sendWindowUpdate(0, connectionWindow() - recvWindow_);
+            recvWindow_ = connectionWindow();
+        }
+
+        auto stream = findStream(frame.streamId);
+        if (!stream) {
+            // the stream may be reset already. its frames in flight are ignored then
+            return frame.streamId <= lastStreamId_ || connectionError(ErrorCode::ProtocolError);
+        }
+        if (stream->remoteClosed || std::int64_t(frame.payload.size()) > stream->recvWindow) {
+            stream->stop.request_stop();
+            resetStream(stream->id, stream->remoteClosed ? ErrorCode::StreamClosed : ErrorCode::FlowControlError);
+            closeStream(*stream);
+            return true;
+        }
+        stream->recvWindow -= frame.payload.size();
+        auto &body = stream->request.body();
+        if (body.size() + payload.size() > max_request_body) {
+            respond(*stream, http::status::payload_too_large); // and resets the stream
+            return true;
+        }
+        body.append(payload);
+        stream->remoteClosed = frame.flags & flags::end_stream;
+        if (stream->remoteClosed) {
+            startStream(streams_[stream->id]);
+            return true;
+        }
+        stream->recvUnacked += frame.payload.size();
+        if (stream->recvUnacked >= options_.initialWindowSize / 2) {
+            sendWindowUpdate(stream->id, stream->recvUnacked);
+            stream->recvWindow += stream->recvUnacked;
+            stream->recvUnacked = 0;
+        }
+        return true;
+    }
+
+    void startStream(StreamPtr stream)
+    {
+        stream->dispatched = true;
+        stream->request.prepare_payload();
+        handlers_++;
+        boost::asio::co_spawn(executor_, handle(std::move(stream)), boost::asio::detached);
+    }
+
+    boost::asio::awaitable<void> handle(StreamPtr stream)
+    {
+        bool answered = false;
+        try {
+            answered = co_await dispatch_(stream->request, stream->response, stream->stop);
+        } catch (std::exception &e) {
+            RESTIO_ERROR("HTTP/2 stream failed: " << e.what());
+        }
+        if (stream->closed) {
+            // reset by the client
+        } else if (answered) {
+            respond(*stream, stream->response.result());
+        } else {
+            resetStream(stream->id, http2::ErrorCode::InternalError);
+            closeStream(*stream);
+        }
+        if (--handlers_ == 0) {
+            handlersDone_.cancel();
+        }
+    }
+
+    // queues the response headers. the body is sent by pump() as flow control allows
+    void respond(StreamState &stream, http::status status)
+    {
+        using namespace http2;
+        auto &response = stream.response;
+        if (status != response.result()) {
+            response = {};
+            response.result(status);
+        }
+        bool hasBody = bodyAllowed(status) && !response.body().empty();
+        if (!hasBody) {
+            response.body().clear();
+        }
+
+        std::string block;
+        std::string name;
+        bool        hasServer = false;
+        bool        hasDate   = false;
+        HpackEncoder::encodeStatus(response.result_int(), block);
+        for (auto const &field : response) {
+            switch (field.name()) {
+            case http::field::connection:
+            case http::field::keep_alive:
+            case http::field::proxy_connection:
+            case http::field::transfer_encoding:
+            case http::field::upgrade:
+            case http::field::content_length:
+                continue; // connection specific or computed
+            case http::field::server:
+                hasServer = true;
+                break;
+            case http::field::date:
+                hasDate = true;
+                break;
+            default:
+                break;
+            }
+            name.assign(field.name_string().data(), field.name_string().size());
+            boost::algorithm::to_lower(name);
+            HpackEncoder::encode(name, { field.value().data(), field.value().size() }, block);
+        }
+        if (!hasServer) {
+            HpackEncoder::encode("server", "Restio/" RESTIO_VERSION, block);
+        }
+        if (!hasDate) {
+            HpackEncoder::encode("date", httpDate(), block);
+        }
+        if (bodyAllowed(status)) {
+            HpackEncoder::encode("content-length", std::to_string(response.body().size()), block);
+        }
+
+        // HEADERS and as many CONTINUATIONs as the peer's frame size requires
+        std::string_view rest  = block;
+        auto             type  = FrameType::Headers;
+        std::uint8_t     flags = hasBody ? 0 : flags::end_stream;
+        do {
+            auto fragment = rest.substr(0, peerMaxFrameSize_);
+            rest.remove_prefix(fragment.size());
+            queueFrame(type, flags | (rest.empty() ? flags::end_headers : 0), stream.id, fragment);
+            type  = FrameType::Continuation;
+            flags = 0;
+        } while (!rest.empty());
+
+        if (hasBody) {
+            sending_.push_back(streams_[stream.id]);
+            pump();
+        } else {
+            finishStream(stream);
+        }
+    }
+
+    // the response is queued completely
+    void finishStream(StreamState &stream)
+    {
+        if (!stream.remoteClosed) {
+            // the client still sends the request, but the response doesn't need it (RFC 7540 8.1)
+            resetStream(stream.id, http2::ErrorCode::NoError);
+        }
+        closeStream(stream);
+    }
+
+    // queues DATA frames of the streams in turn while flow control allows
+    void pump()
+    {
+        bool progress = true;
+        while (progress && outbox_.size() < outbox_limit && sendWindow_ > 0) {
+            progress = false;
+            for (std::size_t i = 0; i < sending_.size() && sendWindow_ > 0;) {
+                auto &stream = *sending_[i];
+                auto &body   = stream.response.body();
+                auto  chunk  = std::min<std::size_t>(
+                    { body.size() - stream.sent, std::size_t(std::max<std::int64_t>(stream.sendWindow, 0)),
+                      std::size_t(sendWindow_), peerMaxFrameSize_ });
+                if (!chunk) {
+                    i++;
+                    continue;
+                }
+                bool last = stream.sent + chunk == body.size();
+                queueFrame(http2::FrameType::Data,
+                           last ? http2::flags::end_stream : 0,
+                           stream.id,
+                           std::string_view(body).substr(stream.sent, chunk));
+                stream.sent += chunk;
+                stream.sendWindow -= chunk;
+                sendWindow_ -= chunk;
+                progress = true;
+                if (last) {
+                    finishStream(stream); // removes it from sending_
+                } else {
+                    i++;
+                }
+            }
+        }
+    }
+
+    // writes everything queued at once, then waits for more
+    boost::asio::awaitable<void> writeLoop()
+    {
+        using boost::asio::use_awaitable;
+        boost::system::error_code ec;
+        std::string               writing;
+        for (;;) {
+            if (!outbox_.empty()) {
+                std::swap(writing, outbox_);
+                co_await boost::asio::async_write(
+                    stream_, boost::asio::buffer(writing), boost::asio::redirect_error(use_awaitable, ec));
+                writing.clear();
+                if (ec) {
+                    RESTIO_DEBUG("HTTP/2 write failed: " << ec.message());
+                    closing_ = true;
+                    boost::beast::get_lowest_layer(stream_).socket().cancel(ec); // wakes up the reader
+                    break;
+                }
+                pump();
+                continue;
+            }
+            if (closing_) {
+                break;
+            }
+            signal_.expires_at(boost::asio::steady_timer::time_point::max());
+            co_await signal_.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+        }
+        writing_ = false;
+        writerDone_.cancel();
+    }
+
+    Stream                                      &stream_;
+    boost::beast::flat_buffer                   &buffer_;
+    const HttpServer::Http2Options               options_;
+    Dispatch                                     dispatch_;
+    boost::asio::any_io_executor                 executor_;
+    boost::asio::steady_timer                    signal_;       // wakes up the writer
+    boost::asio::steady_timer                    writerDone_;   // wakes up run() when the writer exits
+    boost::asio::steady_timer                    handlersDone_; // wakes up run() when the handlers finish
+    HpackDecoder                                 decoder_;
+    std::vector<HeaderField>                     fields_;
+    std::unordered_map<std::uint32_t, StreamPtr> streams_;               // open streams
+    std::vector<StreamPtr>                       sending_;               // streams with unsent response body
+    std::string                                  outbox_;                // frames to write
+    std::string                                  headerBlock_;           // of HEADERS and CONTINUATIONs
+    std::uint32_t                                headerStream_      = 0; // if CONTINUATION is expected
+    bool                                         headerEndStream_   = false;
+    std::uint32_t                                lastStreamId_      = 0;
+    std::int64_t                                 sendWindow_        = http2::default_window_size; // of the connection
+    std::int64_t                                 peerInitialWindow_ = http2::default_window_size; // of new streams
+    std::uint32_t                                recvWindow_        = 0;
+    std::size_t                                  peerMaxFrameSize_  = http2::default_frame_size;
+    std::size_t                                  handlers_          = 0; // running
+    std::uint32_t                                resets_            = 0; // of streams by the client since resetsSince_
+    std::chrono::steady_clock::time_point        resetsSince_;
+    bool                                         writing_           = false;
+    bool                                         closing_           = false;
+    bool                                         draining_          = false; // GOAWAY is sent
+    bool                                         settingsAcked_     = false; // ours, by the client
+};
+
+} // namespace restio
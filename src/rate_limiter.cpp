@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <string>
+
+namespace restio {
+
+namespace http = ::boost::beast::http;
+
+RateLimiter::RateLimiter(std::size_t capacity) :
+    start_(Clock::now()),
+    mask_(std::bit_ceil(std::max<std::size_t>(capacity / std::size(Set {}.buckets), 1)) - 1),
+    sets_(std::make_unique<Set[]>(mask_ + 1))
+{
+}
+
+RateLimiter::~RateLimiter() = default;
+
+RateLimiter::Clock::duration RateLimiter::acquire(std::uint64_t key, const RateLimit &limit, Clock::time_point now)
+{
+    if (limit.rate <= 0) {
+        return Clock::duration::zero();
+    }
+    key = std::max<std::uint64_t>(key, 1);
+    using namespace std::chrono;
+    std::int64_t t         = duration_cast<nanoseconds>(now - start_).count();
+    std::int64_t interval  = std::int64_t(1e9 / limit.rate);
+    std::int64_t tolerance = std::int64_t(interval * std::max(limit.burst, 1.0));
+
+    // the high bits of the key, the low ones may be alike for similar keys
+    auto   &set    = sets_[(key ^ (key >> 32)) & mask_];
+    Bucket *bucket = nullptr;
+    for (auto &b : set.buckets) {
+        if (b.key.load(std::memory_order_relaxed) == key) {
+            bucket = &b;
+            break;
+        }
+    }
+    if (!bucket) {
+        // a bucket refilled long ago is the least recently used one. nothing is lost evicting a full bucket
+        bucket = std::min_element(std::begin(set.buckets), std::end(set.buckets), [](auto const &a, auto const &b) {
+            return a.tat.load(std::memory_order_relaxed) < b.tat.load(std::memory_order_relaxed);
+        });
+        auto victim = bucket->key.load(std::memory_order_relaxed);
+        if (bucket->key.compare_exchange_strong(victim, key, std::memory_order_relaxed)) {
+            bucket->tat.store(t, std::memory_order_relaxed); // full
+        }
+        // otherwise another key took it just now. share its tokens
+    }
+
+    auto tat = bucket->tat.load(std::memory_order_relaxed);
+    for (;;) {
+        auto next = std::max(tat, t) + interval;
+        if (next - t > tolerance) {
+            return duration_cast<Clock::duration>(nanoseconds(next - t - tolerance));
+        }
+        if (bucket->tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+            return Clock::duration::zero();
+        }
+    }
+}
+
+RateLimiter::Clock::duration RateLimiter::acquire(const Request        &request,
+                                                  const RequestContext &context,
+                                                  std::string_view      header,
+                                                  const RateLimit      &limit,
+                                                  std::uint64_t         salt,
+                                                  Clock::time_point     now)
+{
+    if (!context.peer.empty()) {
+        auto wait = acquire(clientKey(context.peer, 0, salt), limit, now);
+        if (wait != Clock::duration::zero()) {
+            return wait;
+        }
+    }
+    if (!header.empty()) {
+        if (auto it = request.find({ header.data(), header.size() }); it != request.end()) {
+            return acquire(clientKey({ it->value().data(), it->value().size() }, 1, salt), limit, now);
+        }
+    }
+    return Clock::duration::zero();
+}
+
+std::uint64_t RateLimiter::clientKey(std::string_view client, std::uint64_t kind, std::uint64_t salt)
+{
+    // spread the salt over all the bits (splitmix64 constant)
+    return std::hash<std::string_view>()(client) ^ ((salt << 1 | kind) * 0x9e3779b97f4a7c15ull);
+}
+
+void RateLimiter::reject(Response &response, Clock::duration retryAfter)
+{
+    auto seconds = std::chrono::ceil<std::chrono::seconds>(retryAfter).count();
+    response.result(http::status::too_many_requests);
+    response.set(http::field::retry_after, std::to_string(std::max<decltype(seconds)>(seconds, 1)));
+    response.body().clear();
+}
+
+} // namespace restio
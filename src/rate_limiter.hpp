@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_common.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace restio {
+
+/**
+ * @brief Token buckets of clients, e.g. per address.
+ *
+ * The table is split into sets of 4 buckets sharing a cache line. A key maps to one set and takes the least
+ * recently used bucket of it if it's not there yet, so the table never grows and forgotten clients are the idle
+ * ones. Buckets are updated with CAS only (GCRA, equivalent to a token bucket), nothing is locked.
+ * Two keys racing for the same bucket may share its tokens for a moment. Good enough for limiting.
+ */
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // capacity - buckets, rounded up to a power of two
+    explicit RateLimiter(std::size_t capacity = 1 << 16);
+    ~RateLimiter();
+
+    /**
+     * @brief take a token of the key's bucket
+     * @return zero if taken. otherwise how long to wait for the next one
+     */
+    Clock::duration acquire(std::uint64_t key, const RateLimit &limit, Clock::time_point now = Clock::now());
+
+    /**
+     * @brief take a token of each bucket of the client of the request
+     *
+     * The peer address has a bucket, and so does the value of the header if it's set and present. The header
+     * doesn't replace the address: a client sending another value every time still drains the bucket of its address.
+     * Peers of unix domain sockets not sending the header are not limited, they are all local and can't be told apart.
+     * @param salt - mixed in to have separate buckets of the same client, e.g. per API method
+     * @return zero if taken. otherwise how long to wait for the next one
+     */
+    Clock::duration acquire(const Request        &request,
+                            const RequestContext &context,
+                            std::string_view      header,
+                            const RateLimit      &limit,
+                            std::uint64_t         salt = 0,
+                            Clock::time_point     now  = Clock::now());
+
+    // sets 429 with Retry-After
+    static void reject(Response &response, Clock::duration retryAfter);
+
+private:
+    // kind - tells apart addresses and header values
+    static std::uint64_t clientKey(std::string_view client, std::uint64_t kind, std::uint64_t salt);
+
+    struct Bucket {
+        std::atomic<std::uint64_t> key { 0 }; // 0 - free
+        std::atomic<std::int64_t>  tat { 0 }; // theoretical arrival time. nanoseconds since start_
+    };
+    struct alignas(64) Set {
+        Bucket buckets[4];
+    };
+
+    Clock::time_point      start_;
+    std::size_t            mask_;
+    std::unique_ptr<Set[]> sets_;
+};
+
+} // namespace restio
@@ -0,0 +1,240 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "response_cache.hpp"
+
+#include <boost/algorithm/string.hpp>
+
+#include <cstdio>
+
+namespace restio {
+
+namespace http = boost::beast::http;
+
+ResponseCache::ResponseCache(std::size_t maxBytes, std::size_t maxEntries) :
+    maxBytes_(maxBytes), maxEntries_(maxEntries)
+{
+}
+
+void ResponseCache::setLimits(std::size_t maxBytes, std::size_t maxEntries)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    maxBytes_   = maxBytes;
+    maxEntries_ = maxEntries;
+    evict();
+}
+
+std::string ResponseCache::normalizeTarget(std::string_view target)
+{
+    // what API::lookup() treats as the same route. the query is the handler's, it is left as it is
+    std::string normalized;
+    normalized.reserve(target.size());
+    for (auto c : target) {
+        if (c == '/' && (normalized.empty() || normalized.back() == '/')) {
+            continue;
+        }
+        normalized += c;
+    }
+    if (normalized.ends_with('/')) {
+        normalized.pop_back();
+    }
+    return normalized;
+}
+
+std::string ResponseCache::makeKey(int                             apiVersion,
+                                   const Request                  &request,
+                                   std::string_view                normalizedTarget,
+                                   const std::vector<std::string> &vary)
+{
+    auto key = std::to_string(apiVersion);
+    key += ' ';
+    auto verb = http::to_string(request.method());
+    key.append(verb.data(), verb.size());
+    key += ' ';
+    key += normalizedTarget;
+    auto append = [&key, &request](auto const &name) {
+        key += '\n';
+        auto it = request.find(name);
+        if (it != request.end()) {
+            key.append(it->value().data(), it->value().size());
+        }
+    };
+    for (auto const &name : vary) {
+        append(name);
+    }
+    // the cache is shared by all the clients. responses to credentialed requests are per user (RFC 9111 3.5)
+    append(http::field::authorization);
+    append(http::field::cookie);
+    return key;
+}
+
+std::shared_ptr<const ResponseCache::Entry> ResponseCache::find(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        it = index_.find(key);
+    if (it == index_.end()) {
+        return nullptr;
+    }
+    auto slot = it->second;
+    if (slot->entry->expires <= Clock::now()) {
+        erase(slot);
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, slot);
+    return slot->entry;
+}
+
+void ResponseCache::store(std::string    &&key,
+                          int              apiVersion,
+                          std::string    &&normalizedTarget,
+                          Response        &response,
+                          Clock::duration  ttl,
+                          std::uint64_t    generation)
+{
+    if (response.result() != http::status::ok || response.has_content_length()
+        || response.find(http::field::set_cookie) != response.end() || !storable(response)) {
+        return;
+    }
+    auto entry = std::make_shared<Entry>();
+    char etag[24];
+    std::snprintf(etag, sizeof(etag), "\"%016zx\"", std::hash<std::string_view> {}(response.body()));
+    entry->etag = etag;
+    response.set(http::field::etag, entry->etag);
+    entry->header = response.base();
+    entry->header.erase(http::field::date); // a fresh one is set when the hit is written
+    entry->body    = std::make_shared<const std::string>(response.body());
+    entry->expires = Clock::now() + ttl;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_.load(std::memory_order_relaxed)) {
+        return; // invalidated while the handler was running
+    }
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        erase(it->second);
+    }
+    bytes_ += key.size() + entry->body->size();
+    lru_.push_front(Slot { std::move(key), apiVersion, std::move(normalizedTarget), std::move(entry) });
+    index_.emplace(lru_.front().key, lru_.begin());
+    evict();
+}
+
+void ResponseCache::invalidate(int apiVersion, std::string_view targetPrefix)
+{
+    auto prefix  = normalizeTarget(targetPrefix);
+    auto matches = [&prefix](const std::string &target) {
+        if (prefix.empty()) {
+            return true;
+        }
+        return target.starts_with(prefix)
+            && (target.size() == prefix.size() || target[prefix.size()] == '/' || target[prefix.size()] == '?');
+    };
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_.fetch_add(1, std::memory_order_release);
+    for (auto it = lru_.begin(); it != lru_.end();) {
+        auto next = std::next(it);
+        if ((!apiVersion || it->apiVersion == apiVersion) && matches(it->target)) {
+            erase(it);
+        }
+        it = next;
+    }
+}
+
+void ResponseCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_.fetch_add(1, std::memory_order_release);
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+void ResponseCache::apply(const Entry &entry, const Request &request, Response &response, RequestContext &context)
+{
+    auto version    = response.version();
+    auto keep_alive = response.keep_alive();
+    response.base() = entry.header;
+    response.version(version);
+    response.keep_alive(keep_alive);
+    response.body().clear();
+    if (notModified(request, entry.etag)) {
+        response.result(http::status::not_modified);
+        return;
+    }
+    context.sharedBody = entry.body;
+}
+
+bool ResponseCache::notModified(const Request &request, std::string_view etag)
+{
+    auto it = request.find(http::field::if_none_match);
+    if (it == request.end()) {
+        return false;
+    }
+    std::vector<std::string> tags;
+    boost::split(tags, it->value(), boost::is_any_of(","));
+    for (auto &tag : tags) {
+        boost::trim(tag);
+        if (tag.starts_with("W/")) {
+            tag.erase(0, 2); // weak comparison
+        }
+        if (tag == "*" || tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ResponseCache::storable(const Response &response)
+{
+    auto it = response.find(http::field::cache_control);
+    if (it == response.end()) {
+        return true;
+    }
+    std::vector<std::string> directives;
+    boost::split(directives, it->value(), boost::is_any_of(","));
+    for (auto &directive : directives) {
+        boost::trim(directive);
+        auto name = std::string_view(directive).substr(0, directive.find('='));
+        if (boost::iequals(name, "no-store") || boost::iequals(name, "private")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ResponseCache::erase(LRU::iterator it)
+{
+    bytes_ -= it->key.size() + it->entry->body->size();
+    index_.erase(it->key);
+    lru_.erase(it);
+}
+
+void ResponseCache::evict()
+{
+    while (!lru_.empty() && (bytes_ > maxBytes_ || lru_.size() > maxEntries_)) {
+        erase(std::prev(lru_.end()));
+    }
+}
+
+} // namespace restio
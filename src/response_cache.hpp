@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_common.hpp"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace restio {
+
+/**
+ * @brief Bounded LRU cache of GET responses.
+ *
+ * Thread-safe. Entries expire after their TTL and the least recently used ones are evicted when the cache
+ * is over its entry or byte limits. Bodies are shared, so the lock is never held while a body is copied.
+ */
+class ResponseCache {
+public:
+    using Clock = RequestContext::Clock;
+
+    struct Entry {
+        Response::header_type              header; // with the ETag
+        std::string                        etag;   // quoted
+        std::shared_ptr<const std::string> body;
+        Clock::time_point                  expires;
+    };
+
+    ResponseCache(std::size_t maxBytes = 16 * 1024 * 1024, std::size_t maxEntries = 4096);
+
+    void setLimits(std::size_t maxBytes, std::size_t maxEntries);
+
+    // target relative to the api root with leading, duplicate and trailing slashes removed, as the router sees it
+    static std::string normalizeTarget(std::string_view target);
+
+    // vary - names of request headers affecting the response. Authorization and Cookie are always a part of the key
+    static std::string makeKey(int                             apiVersion,
+                               const Request                  &request,
+                               std::string_view                normalizedTarget,
+                               const std::vector<std::string> &vary);
+
+    std::shared_ptr<const Entry> find(const std::string &key);
+
+    // changes on every invalidation. Take it before the handler runs and pass it to store()
+    std::uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+    // stores successful responses only, unless they are marked no-store or private or set cookies. sets ETag of the
+    // response. Nothing is stored if the cache was invalidated since the generation was taken, the response may be
+    // outdated then.
+    void store(std::string    &&key,
+               int              apiVersion,
+               std::string    &&normalizedTarget,
+               Response        &response,
+               Clock::duration  ttl,
+               std::uint64_t    generation);
+
+    // drops entries of the api version whose normalized target is the prefix or below it, i.e. "users/1" drops
+    // "users/1/posts" and "users/1?x=y" but not "users/10". apiVersion 0 - any version
+    void invalidate(int apiVersion, std::string_view targetPrefix);
+    void clear();
+
+    // fills the response from the entry, all the headers the handler set included. answers 304 if the request has
+    // a matching If-None-Match. The body is not copied, it's shared via RequestContext::sharedBody
+    static void apply(const Entry &entry, const Request &request, Response &response, RequestContext &context);
+
+    // true if If-None-Match of the request matches the etag
+    static bool notModified(const Request &request, std::string_view etag);
+
+private:
+    struct Slot {
+        std::string                  key;
+        int                          apiVersion;
+        std::string                  target; // normalized
+        std::shared_ptr<const Entry> entry;
+    };
+    using LRU = std::list<Slot>; // most recently used first
+
+    // false if Cache-Control of the response forbids shared caches to store it
+    static bool storable(const Response &response);
+
+    void erase(LRU::iterator it);
+    void evict();
+
+    std::mutex                                          mutex_;
+    LRU                                                 lru_;
+    std::unordered_map<std::string_view, LRU::iterator> index_; // keys point into lru_
+    std::size_t                                         bytes_ = 0;
+    std::size_t                                         maxBytes_;
+    std::size_t                                         maxEntries_;
+    std::atomic<std::uint64_t>                          generation_ { 0 }; // bumped under the mutex
+};
+
+} // namespace restio
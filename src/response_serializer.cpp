@@ -0,0 +1,240 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "response_serializer.hpp"
+
+#include <boost/beast/http/write.hpp>
+
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <ctime>
+#include <sstream>
+
+namespace restio {
+
+namespace http = boost::beast::http;
+
+namespace {
+
+    constexpr const char      *server_name  = "Restio/" RESTIO_VERSION;
+    constexpr std::string_view server_field = "Server: Restio/" RESTIO_VERSION "\r\n";
+
+    inline void append(std::string &out, boost::beast::string_view s) { out.append(s.data(), s.size()); }
+
+    // "HTTP/1.x <code> <reason>\r\n" for every known status
+    class StatusLines {
+    public:
+        static constexpr unsigned first = 100;
+        static constexpr unsigned last  = 599;
+
+        StatusLines()
+        {
+            for (unsigned code = first; code <= last; code++) {
+                auto reason = http::obsolete_reason(http::int_to_status(code));
+                if (reason == "<unknown-status>") {
+                    continue;
+                }
+                auto tail = " " + std::to_string(code) + " " + std::string(reason.data(), reason.size()) + "\r\n";
+                http10_[code - first] = "HTTP/1.0" + tail;
+                http11_[code - first] = "HTTP/1.1" + tail;
+            }
+        }
+
+        // empty if unknown
+        const std::string &get(unsigned version, unsigned code) const
+        {
+            static const std::string none;
+            if (code < first || code > last) {
+                return none;
+            }
+            return version == 10 ? http10_[code - first] : http11_[code - first];
+        }
+
+    private:
+        std::array<std::string, last - first + 1> http10_;
+        std::array<std::string, last - first + 1> http11_;
+    };
+
+    const StatusLines &statusLines()
+    {
+        static const StatusLines lines;
+        return lines;
+    }
+
+    // "Date: <IMF-fixdate>\r\n", rendered at most once a second per thread
+    std::string_view dateField()
+    {
+        static constexpr const char *days[]   = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+        static constexpr const char *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                                  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+        thread_local std::time_t renderedAt = -1;
+        thread_local char        field[64];
+        thread_local std::size_t length = 0;
+
+        auto now = std::time(nullptr);
+        if (now != renderedAt) {
+            std::tm tm;
+            gmtime_r(&now, &tm);
+            auto n = std::snprintf(field, sizeof(field), "Date: %s, %02d %s %04d %02d:%02d:%02d GMT\r\n",
+                                   days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour,
+                                   tm.tm_min, tm.tm_sec);
+            length     = n > 0 ? std::size_t(n) : 0;
+            renderedAt = now;
+        }
+        return { field, length };
+    }
+
+    // see serializeHeader. the body may be elsewhere
+    void renderHeader(const Response &response, std::size_t bodySize, std::string &out)
+    {
+        out.clear();
+        auto const &statusLine = statusLines().get(response.version(), response.result_int());
+        // the table has the default reasons only. Beast reports the default one unless another one was set
+        if (statusLine.empty() || response.reason() != http::obsolete_reason(response.result())) {
+            out += response.version() == 10 ? "HTTP/1.0 " : "HTTP/1.1 ";
+            out += std::to_string(response.result_int());
+            out += ' ';
+            append(out, response.reason());
+            out += "\r\n";
+        } else {
+            out += statusLine;
+        }
+
+        bool hasServer = false;
+        bool hasDate   = false;
+        for (auto const &field : response) {
+            switch (field.name()) {
+            case http::field::server:
+                hasServer = true;
+                break;
+            case http::field::date:
+                hasDate = true;
+                break;
+            case http::field::content_length:
+                continue;
+            default:
+                break;
+            }
+            append(out, field.name_string());
+            out += ": ";
+            append(out, field.value());
+            out += "\r\n";
+        }
+        if (!hasServer) {
+            out += server_field;
+        }
+        if (!hasDate) {
+            out += dateField();
+        }
+        if (bodyAllowed(response.result())) {
+            char buf[24];
+            auto res = std::to_chars(buf, buf + sizeof(buf), bodySize);
+            out += "Content-Length: ";
+            out.append(buf, res.ptr);
+            out += "\r\n";
+        }
+        out += "\r\n";
+    }
+
+} // namespace
+
+bool bodyAllowed(http::status status)
+{
+    return http::to_status_class(status) != http::status_class::informational && status != http::status::no_content
+        && status != http::status::not_modified;
+}
+
+std::string_view httpDate()
+{
+    constexpr std::string_view prefix = "Date: ";
+    auto                       field  = dateField();
+    return field.substr(prefix.size(), field.size() - prefix.size() - 2);
+}
+
+void ResponseBatch::add(Response &response, std::shared_ptr<const std::string> sharedBody)
+{
+    if (count_ == entries_.size()) {
+        entries_.emplace_back();
+    }
+    auto &entry = entries_[count_++];
+    if (!response.body().empty() || !bodyAllowed(response.result())) {
+        sharedBody.reset();
+    }
+    if (response.has_content_length() || response.find(http::field::transfer_encoding) != response.end()) {
+        // framing was chosen by the handler. let Beast do it as it wishes, with the fields we always send
+        if (response.find(http::field::server) == response.end()) {
+            response.set(http::field::server, server_name);
+        }
+        if (response.find(http::field::date) == response.end()) {
+            auto date = httpDate();
+            response.set(http::field::date, boost::beast::string_view(date.data(), date.size()));
+        }
+        if (sharedBody) {
+            response.body() = *sharedBody;
+        }
+        std::ostringstream os;
+        os << response;
+        entry.header = os.str();
+        entry.body.clear();
+        return;
+    }
+    if (!bodyAllowed(response.result())) {
+        response.body().clear();
+    }
+    entry.body       = std::move(response.body());
+    entry.sharedBody = std::move(sharedBody);
+    renderHeader(response, entry.sharedBody ? entry.sharedBody->size() : entry.body.size(), entry.header);
+}
+
+const std::vector<boost::asio::const_buffer> &ResponseBatch::buffers()
+{
+    buffers_.clear();
+    for (std::size_t i = 0; i < count_; i++) {
+        auto const &entry = entries_[i];
+        auto const &body  = entry.sharedBody ? *entry.sharedBody : entry.body;
+        buffers_.emplace_back(entry.header.data(), entry.header.size());
+        if (!body.empty()) {
+            buffers_.emplace_back(body.data(), body.size());
+        }
+    }
+    return buffers_;
+}
+
+void ResponseBatch::clear()
+{
+    for (std::size_t i = 0; i < count_; i++) {
+        entries_[i].body = {}; // bodies may be big. don't keep them
+        entries_[i].sharedBody.reset();
+    }
+    count_ = 0;
+    buffers_.clear();
+}
+
+void serializeHeader(const Response &response, std::string &out)
+{
+    renderHeader(response, response.body().size(), out);
+}
+
+} // namespace restio
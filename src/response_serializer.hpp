@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_common.hpp"
+
+#include <boost/asio/buffer.hpp>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace restio {
+
+/**
+ * @brief Responses collected for a single gathered write.
+ *
+ * Headers are rendered into strings owned by the batch, bodies are moved in or shared without copying.
+ * Content-Length is computed from the body, so there is no need to call prepare_payload(). Server and Date
+ * are added unless the response has them already. Responses with their own Content-Length or
+ * Transfer-Encoding are serialized by Beast.
+ */
+class ResponseBatch {
+public:
+    // moves the body out of the response. sharedBody is sent instead of an empty body, see RequestContext::sharedBody
+    void add(Response &response, std::shared_ptr<const std::string> sharedBody = {});
+
+    inline bool        empty() const { return count_ == 0; }
+    inline std::size_t size() const { return count_; }
+
+    // valid until the batch is modified
+    const std::vector<boost::asio::const_buffer> &buffers();
+
+    void clear();
+
+private:
+    struct Entry {
+        std::string                        header;
+        std::string                        body;
+        std::shared_ptr<const std::string> sharedBody;
+    };
+
+    std::vector<Entry>                     entries_; // entries beyond count_ are kept to reuse their memory
+    std::size_t                            count_ = 0;
+    std::vector<boost::asio::const_buffer> buffers_;
+};
+
+// renders the status line, the fields, Server, Date and Content-Length headers and the empty line after them.
+// Content-Length of the response itself is ignored.
+void serializeHeader(const Response &response, std::string &out);
+
+// false for 1xx, 204 and 304
+bool bodyAllowed(boost::beast::http::status status);
+
+// the current time for the Date header
+std::string_view httpDate();
+
+} // namespace restio
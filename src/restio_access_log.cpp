@@ -0,0 +1,241 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "restio_access_log.hpp"
+
+#include <boost/asio/ip/address.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace restio {
+
+namespace {
+
+    constexpr char          log_magic[8]   = { 'R', 'E', 'S', 'T', 'I', 'O', 'A', 'L' };
+    constexpr std::uint32_t format_version = 1;
+    constexpr std::uint64_t slot_busy      = ~std::uint64_t(0); // the sequence of a slot being written
+
+    [[noreturn]] void throwError(const std::string &what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // reads exactly size bytes or fails
+    bool readAt(int fd, void *data, std::size_t size, off_t offset)
+    {
+        auto bytes = static_cast<char *>(data);
+        while (size) {
+            auto n = ::pread(fd, bytes, size, offset);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            bytes += n;
+            size -= std::size_t(n);
+            offset += n;
+        }
+        return true;
+    }
+
+} // namespace
+
+// takes the first slot of the file
+struct AccessLog::Header {
+    char          magic[8];
+    std::uint32_t formatVersion;
+    std::uint32_t recordSize;
+    std::uint64_t capacity;
+    std::uint64_t written; // records. the next one gets written + 1 as its sequence
+    std::uint8_t  padding[sizeof(AccessLogRecord) - 32];
+
+    bool valid() const
+    {
+        return std::equal(std::begin(magic), std::end(magic), std::begin(log_magic))
+            && formatVersion == format_version && recordSize == sizeof(AccessLogRecord) && capacity;
+    }
+};
+
+AccessLog::AccessLog(const std::string &path, std::size_t capacity) :
+    capacity_(std::max<std::size_t>(capacity, 1)), mappedSize_((capacity_ + 1) * sizeof(AccessLogRecord))
+{
+    static_assert(sizeof(Header) == sizeof(AccessLogRecord));
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throwError("Failed to open " + path);
+    }
+    Header      existing;
+    struct stat st;
+    bool        reused = ::fstat(fd_, &st) == 0 && std::size_t(st.st_size) == mappedSize_
+        && readAt(fd_, &existing, sizeof(existing), 0) && existing.valid() && existing.capacity == capacity_;
+    // zeros without writing them
+    if (!reused && (::ftruncate(fd_, 0) != 0 || ::ftruncate(fd_, off_t(mappedSize_)) != 0)) {
+        auto error = errno;
+        ::close(fd_);
+        errno = error;
+        throwError("Failed to resize " + path);
+    }
+    // the blocks are allocated now. A sparse file out of space would crash the writers with SIGBUS instead
+    if (auto error = ::posix_fallocate(fd_, 0, off_t(mappedSize_)); error != 0) {
+        ::close(fd_);
+        errno = error;
+        throwError("Failed to allocate " + path);
+    }
+    auto memory = ::mmap(nullptr, mappedSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (memory == MAP_FAILED) {
+        auto error = errno;
+        ::close(fd_);
+        errno = error;
+        throwError("Failed to map " + path);
+    }
+    header_  = static_cast<Header *>(memory);
+    records_ = reinterpret_cast<AccessLogRecord *>(header_ + 1);
+    if (!reused) {
+        std::memcpy(header_->magic, log_magic, sizeof(log_magic));
+        header_->formatVersion = format_version;
+        header_->recordSize    = sizeof(AccessLogRecord);
+        header_->capacity      = capacity_;
+    }
+    // left by a process that died while writing them. the writers would wait for them forever
+    for (std::size_t i = 0; reused && i < capacity_; i++) {
+        if (records_[i].sequence == slot_busy) {
+            records_[i].sequence = 0;
+        }
+    }
+}
+
+AccessLog::~AccessLog()
+{
+    ::munmap(header_, mappedSize_);
+    ::close(fd_);
+}
+
+void AccessLog::write(const AccessLogRecord &record)
+{
+    auto sequence = std::atomic_ref<std::uint64_t>(header_->written).fetch_add(1, std::memory_order_relaxed) + 1;
+    auto &slot    = records_[(sequence - 1) % capacity_];
+
+    // the writer that claims the slot owns it till the sequence is set. readers skip it meanwhile.
+    // another writer may get to it too once the ring wraps around: it waits, and only the newer record is kept
+    std::atomic_ref<std::uint64_t> marker(slot.sequence);
+    auto                           current = marker.load(std::memory_order_relaxed);
+    for (;;) {
+        if (current == slot_busy) {
+            current = marker.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (current > sequence) {
+            return; // overwritten already
+        }
+        if (marker.compare_exchange_weak(current, slot_busy, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    constexpr auto offset = sizeof(record.sequence);
+    std::memcpy(reinterpret_cast<char *>(&slot) + offset,
+                reinterpret_cast<const char *>(&record) + offset,
+                sizeof(record) - offset);
+    marker.store(sequence, std::memory_order_release);
+}
+
+std::vector<AccessLogRecord> AccessLog::read(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throwError("Failed to open " + path);
+    }
+    Header      header;
+    struct stat st;
+    bool        valid = readAt(fd, &header, sizeof(header), 0) && header.valid() && ::fstat(fd, &st) == 0
+        && std::uint64_t(st.st_size) >= (header.capacity + 1) * sizeof(AccessLogRecord);
+    std::size_t size   = valid ? (header.capacity + 1) * sizeof(AccessLogRecord) : 0;
+    void       *memory = valid ? ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    auto        error  = errno;
+    ::close(fd);
+    if (!valid) {
+        throw std::runtime_error(path + " is not an access log");
+    }
+    if (memory == MAP_FAILED) {
+        errno = error;
+        throwError("Failed to map " + path);
+    }
+
+    // the slots are read as seqlocks: a record is dropped if a writer changed it while it was copied
+    auto                         slots = reinterpret_cast<AccessLogRecord *>(static_cast<Header *>(memory) + 1);
+    std::vector<AccessLogRecord> records;
+    records.reserve(header.capacity);
+    for (std::uint64_t i = 0; i < header.capacity; i++) {
+        std::atomic_ref<std::uint64_t> marker(slots[i].sequence);
+        auto                           sequence = marker.load(std::memory_order_acquire);
+        if (!sequence || sequence == slot_busy) {
+            continue;
+        }
+        AccessLogRecord record;
+        std::memcpy(&record, &slots[i], sizeof(record));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (marker.load(std::memory_order_relaxed) == sequence) {
+            record.sequence = sequence;
+            records.push_back(record);
+        }
+    }
+    ::munmap(memory, size);
+    std::sort(records.begin(), records.end(), [](auto const &a, auto const &b) { return a.sequence < b.sequence; });
+    return records;
+}
+
+std::uint32_t AccessLog::routeId(std::string_view route)
+{
+    std::uint32_t hash = 2166136261u;
+    for (unsigned char c : route) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+void AccessLog::encodePeer(std::string_view peer, std::uint8_t (&address)[16])
+{
+    boost::system::error_code ec;
+    auto                      ip = boost::asio::ip::make_address(peer, ec);
+    if (ec) {
+        std::fill(std::begin(address), std::end(address), 0);
+        return;
+    }
+    auto v6    = ip.is_v4() ? boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped, ip.to_v4()) : ip.to_v6();
+    auto bytes = v6.to_bytes();
+    std::copy(bytes.begin(), bytes.end(), address);
+}
+
+} // namespace restio
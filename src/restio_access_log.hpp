@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace restio {
+
+/**
+ * @brief A request as written to the access log. The layout of the file, native byte order.
+ */
+struct AccessLogRecord {
+    std::uint64_t sequence;      // 1 for the first record of the file. 0 - the slot is empty, ~0 - being written
+    std::uint64_t timestamp;     // microseconds since the unix epoch, when the response was ready
+    std::uint32_t routeId;       // FNV-1a of the matched route (base path included). 0 - no route
+    std::uint16_t status;
+    std::uint8_t  method;        // http::verb
+    std::uint8_t  version;       // 10, 11 or 20 for HTTP/2
+    std::uint32_t readMicros;    // from the first byte of the request till it's parsed. 0 for HTTP/2
+    std::uint32_t handlerMicros; // from routing till the response is ready
+    std::uint32_t writeMicros;   // till the response is written. 0 for HTTP/2
+    std::uint32_t requestBytes;  // of the body
+    std::uint32_t responseBytes; // of the body
+    std::uint32_t reserved;
+    std::uint8_t  peer[16];      // IPv6 address of the client. IPv4 ones are v4-mapped, unix sockets are zeros
+    char          target[64];    // truncated. not null-terminated if it's that long
+};
+static_assert(sizeof(AccessLogRecord) == 128);
+
+/**
+ * @brief Structured access log of fixed-size binary records in a memory-mapped ring file.
+ *
+ * Writing a record is a copy to the mapped memory, the kernel writes it to the file. Once the file is full
+ * the oldest records are overwritten. Records of a log opened again are kept if its capacity is the same.
+ * Thread-safe, records may be written by many threads at once. Use tools/restio-accesslog to read the file.
+ */
+class AccessLog {
+public:
+    /**
+     * @param capacity - records kept. the file takes 128 bytes per record
+     * Throws std::system_error if the file can't be created, allocated on the disk or mapped.
+     */
+    explicit AccessLog(const std::string &path, std::size_t capacity = 1 << 20);
+    ~AccessLog();
+
+    AccessLog(const AccessLog &)            = delete;
+    AccessLog &operator=(const AccessLog &) = delete;
+
+    // the sequence is set by the log
+    void write(const AccessLogRecord &record);
+
+    // records of the file from the oldest one. Throws std::system_error if it can't be read, std::runtime_error
+    // if it's not an access log
+    static std::vector<AccessLogRecord> read(const std::string &path);
+
+    static std::uint32_t routeId(std::string_view route);
+
+    // peer - text form of an IP address. zeros if it isn't one
+    static void encodePeer(std::string_view peer, std::uint8_t (&address)[16]);
+
+private:
+    struct Header;
+
+    int              fd_ = -1;
+    std::size_t      capacity_;
+    std::size_t      mappedSize_;
+    Header          *header_;
+    AccessLogRecord *records_;
+};
+
+} // namespace restio
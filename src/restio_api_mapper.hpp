@@ -30,8 +30,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <span>
 
 #include "restio_common.hpp"
+#include "restio_middleware.hpp"
 #include "restio_properties.hpp"
 
+#include <stdexcept>
+#include <string>
 #include <type_traits>
 
 namespace restio::api {
@@ -41,42 +44,110 @@ namespace http = ::boost::beast::http; // from <boost/beast/http.hpp>
 using ::boost::asio::awaitable;
 
 struct API {
+    /**
+     * @brief where the handler runs
+     *
+     * Inline - on the io thread of the session. Good for anything cheap or waiting for i/o.
+     * Offload - on the CPU pool of the RestHandler (see RestHandler::setOffloadExecutor). The session's
+     *           executor is resumed once the handler finishes, so heavy handlers don't stall other connections.
+     */
+    enum class Execution : std::uint8_t { Inline, Offload };
+
+    /**
+     * @brief caching of successful GET responses
+     *
+     * Cached responses are served without calling the handler till the ttl expires or RestHandler::invalidateCache
+     * is called. Responses get an ETag, so clients may revalidate with If-None-Match and receive 304.
+     * Responses marked Cache-Control: no-store or private are not cached. Requests with different Authorization or
+     * Cookie never share a response.
+     */
+    struct CachePolicy {
+        RequestContext::Clock::duration ttl = RequestContext::Clock::duration::zero(); // zero - not cached
+        std::vector<std::string>        vary; // request headers the response depends on
+    };
+
     struct Method {
-        using Handler
-            = std::function<awaitable<void>(Request &request, Response &response, const Properties &properties)>;
-        // using SyncHandler = std::function<void(Request &request, Response &response, const Properties &properties)>;
-
-        http::verb  method;
-        std::string uri;
-        std::string comment;
-        json        inputExample;
-        json        outputExample;
-        std::string responseStatus;
-        Handler     handler;
-
-        // Wrapping hardler to an async func if it's synchronous
-        template <typename HandlerType>
-        inline static Handler wrapHandler(
-            HandlerType &&handler,
-            typename std::enable_if<
-                std::is_same<typename std::invoke_result<HandlerType, Request &, Response &, const Properties &>::type,
-                             awaitable<void>>::value>::type * = 0)
+        using Handler     = Function<awaitable<void>(
+            Request &request, Response &response, const Properties &properties, RequestContext &context)>;
+        using SyncHandler = Function<void(
+            Request &request, Response &response, const Properties &properties, RequestContext &context)>;
+
+        http::verb                      method;
+        std::string                     uri;
+        std::string                     comment;
+        json                            inputExample;
+        json                            outputExample;
+        std::string                     responseStatus;
+        Handler                         handler;     // set if the handler is a coroutine
+        SyncHandler                     syncHandler; // set if the handler is synchronous. runs without coroutine frames
+        Execution                       execution = Execution::Inline;
+        RequestContext::Clock::duration timeout   = RequestContext::Clock::duration::zero(); // zero - server's one
+        CachePolicy                     caching;
+        bool                            coalesce = false; // identical concurrent GETs share one handler call
+        RateLimit                       rateLimit;        // per client. see RestHandler::setRateLimitKey
+
+        /**
+         * @brief set the handler
+         *
+         * Accepted signatures are
+         *   awaitable<void>|void (Request &, Response &, const Properties &)
+         *   awaitable<void>|void (Request &, Response &, const Properties &, RequestContext &)
+         */
+        template <typename HandlerType> inline Method &setHandler(HandlerType &&newHandler)
         {
-            return handler;
+            if constexpr (std::is_invocable_v<HandlerType &, Request &, Response &, const Properties &>) {
+                using Result = std::invoke_result_t<HandlerType &, Request &, Response &, const Properties &>;
+                return setHandler([newHandler = std::forward<HandlerType>(newHandler)](
+                                      Request &request, Response &response, const Properties &properties, RequestContext &) mutable
+                                      -> Result { return newHandler(request, response, properties); });
+            } else {
+                using Result
+                    = std::invoke_result_t<HandlerType &, Request &, Response &, const Properties &, RequestContext &>;
+                static_assert(std::is_void_v<Result> || std::is_same_v<Result, awaitable<void>>,
+                              "API handler has to return either void or awaitable<void>");
+                if constexpr (std::is_void_v<Result>) {
+                    handler     = nullptr;
+                    syncHandler = std::forward<HandlerType>(newHandler);
+                } else {
+                    handler     = std::forward<HandlerType>(newHandler);
+                    syncHandler = nullptr;
+                }
+                return *this;
+            }
         }
 
-        template <typename HandlerType>
-        inline static Handler wrapHandler(
-            HandlerType &&handler,
-            typename std::enable_if<
-                std::is_same<typename std::invoke_result<HandlerType, Request &, Response &, const Properties &>::type,
-                             void>::value>::type * = 0)
+        // answer 504 if the handler doesn't finish in time. see RequestContext::stopToken
+        inline Method &setTimeout(RequestContext::Clock::duration newTimeout)
         {
-            return [handler = std::move(handler)](
-                       Request &request, Response &response, const Properties &properties) -> awaitable<void> {
-                handler(request, response, properties);
-                co_return;
-            };
+            timeout = newTimeout;
+            return *this;
+        }
+
+        inline Method &offload()
+        {
+            execution = Execution::Offload;
+            return *this;
+        }
+
+        // requests arriving while an identical GET is handled wait for it and get a copy of its response.
+        // Identical includes the credentials (Authorization, Cookie). Responses with Set-Cookie aren't shared
+        inline Method &setCoalesce(bool enabled = true)
+        {
+            coalesce = enabled;
+            return *this;
+        }
+
+        inline Method &setCache(RequestContext::Clock::duration ttl, std::vector<std::string> &&vary = {})
+        {
+            caching = { ttl, std::move(vary) };
+            return *this;
+        }
+
+        // answer 429 to clients calling the method more often. checked before the cache
+        inline Method &setRateLimit(double rate, double burst = 1)
+        {
+            rateLimit = { rate, burst };
+            return *this;
         }
 
         template <typename RequestMessage, typename ResponseMessage, typename HandlerType>
@@ -86,15 +157,23 @@ struct API {
                                     std::string &&responseStatus,
                                     HandlerType &&handler)
         {
-            return Method {
+            Method m {
                 method,
                 std::move(uri),
                 std::move(desc),
                 RequestMessage::docSample(),
                 ResponseMessage::docSample(),
                 std::move(responseStatus),
-                std::move(wrapHandler(std::move(handler))),
+                {},
+                {},
+                Execution::Inline,
+                RequestContext::Clock::duration::zero(),
+                {},
+                false,
+                {},
             };
+            m.setHandler(std::forward<HandlerType>(handler));
+            return m;
         }
 
         struct Dummy {
@@ -166,12 +245,76 @@ struct API {
         return *this;
     }
 
+    // run the method added last on the offload pool
+    inline API &offload()
+    {
+        lastMethod().offload();
+        return *this;
+    }
+
+    // set timeout of the method added last
+    inline API &timeout(RequestContext::Clock::duration timeout)
+    {
+        lastMethod().setTimeout(timeout);
+        return *this;
+    }
+
+    // coalesce identical concurrent GETs of the method added last
+    inline API &coalesce()
+    {
+        lastMethod().setCoalesce();
+        return *this;
+    }
+
+    // cache responses of the method added last. see CachePolicy
+    inline API &cache(RequestContext::Clock::duration ttl, std::vector<std::string> &&vary = {})
+    {
+        lastMethod().setCache(ttl, std::move(vary));
+        return *this;
+    }
+
+    /**
+     * @brief clients asking for an older version, down to the oldest one, may be served by this one
+     *
+     * Applies when the version is negotiated (see RestHandler::registerAPI) and the one asked for isn't registered.
+     */
+    inline API &compatibleWith(int oldest)
+    {
+        compatibleFrom = oldest;
+        return *this;
+    }
+
+    // limit requests per second of a client to the method added last
+    inline API &rateLimit(double rate, double burst = 1)
+    {
+        lastMethod().setRateLimit(rate, burst);
+        return *this;
+    }
+
+    // run the middlewares around all the methods of the version. see MiddlewareChain. replaces the ones used before
+    template <typename... M> inline API &use(M &&...middlewares)
+    {
+        middleware = makeMiddleware(std::forward<M>(middlewares)...);
+        return *this;
+    }
+
+    // the one the settings above apply to. Throws std::logic_error if no method was added yet
+    inline Method &lastMethod()
+    {
+        if (methods.empty()) {
+            throw std::logic_error("API v" + std::to_string(version) + ": add a method before setting it up");
+        }
+        return methods.back();
+    }
+
     void                        buildParser();
     std::optional<LookupResult> lookup(http::verb method, std::string_view target) const;
 
-    int                     version = 1;
-    std::vector<Method>     methods;
-    std::vector<ParsedNode> roots;
+    int                         version        = 1;
+    int                         compatibleFrom = 0; // the oldest version this one may serve. 0 - only itself
+    std::vector<Method>         methods;
+    std::vector<ParsedNode>     roots;
+    std::shared_ptr<Middleware> middleware; // seen by the requests to the version's root too
 };
 
 } // namespace restio::api
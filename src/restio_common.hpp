@@ -24,6 +24,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include "restio_function.hpp"
+#include "restio_request_context.hpp"
+
 #include <boost/asio/awaitable.hpp>
 #include <boost/beast/http.hpp>
 
@@ -31,5 +34,48 @@ namespace restio {
 using Request  = boost::beast::http::request<boost::beast::http::string_body>;
 using Response = boost::beast::http::response<boost::beast::http::string_body>;
 
-using RequestHandler = std::function<boost::asio::awaitable<void>(std::string_view, Request &, Response &)>;
+// requests of a client per second and how many of them may come at once
+struct RateLimit {
+    double rate  = 0; // zero - unlimited
+    double burst = 1;
+};
+
+/**
+ * A handler may complete synchronously by returning an empty (default constructed) awaitable. Then no coroutine
+ * frame is created for the request at all.
+ *
+ * Use makeRequestHandler() to make one of a function which doesn't need the context or is synchronous.
+ */
+using RequestHandler
+    = Function<boost::asio::awaitable<void>(std::string_view, Request &, Response &, RequestContext &)>;
+
+template <typename Handler> inline RequestHandler makeRequestHandler(Handler &&handler)
+{
+    if constexpr (std::is_invocable_v<Handler &, std::string_view, Request &, Response &, RequestContext &>) {
+        using Result = std::invoke_result_t<Handler &, std::string_view, Request &, Response &, RequestContext &>;
+        if constexpr (std::is_void_v<Result>) {
+            return [handler = std::forward<Handler>(handler)](std::string_view path,
+                                                              Request         &request,
+                                                              Response        &response,
+                                                              RequestContext  &context) mutable
+                   -> boost::asio::awaitable<void> {
+                handler(path, request, response, context);
+                return {};
+            };
+        } else {
+            return RequestHandler(std::forward<Handler>(handler));
+        }
+    } else {
+        return [handler = std::forward<Handler>(handler)](
+                   std::string_view path, Request &request, Response &response, RequestContext &) mutable
+               -> boost::asio::awaitable<void> {
+            if constexpr (std::is_void_v<std::invoke_result_t<Handler &, std::string_view, Request &, Response &>>) {
+                handler(path, request, response);
+                return {};
+            } else {
+                return handler(path, request, response);
+            }
+        };
+    }
+}
 }
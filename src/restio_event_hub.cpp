@@ -0,0 +1,189 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "restio_event_hub.hpp"
+
+#include "atomic_shared_ptr.hpp"
+#include "event_subscriber.hpp"
+
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace restio {
+
+EventSubscriber::EventSubscriber(const boost::asio::any_io_executor &executor, std::size_t maxQueued) :
+    signal(executor), maxQueued_(maxQueued)
+{
+}
+
+bool EventSubscriber::push(const Event &event)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (evicted_) {
+            return false;
+        }
+        if (queue_.size() >= maxQueued_) {
+            evicted_ = true;
+            queue_.clear();
+        } else {
+            queue_.push_back(event);
+            if (queue_.size() > 1) {
+                return true; // the writer is woken up already
+            }
+        }
+    }
+    boost::asio::post(signal.get_executor(), [self = shared_from_this()]() { self->signal.cancel(); });
+    return true;
+}
+
+std::vector<EventSubscriber::Event> EventSubscriber::take()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Event>          events(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.end()));
+    queue_.clear();
+    return events;
+}
+
+bool EventSubscriber::evicted() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return evicted_;
+}
+
+struct EventHub::Private {
+    using Subscribers = std::vector<std::shared_ptr<EventSubscriber>>;
+    struct HistoryEntry {
+        std::string                        id;
+        std::shared_ptr<const std::string> event;
+    };
+
+    AtomicSharedPtr<const Subscribers> subscribers { std::make_shared<const Subscribers>() }; // copy on change
+    std::mutex                         mutex; // subscription changes and history
+    std::deque<HistoryEntry>           history;
+};
+
+namespace {
+
+    // a line break would end the field and start a new field or event
+    std::string singleLine(std::string_view value)
+    {
+        std::string line(value);
+        std::erase_if(line, [](char c) { return c == '\r' || c == '\n'; });
+        return line;
+    }
+
+} // namespace
+
+EventHub::EventHub() : EventHub(Options()) { }
+
+EventHub::EventHub(Options options) : options_(options), d(std::make_unique<Private>()) { }
+
+EventHub::~EventHub() = default;
+
+std::string EventHub::serialize(std::string_view data, std::string_view event, std::string_view id)
+{
+    std::string out;
+    out.reserve(data.size() + event.size() + id.size() + 32);
+    if (!id.empty()) {
+        out += "id: ";
+        out += singleLine(id);
+        out += '\n';
+    }
+    if (!event.empty()) {
+        out += "event: ";
+        out += singleLine(event);
+        out += '\n';
+    }
+    // clients end lines at CRLF, CR or LF
+    for (std::size_t start = 0;;) {
+        auto end = data.find_first_of("\r\n", start);
+        out += "data: ";
+        out += data.substr(start, end - start);
+        out += '\n';
+        if (end == std::string_view::npos) {
+            break;
+        }
+        start = end + (data.substr(end, 2) == "\r\n" ? 2 : 1);
+    }
+    out += '\n';
+    return out;
+}
+
+std::size_t EventHub::publish(std::string_view data, std::string_view event, std::string_view id)
+{
+    auto serialized = std::make_shared<const std::string>(serialize(data, event, id));
+
+    std::shared_ptr<const Private::Subscribers> subscribers;
+    if (options_.historySize && !id.empty()) {
+        // taken together with the history, so a new subscriber gets the event either from the history or from here
+        std::lock_guard<std::mutex> lock(d->mutex);
+        d->history.push_back({ singleLine(id), serialized }); // as the clients see it
+        if (d->history.size() > options_.historySize) {
+            d->history.pop_front();
+        }
+        subscribers = d->subscribers.load();
+    } else {
+        subscribers = d->subscribers.load();
+    }
+    std::size_t queued = 0;
+    for (auto const &subscriber : *subscribers) {
+        if (subscriber->push(serialized)) {
+            queued++;
+        }
+    }
+    return queued;
+}
+
+std::size_t EventHub::subscribers() const { return d->subscribers.load()->size(); }
+
+void EventHub::subscribe(const std::shared_ptr<EventSubscriber> &subscriber, std::string_view lastEventId)
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    auto const                 &history = d->history;
+    if (!lastEventId.empty()) {
+        auto it = std::find_if(
+            history.begin(), history.end(), [lastEventId](auto const &entry) { return entry.id == lastEventId; });
+        if (it != history.end()) {
+            std::for_each(std::next(it), history.end(), [&](auto const &entry) { subscriber->push(entry.event); });
+        }
+    }
+    auto updated = std::make_shared<Private::Subscribers>(*d->subscribers.load());
+    updated->push_back(subscriber);
+    d->subscribers.store(std::move(updated));
+}
+
+void EventHub::unsubscribe(const EventSubscriber *subscriber)
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    auto                        updated = std::make_shared<Private::Subscribers>(*d->subscribers.load());
+    std::erase_if(*updated, [subscriber](auto const &s) { return s.get() == subscriber; });
+    d->subscribers.store(std::move(updated));
+}
+
+} // namespace restio
@@ -0,0 +1,86 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace restio {
+
+class EventSubscriber;
+
+/**
+ * @brief Server-Sent Events publisher.
+ *
+ * Attach to a server with HttpServer::events(). Each published event is serialized once and the same buffer
+ * is queued for every subscriber. A subscriber which doesn't read fast enough to stay within the queue limit
+ * is disconnected. It will reconnect and may catch up from the history with Last-Event-ID.
+ *
+ * Thread-safe.
+ */
+class EventHub {
+public:
+    struct Options {
+        std::size_t               maxQueuedEvents = 256; // per subscriber
+        std::size_t               historySize     = 0;   // events kept for reconnecting clients. need ids
+        std::chrono::seconds      keepAlive { 15 };      // comment sent to idle subscribers
+        std::chrono::milliseconds retry { 0 };           // reconnection time advised to clients. 0 - don't advise
+    };
+
+    EventHub();
+    explicit EventHub(Options options);
+    ~EventHub();
+
+    /**
+     * @brief publish an event to all the subscribers
+     * @param data - multiline data is split to several "data:" fields. Lines end at CRLF, CR or LF
+     * @param event - type of the event. "message" if empty. Line breaks are removed
+     * @param id - becomes Last-Event-ID of the clients. may be empty. Line breaks are removed
+     * @return number of subscribers the event was queued for
+     */
+    std::size_t publish(std::string_view data, std::string_view event = {}, std::string_view id = {});
+
+    std::size_t subscribers() const;
+
+    inline const Options &options() const { return options_; }
+
+    // serialized event as it's sent to clients
+    static std::string serialize(std::string_view data, std::string_view event, std::string_view id);
+
+private:
+    friend class HttpServerPrivate;
+
+    // queues history after lastEventId for the new subscriber
+    void subscribe(const std::shared_ptr<EventSubscriber> &subscriber, std::string_view lastEventId);
+    void unsubscribe(const EventSubscriber *subscriber);
+
+    struct Private;
+    Options                  options_;
+    std::unique_ptr<Private> d;
+};
+
+} // namespace restio
@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace restio {
+
+template <typename Signature, std::size_t InlineSize = 4 * sizeof(void *)> class Function;
+
+/**
+ * @brief Move-only replacement for std::function with inline storage.
+ *
+ * Callables up to InlineSize bytes (e.g. a lambda capturing `this` and a couple of values, or a bound member
+ * function) are kept inside the object, so neither construction nor invocation touches the heap.
+ * Bigger callables are allocated once on construction. Unlike std::function the callable doesn't have to be
+ * copyable.
+ */
+template <typename R, typename... Args, std::size_t InlineSize> class Function<R(Args...), InlineSize> {
+    template <typename F>
+    static constexpr bool is_inline = sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible_v<F>;
+
+    struct VTable {
+        R (*invoke)(void *storage, Args &&...args);
+        void (*move)(void *dst, void *src) noexcept; // move-constructs dst from src and destroys src
+        void (*destroy)(void *storage) noexcept;
+    };
+
+    template <typename F> static F *target(void *storage)
+    {
+        if constexpr (is_inline<F>) {
+            return std::launder(reinterpret_cast<F *>(storage));
+        } else {
+            return *std::launder(reinterpret_cast<F **>(storage));
+        }
+    }
+
+    template <typename F> static constexpr VTable vtable_for {
+        [](void *storage, Args &&...args) -> R { return std::invoke(*target<F>(storage), std::forward<Args>(args)...); },
+        [](void *dst, void *src) noexcept {
+            if constexpr (is_inline<F>) {
+                ::new (dst) F(std::move(*target<F>(src)));
+                target<F>(src)->~F();
+            } else {
+                ::new (dst) F *(target<F>(src));
+            }
+        },
+        [](void *storage) noexcept {
+            if constexpr (is_inline<F>) {
+                target<F>(storage)->~F();
+            } else {
+                delete target<F>(storage);
+            }
+        },
+    };
+
+public:
+    Function() noexcept = default;
+    Function(std::nullptr_t) noexcept { }
+
+    template <typename F,
+              typename D = std::decay_t<F>,
+              typename   = std::enable_if_t<!std::is_same_v<D, Function> && std::is_invocable_r_v<R, D &, Args...>>>
+    Function(F &&f)
+    {
+        // function references decay to pointers too, but they can't be null
+        if constexpr (std::is_pointer_v<std::remove_cvref_t<F>> || std::is_member_pointer_v<D>) {
+            if (!f) {
+                return;
+            }
+        }
+        if constexpr (is_inline<D>) {
+            ::new (static_cast<void *>(storage_)) D(std::forward<F>(f));
+        } else {
+            ::new (static_cast<void *>(storage_)) D *(new D(std::forward<F>(f)));
+        }
+        vtable_ = &vtable_for<D>;
+    }
+
+    Function(Function &&other) noexcept : vtable_(other.vtable_)
+    {
+        if (vtable_) {
+            vtable_->move(storage_, other.storage_);
+            other.vtable_ = nullptr;
+        }
+    }
+
+    Function &operator=(Function &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            if (other.vtable_) {
+                other.vtable_->move(storage_, other.storage_);
+                vtable_       = other.vtable_;
+                other.vtable_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Function &operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    Function(const Function &)            = delete;
+    Function &operator=(const Function &) = delete;
+
+    ~Function() { reset(); }
+
+    // Like std::function, a const Function may still invoke a mutable callable.
+    inline R operator()(Args... args) const
+    {
+        if (!vtable_) {
+            throw std::bad_function_call();
+        }
+        return vtable_->invoke(const_cast<unsigned char *>(storage_), std::forward<Args>(args)...);
+    }
+
+    inline explicit operator bool() const noexcept { return vtable_ != nullptr; }
+
+private:
+    inline void reset() noexcept
+    {
+        if (vtable_) {
+            vtable_->destroy(storage_);
+            vtable_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[InlineSize < sizeof(void *) ? sizeof(void *) : InlineSize];
+    const VTable *vtable_ = nullptr;
+};
+
+} // namespace restio
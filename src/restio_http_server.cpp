@@ -24,120 +24,1084 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "coro_compat.h"
 
+#include "atomic_shared_ptr.hpp"
+#include "buffer_pool.hpp"
+#include "event_subscriber.hpp"
 #include "handler_store.hpp"
+#include "http2_session.hpp"
+#include "rate_limiter.hpp"
+#include "response_serializer.hpp"
+#include "restio_access_log.hpp"
+#include "restio_event_hub.hpp"
 #include "restio_http_server.hpp"
 #include "restio_log.hpp"
+#include "tls_context.hpp"
+#include "websocket_session.hpp"
 
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/asio/awaitable.hpp>
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/co_spawn.hpp>
 #include <boost/asio/detached.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ip/v6_only.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket/rfc6455.hpp>
 #include <boost/system/error_code.hpp>
 
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 namespace beast = boost::beast;
 namespace http  = beast::http;
 using tcp       = boost::asio::ip::tcp;
+// any stream socket: TCP over IPv4 or IPv6, AF_UNIX
+using Protocol = boost::asio::generic::stream_protocol;
+using Socket   = Protocol::socket;
+using Acceptor = boost::asio::basic_socket_acceptor<Protocol>;
 using boost::asio::awaitable;
 using boost::asio::detached;
 using boost::asio::use_awaitable;
 namespace this_coro = boost::asio::this_coro;
 
-#define ensure_success(ec, msg)                                                                                        \
+#define ensure_success(ec, msg, where)                                                                                 \
     if (ec)                                                                                                            \
-        throw std::runtime_error(std::string("Failed to ") + msg + " on " + bind_address + ":"                         \
-                                 + std::to_string(bind_port));
+        throw std::runtime_error(std::string("Failed to ") + msg + " on " + where + ": " + ec.message());
 
 namespace restio {
 
+// responses to pipelined requests written at once
+constexpr std::size_t max_pipelined_responses = 16;
+// the first read of a connection. big enough for a usual HTTP/1 request
+constexpr std::size_t preface_read_size = 4096;
+// borrowed from BufferPool for reading requests
+constexpr std::size_t read_buffer_size = preface_read_size;
+// for TLS handshake and close_notify exchange
+constexpr auto tls_handshake_timeout = std::chrono::seconds(30);
+
 class HttpServerPrivate {
-    HttpHandlerStore  handlers;
-    tcp::acceptor     acceptor;
-    HttpServer::Stats stats;
+    using Routes = std::shared_ptr<const HttpHandlerStore::Snapshot>;
+    // routes of long-living connections. matched exactly
+    template <typename T> using ExactRoutes = std::unordered_map<std::string, std::shared_ptr<T>>;
+
+    // Request and response of a session. Reused for all the requests of the session unless the handler
+    // is abandoned (deadline or client disconnect). Then it stays with the handler and the session makes a new one.
+    // HTTP/2 streams have an exchange each, stopped by the stream's stop source.
+    struct Exchange {
+        Request                    request;
+        Response                   response;
+        RequestContext             context;
+        std::stop_source           stopSource;
+        std::optional<std::size_t> middlewarePassed; // set if the middleware saw the request
+        std::uint32_t              routeId = 0;      // of the access log
+
+        Exchange(std::stop_source source = {}) : stopSource(std::move(source))
+        {
+            context.stopToken = stopSource.get_token();
+        }
+    };
+
+    // the counters of Stats. updated by sessions on any thread, taken by takeStats()
+    struct Counter {
+        std::atomic<std::uint32_t> value { 0 };
+
+        void          operator++(int) { value.fetch_add(1, std::memory_order_relaxed); }
+        std::uint32_t take() { return value.exchange(0, std::memory_order_relaxed); }
+    };
+
+    struct Histogram {
+        std::array<std::atomic<std::uint32_t>, LatencyHistogram::bucket_count> buckets {};
+
+        void add(std::chrono::steady_clock::duration duration)
+        {
+            buckets[LatencyHistogram::bucket(duration)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        LatencyHistogram take()
+        {
+            LatencyHistogram histogram;
+            for (std::size_t i = 0; i < buckets.size(); i++) {
+                histogram.buckets[i] = buckets[i].exchange(0, std::memory_order_relaxed);
+            }
+            return histogram;
+        }
+    };
+
+    struct StatsCounters {
+        Counter   requests;
+        Counter   unknown_requests;
+        Counter   exceptions;
+        Counter   timeouts;
+        Counter   disconnects;
+        Counter   rateLimited;
+        Histogram readLatency;
+        Histogram routingLatency;
+        Histogram handlerLatency;
+        Histogram serializationLatency;
+        Histogram writeLatency;
+    };
+
+    // Shared by the session and the handler it waits for
+    struct HandlerWatch {
+        HandlerWatch(const boost::asio::any_io_executor &executor) : signal(executor) { }
+
+        boost::asio::steady_timer signal;
+        bool                      finished = false;
+        bool                      readable = false;
+        bool                      stopped  = false;
+        std::exception_ptr        exception;
+    };
+
+    enum class HandlerOutcome { Finished, TimedOut, Disconnected };
+
+    // An accepted connection as seen by drain(). Everything but the registration is accessed on its strand
+    struct Connection {
+        boost::asio::any_io_executor executor;
+        bool                         idle     = false; // waits for the next request
+        bool                         draining = false; // answers go with "Connection: close"
+        // what the session does on drain. force - the deadline is hit, the connection has to be closed at once
+        std::function<void(bool force)> onDrain;
+    };
+    using ConnectionPtr = std::shared_ptr<Connection>;
+
+    // Sets the drain hook of a connection for a scope. The hooks refer to the session's locals.
+    class DrainHook {
+    public:
+        DrainHook(Connection &connection, std::function<void(bool)> &&hook) :
+            connection_(connection), previous_(std::exchange(connection.onDrain, std::move(hook)))
+        {
+        }
+        ~DrainHook() { connection_.onDrain = std::move(previous_); }
+
+    private:
+        Connection               &connection_;
+        std::function<void(bool)> previous_;
+    };
+
+    // Shared with the sessions. The ones left in the io_context may be destroyed after the server
+    struct ConnectionRegistry {
+        std::mutex                                 mutex;
+        std::unordered_set<ConnectionPtr>          connections;
+        bool                                       draining = false;
+        std::shared_ptr<boost::asio::steady_timer> drainWaiter; // woken up when the last connection is gone
+
+        ConnectionPtr track(const boost::asio::any_io_executor &executor)
+        {
+            auto                        connection = std::make_shared<Connection>();
+            std::lock_guard<std::mutex> lock(mutex);
+            connection->executor = executor;
+            connection->draining = draining;
+            connections.insert(connection);
+            return connection;
+        }
+
+        void untrack(const ConnectionPtr &connection)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            connections.erase(connection);
+            if (connections.empty() && drainWaiter) {
+                boost::asio::post(drainWaiter->get_executor(), [waiter = drainWaiter]() { waiter->cancel(); });
+            }
+        }
+    };
+
+    // Unregisters the connection when the session ends
+    struct TrackedConnection {
+        std::shared_ptr<ConnectionRegistry> registry;
+        ConnectionPtr                       connection;
+
+        TrackedConnection(std::shared_ptr<ConnectionRegistry> registry, const boost::asio::any_io_executor &executor) :
+            registry(std::move(registry)), connection(this->registry->track(executor))
+        {
+        }
+        ~TrackedConnection() { registry->untrack(connection); }
+    };
 
-    awaitable<void> processRequest(Request &request, Response &response)
+    boost::asio::io_context                                    &ioContext;
+    std::string                                                 serviceName;
+    HttpHandlerStore                                            handlers;
+    std::string                                                 basePath;
+    AtomicSharedPtr<const ExactRoutes<const WebSocketEndpoint>> websockets; // replaced as a whole on change
+    AtomicSharedPtr<const ExactRoutes<EventHub>>                eventHubs;
+    std::mutex                                                  exactRoutesMutex;
+    std::list<Acceptor>                                         acceptors; // a list, listen() refers to its acceptor
+    std::shared_ptr<TlsContext>                                 tls; // plain http if not set
+    StatsCounters                                               stats;
+    HttpServer::Http2Options                                    http2;
+    HttpServer::SocketOptions                                   socketOptions;
+    HttpServer::RateLimitOptions                                rateLimitOptions;
+    std::unique_ptr<RateLimiter>                                rateLimiter; // if the rate is limited
+    std::shared_ptr<Middleware>                                 middleware;
+    std::shared_ptr<AccessLog>                                  accessLog; // written if set
+    RequestObserver                                             requestObserver;
+    RequestContext::Clock::duration requestTimeout     = RequestContext::Clock::duration::zero();
+    bool                            cancelOnDisconnect = true;
+
+    std::shared_ptr<ConnectionRegistry> registry = std::make_shared<ConnectionRegistry>();
+
+    // runs the drain hook on the connection's strand
+    static void drainConnection(const ConnectionPtr &connection, bool force)
     {
-        stats.requests++;
-        auto lookup_result = handlers.lookup(request);
+        boost::asio::post(connection->executor, [connection, force]() {
+            connection->draining = true;
+            if (connection->onDrain) {
+                connection->onDrain(force);
+            }
+        });
+    }
+
+    // Not a coroutine on purpose. Synchronous handlers complete right here and an empty awaitable is returned,
+    // so no coroutine frame is allocated for them. Otherwise the caller has to co_await the result.
+    awaitable<void> processRequest(const HttpHandlerStore::Snapshot &routes, Exchange &exchange)
+    {
+        auto &request  = exchange.request;
+        auto &response = exchange.response;
+        if (!enterRequest(exchange)) {
+            return {};
+        }
+        auto lookup_result               = routes.lookup(request);
+        exchange.context.timings.routed = RequestContext::Clock::now();
         if (!lookup_result) {
             RESTIO_ERROR("unroutable request: " << request.method_string() << " " << request.target()
                                                 << " payload:" << request.body());
             response.result(http::status::not_found);
             stats.unknown_requests++;
-            co_return;
+            return {};
         }
         RESTIO_TRACE("request: " << request.method_string() << " " << request.target()
                                  << " payload:" << request.body());
 
+        if (requestTimeout != RequestContext::Clock::duration::zero()) {
+            exchange.context.setTimeout(requestTimeout);
+        }
         auto const &[path, handler] = *lookup_result;
+        if (accessLog) {
+            auto target      = request.target();
+            exchange.routeId = AccessLog::routeId({ target.data(), target.size() - path.size() });
+        }
         try {
-            co_await handler(path, request, response);
+            return handler(path, request, response, exchange.context);
         } catch (std::exception &e) {
-            stats.exceptions++;
-            RESTIO_ERROR("Session failed: " << e.what());
-            response.result(http::status::internal_server_error);
-            response.reason("Exception happened");
+            onHandlerException(e, response);
         }
+        return {};
     }
 
-    awaitable<void> makeSession(tcp::socket socket)
+    // counts the request and runs the rate limit and the middleware. false if they answered the request already
+    bool enterRequest(Exchange &exchange)
     {
-        beast::flat_buffer        buffer;
-        Request                   request;
-        Response                  response;
-        boost::beast::tcp_stream  stream = boost::beast::tcp_stream(std::move(socket));
-        boost::system::error_code ec;
+        stats.requests++;
+        exchange.middlewarePassed.reset();
+        exchange.routeId       = 0;
+        auto traceparent       = exchange.request["traceparent"];
+        exchange.context.trace = TraceContext::fromHeader({ traceparent.data(), traceparent.size() });
+        return admit(exchange.request, exchange.response, exchange.context)
+            && (!middleware || enterMiddleware(exchange));
+    }
+
+    // false if the client exceeded the rate limit, 429 is answered then
+    bool admit(Request &request, Response &response, const RequestContext &context)
+    {
+        if (!rateLimiter) {
+            return true;
+        }
+        auto wait = rateLimiter->acquire(request, context, rateLimitOptions.keyHeader, rateLimitOptions.limit);
+        if (wait == RateLimiter::Clock::duration::zero()) {
+            return true;
+        }
+        RateLimiter::reject(response, wait);
+        stats.rateLimited++;
+        return false;
+    }
+
+    // false if the middleware answered the request itself
+    bool enterMiddleware(Exchange &exchange)
+    {
+        return enterMiddleware(exchange.request, exchange.response, exchange.context, exchange.middlewarePassed);
+    }
+
+    bool enterMiddleware(Request                    &request,
+                         Response                   &response,
+                         RequestContext             &context,
+                         std::optional<std::size_t> &passed)
+    {
+        try {
+            passed = middleware->before(request, response, context);
+            return middleware->proceeds(*passed);
+        } catch (std::exception &e) {
+            passed.reset();
+            onHandlerException(e, response);
+        }
+        return false;
+    }
+
+    // once the response is ready
+    void leaveMiddleware(Exchange &exchange)
+    {
+        leaveMiddleware(exchange.middlewarePassed, exchange.request, exchange.response, exchange.context);
+    }
+
+    void leaveMiddleware(const std::optional<std::size_t> &passed,
+                         Request                          &request,
+                         Response                         &response,
+                         RequestContext                   &context)
+    {
+        if (!passed || !middleware) {
+            return;
+        }
+        try {
+            middleware->after(*passed, request, response, context);
+        } catch (std::exception &e) {
+            onHandlerException(e, response);
+        }
+    }
+
+    void onHandlerException(std::exception &e, Response &response)
+    {
+        stats.exceptions++;
+        RESTIO_ERROR("Session failed: " << e.what());
+        response.result(http::status::internal_server_error);
+        response.reason("Exception happened");
+    }
+
+    // Runs detached from the session. Keeps everything the handler may refer to alive.
+    static awaitable<void>
+    runHandler(std::shared_ptr<Exchange> /* exchange */, Routes /* routes */, awaitable<void> pending)
+    {
+        co_await std::move(pending);
+    }
+
+    /**
+     * Waits for the handler which suspended, unless its deadline expires or the client disconnects.
+     * In these cases stop is requested in the handler's context and the handler is left running on its own.
+     * Without a socket (HTTP/2 stream) the disconnect is signalled by a stop request from the connection.
+     * So is a connection closed by drain() when its deadline is hit.
+     */
+    awaitable<HandlerOutcome>
+    awaitHandler(const std::shared_ptr<Exchange> &exchange, Routes routes, awaitable<void> pending, Socket *socket)
+    {
+        bool has_deadline = exchange->context.deadline != RequestContext::Clock::time_point::max();
+        if (!has_deadline && !cancelOnDisconnect) {
+            co_await std::move(pending);
+            co_return HandlerOutcome::Finished;
+        }
+
+        auto executor = co_await this_coro::executor;
+        auto watch    = std::make_shared<HandlerWatch>(executor);
+        watch->signal.expires_at(exchange->context.deadline);
+        co_spawn(executor,
+                 runHandler(exchange, std::move(routes), std::move(pending)),
+                 [watch](std::exception_ptr e) {
+                     watch->finished  = true;
+                     watch->exception = e;
+                     watch->signal.cancel();
+                 });
+        bool watch_socket = cancelOnDisconnect && socket;
+        if (watch_socket) {
+            socket->async_wait(Socket::wait_read,
+                               boost::asio::bind_executor(executor, [watch](boost::system::error_code ec) {
+                                   if (!ec && !watch->finished) {
+                                       watch->readable = true;
+                                       watch->signal.cancel();
+                                   }
+                               }));
+        }
+        auto onStop = [watch, executor]() {
+            boost::asio::post(executor, [watch]() {
+                watch->stopped = true;
+                watch->signal.cancel();
+            });
+        };
+        std::stop_callback<decltype(onStop)> stopWatch(exchange->context.stopToken, std::move(onStop));
+
+        for (;;) {
+            boost::system::error_code ec;
+            co_await watch->signal.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+            if (watch->finished) {
+                if (watch_socket) {
+                    socket->cancel(ec);
+                }
+                if (watch->exception) {
+                    std::rethrow_exception(watch->exception);
+                }
+                co_return HandlerOutcome::Finished;
+            }
+            if (watch->readable) {
+                // either eof or the next pipelined request. nothing to watch anymore in the latter case
+                watch->readable = false;
+                watch_socket    = false;
+                char c;
+                if (socket->receive(boost::asio::buffer(&c, 1), Socket::message_peek, ec) == 0) {
+                    exchange->stopSource.request_stop();
+                    co_return HandlerOutcome::Disconnected;
+                }
+                continue;
+            }
+            if (watch->stopped) {
+                co_return HandlerOutcome::Disconnected;
+            }
+            if (!ec) { // deadline
+                exchange->stopSource.request_stop();
+                if (watch_socket) {
+                    socket->cancel(ec);
+                }
+                co_return HandlerOutcome::TimedOut;
+            }
+        }
+    }
+
+    /**
+     * Waits for the handler of the exchange which suspended. If it times out, the exchange is replaced with a new one
+     * answering 504. Returns false if the client is gone, so there is nobody to answer.
+     */
+    awaitable<bool>
+    completeExchange(std::shared_ptr<Exchange> &exchange, Routes routes, awaitable<void> pending, Socket *socket)
+    {
+        auto version    = exchange->request.version();
+        auto keep_alive = exchange->request.keep_alive();
+        auto outcome    = HandlerOutcome::Finished;
+        try {
+            outcome = co_await awaitHandler(exchange, std::move(routes), std::move(pending), socket);
+        } catch (std::exception &e) {
+            onHandlerException(e, exchange->response);
+        }
+        if (outcome == HandlerOutcome::Disconnected) {
+            RESTIO_DEBUG("Client disconnected while handling " << exchange->request.target());
+            stats.disconnects++;
+            co_return false;
+        }
+        if (outcome == HandlerOutcome::TimedOut) {
+            RESTIO_WARN("Request timed out: " << exchange->request.method_string() << " "
+                                              << exchange->request.target());
+            stats.timeouts++;
+            auto abandoned = std::exchange(exchange, std::make_shared<Exchange>()); // stays with the handler
+            exchange->request.base()   = abandoned->request.base(); // for the middleware
+            exchange->context.peer     = abandoned->context.peer;
+            exchange->context.peerPort = abandoned->context.peerPort;
+            exchange->context.trace    = abandoned->context.trace;
+            exchange->context.timings  = abandoned->context.timings;
+            exchange->middlewarePassed = abandoned->middlewarePassed;
+            exchange->routeId          = abandoned->routeId;
+            prepareResponse(exchange->response, version, keep_alive);
+            exchange->response.result(http::status::gateway_timeout);
+        }
+        co_return true;
+    }
+
+    // of the response, see RequestContext::sharedBody
+    static std::size_t bodySize(const Exchange &exchange)
+    {
+        auto const &body = exchange.response.body();
+        return body.empty() && exchange.context.sharedBody ? exchange.context.sharedBody->size() : body.size();
+    }
+
+    // the access log record of the exchange. the write time is up to the caller
+    static AccessLogRecord makeLogRecord(const Exchange &exchange)
+    {
+        using namespace std::chrono;
+        auto clamped = [](auto value) {
+            return std::uint32_t(std::min<std::uint64_t>(value, std::numeric_limits<std::uint32_t>::max()));
+        };
+        AccessLogRecord record {};
+        record.timestamp     = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+        record.routeId       = exchange.routeId;
+        record.status        = std::uint16_t(exchange.response.result_int());
+        record.method        = std::uint8_t(exchange.request.method());
+        record.version       = std::uint8_t(exchange.request.version());
+        auto const &timings  = exchange.context.timings;
+        record.readMicros    = clamped(duration_cast<microseconds>(timings.read()).count());
+        record.handlerMicros = clamped(
+            duration_cast<microseconds>(RequestTimings::between(timings.parsed, timings.handled)).count());
+        record.requestBytes  = clamped(exchange.request.body().size());
+        record.responseBytes = clamped(bodySize(exchange));
+        AccessLog::encodePeer(exchange.context.peer, record.peer);
+        auto target = exchange.request.target();
+        std::memcpy(record.target, target.data(), std::min(target.size(), sizeof(record.target)));
+        return record;
+    }
 
+    // details are copied for the observer only. the serialization and write times are up to the caller
+    static RequestSpan makeSpan(const Exchange &exchange, bool observed)
+    {
+        RequestSpan span;
+        span.timings = exchange.context.timings;
+        if (observed) {
+            auto target = exchange.request.target();
+            span.method = exchange.request.method();
+            span.target.assign(target.data(), target.size());
+            span.status = exchange.response.result_int();
+            span.peer   = exchange.context.peer;
+            span.trace  = exchange.context.trace;
+        }
+        return span;
+    }
+
+    // once the request is done with: its response is written or handed over to the HTTP/2 connection
+    void finishRequest(const RequestSpan &span)
+    {
+        auto const &timings = span.timings;
+        addLatency(stats.readLatency, timings.received, timings.parsed);
+        addLatency(stats.routingLatency, timings.parsed, timings.routed);
+        addLatency(stats.handlerLatency, timings.routed, timings.handled);
+        addLatency(stats.serializationLatency, timings.handled, timings.serialized);
+        addLatency(stats.writeLatency, timings.serialized, timings.written);
+        if (requestObserver) {
+            try {
+                requestObserver(span);
+            } catch (std::exception &e) {
+                RESTIO_ERROR("Request observer failed: " << e.what());
+            }
+        }
+    }
+
+    // phases the request didn't get to aren't counted
+    static void addLatency(Histogram &histogram, RequestTimings::TimePoint from, RequestTimings::TimePoint to)
+    {
+        if (from != RequestTimings::TimePoint {} && to != RequestTimings::TimePoint {}) {
+            histogram.add(to - from);
+        }
+    }
+
+    // the responses of the batch are written, successfully or not
+    void finishBatch(std::vector<RequestSpan>         &spans,
+                     std::vector<AccessLogRecord>     &logRecords,
+                     RequestContext::Clock::time_point writeStart,
+                     bool                              written)
+    {
+        auto now = RequestContext::Clock::now();
+        for (auto &span : spans) {
+            if (written) {
+                span.timings.written = now;
+            }
+            finishRequest(span);
+        }
+        spans.clear();
+        auto writeMicros
+            = std::uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(now - writeStart).count());
+        for (auto &record : logRecords) {
+            record.writeMicros = writeMicros;
+            accessLog->write(record);
+        }
+        logRecords.clear();
+    }
+
+    // writes the responses batched so far in one go
+    template <typename Stream>
+    awaitable<void> writeBatch(Stream                       &stream,
+                               ResponseBatch                &batch,
+                               std::vector<RequestSpan>     &spans,
+                               std::vector<AccessLogRecord> &logRecords,
+                               boost::system::error_code    &ec)
+    {
+        auto writeStart = RequestContext::Clock::now();
+        co_await boost::asio::async_write(stream, batch.buffers(), boost::asio::redirect_error(use_awaitable, ec));
+        batch.clear();
+        finishBatch(spans, logRecords, writeStart, !ec);
+    }
+
+    // dispatches the request of an HTTP/2 stream. see Http2Session. connection - the one of the session
+    awaitable<bool>
+    handleStream(Request &request, Response &response, std::stop_source stop, const Exchange &connection)
+    {
+        auto exchange              = std::make_shared<Exchange>(std::move(stop));
+        exchange->request          = std::move(request);
+        exchange->context.peer     = connection.context.peer;
+        exchange->context.peerPort = connection.context.peerPort;
+        prepareResponse(exchange->response, exchange->request.version(), true);
+
+        auto &timings    = exchange->context.timings;
+        timings.received = timings.parsed = RequestContext::Clock::now();
+        auto routes                       = handlers.snapshot();
+        auto pending = processRequest(*routes, *exchange);
+        if (pending.valid() && !co_await completeExchange(exchange, std::move(routes), std::move(pending), nullptr)) {
+            co_return false;
+        }
+        leaveMiddleware(*exchange);
+        exchange->context.timings.handled = RequestContext::Clock::now();
+        if (accessLog) {
+            accessLog->write(makeLogRecord(*exchange));
+        }
+        finishRequest(makeSpan(*exchange, bool(requestObserver)));
+        response = std::move(exchange->response);
+        if (response.body().empty() && exchange->context.sharedBody) {
+            response.body() = *exchange->context.sharedBody; // the stream is written from the response
+        }
+        co_return true;
+    }
+
+    /**
+     * Waits for the next request without holding a read buffer, then borrows one from the pool unless there are
+     * pipelined bytes already. TLS has to decrypt to see whether there is something, so the first byte is read
+     * and put to the buffer.
+     */
+    template <typename Stream>
+    static awaitable<void> awaitInput(Stream &stream, beast::flat_buffer &buffer, boost::system::error_code &ec)
+    {
+        if (buffer.size()) {
+            co_return;
+        }
+        BufferPool::release(buffer);
+        if constexpr (std::is_same_v<Stream, beast::basic_stream<Protocol>>) {
+            co_await beast::get_lowest_layer(stream).socket().async_wait(
+                Socket::wait_read, boost::asio::redirect_error(use_awaitable, ec));
+            buffer = BufferPool::borrow(read_buffer_size);
+        } else {
+            char first;
+            auto n = co_await stream.async_read_some(boost::asio::buffer(&first, 1),
+                                                     boost::asio::redirect_error(use_awaitable, ec));
+            buffer = BufferPool::borrow(read_buffer_size);
+            buffer.commit(boost::asio::buffer_copy(buffer.prepare(n), boost::asio::buffer(&first, n)));
+        }
+    }
+
+    // Reads till it's clear whether the client starts with the HTTP/2 preface (prior knowledge or ALPN h2).
+    // Whatever is read stays in the buffer for the HTTP/1 parser otherwise.
+    template <typename Stream> static awaitable<bool> readPreface(Stream &stream, beast::flat_buffer &buffer)
+    {
+        boost::system::error_code ec;
         for (;;) {
-            request = {};
-            co_await http::async_read(stream, buffer, request, boost::asio::redirect_error(use_awaitable, ec));
+            std::string_view data(static_cast<const char *>(buffer.data().data()), buffer.size());
+            if (!http2::preface.starts_with(data.substr(0, http2::preface.size()))) {
+                co_return false;
+            }
+            if (data.size() >= http2::preface.size()) {
+                co_return true;
+            }
+            auto n = co_await stream.async_read_some(buffer.prepare(preface_read_size),
+                                                     boost::asio::redirect_error(use_awaitable, ec));
+            buffer.commit(n);
+            if (ec) {
+                co_return false; // the HTTP/1 reader will get the error too
+            }
+        }
+    }
+
+    static void prepareResponse(Response &response, unsigned version, bool keep_alive)
+    {
+        response.version(version);
+        response.keep_alive(keep_alive); // Server and Date are added by the serializer
+        response.result(http::status::ok);
+    }
+
+    // Parses a request which is already in the buffer. Returns false if it's incomplete or malformed (see ec).
+    static bool parseBuffered(http::request_parser<http::string_body> &parser,
+                              beast::flat_buffer                      &buffer,
+                              boost::system::error_code               &ec)
+    {
+        parser.eager(true);
+        while (buffer.size() && !parser.is_done()) {
+            auto consumed = parser.put(buffer.data(), ec);
+            buffer.consume(consumed);
+            if (ec == http::error::need_more) {
+                ec = {};
+                return false;
+            }
+            if (ec) {
+                return false;
+            }
+        }
+        return parser.is_done();
+    }
+
+    // path relative to base_path without query, leading and trailing slashes
+    static std::string exactPath(std::string_view path)
+    {
+        path = path.substr(0, path.find_first_of("?#"));
+        while (path.starts_with('/')) {
+            path.remove_prefix(1);
+        }
+        while (path.ends_with('/')) {
+            path.remove_suffix(1);
+        }
+        return std::string(path);
+    }
+
+    template <typename T>
+    std::shared_ptr<T> findExact(const AtomicSharedPtr<const ExactRoutes<T>> &routes, std::string_view target) const
+    {
+        auto current = routes.load();
+        if (current->empty() || !target.starts_with(basePath)) {
+            return nullptr;
+        }
+        auto path = target.substr(basePath.size());
+        if (!path.empty() && path[0] != '/' && path[0] != '?') { // "/basexyz" isn't under "/base"
+            return nullptr;
+        }
+        auto it = current->find(exactPath(path));
+        return it == current->end() ? nullptr : it->second;
+    }
+
+    template <typename T>
+    void setExact(AtomicSharedPtr<const ExactRoutes<T>> &routes, std::string_view path, std::shared_ptr<T> &&value)
+    {
+        std::lock_guard<std::mutex> lock(exactRoutesMutex);
+        auto                        updated = std::make_shared<ExactRoutes<T>>(*routes.load());
+        if (value) {
+            (*updated)[exactPath(path)] = std::move(value);
+        } else {
+            updated->erase(exactPath(path));
+        }
+        routes.store(std::move(updated));
+    }
+
+    // Streams events of the hub till the client disconnects or gets evicted
+    template <typename Stream>
+    awaitable<void>
+    serveEvents(Stream &stream, std::shared_ptr<EventHub> hub, const Request &request, Connection &connection)
+    {
+        auto const &options  = hub->options();
+        auto        executor = co_await this_coro::executor;
+        auto       &socket   = beast::get_lowest_layer(stream).socket();
+        boost::system::error_code ec;
+
+        std::string header = "HTTP/1.1 200 OK\r\n"
+                             "Server: Restio/" RESTIO_VERSION "\r\n"
+                             "Content-Type: text/event-stream\r\n"
+                             "Cache-Control: no-cache\r\n"
+                             "X-Accel-Buffering: no\r\n\r\n";
+        if (options.retry.count()) {
+            header += "retry: " + std::to_string(options.retry.count()) + "\n\n";
+        }
+        co_await boost::asio::async_write(
+            stream, boost::asio::buffer(header), boost::asio::redirect_error(use_awaitable, ec));
+        if (ec) {
+            co_return;
+        }
+
+        auto subscriber  = std::make_shared<EventSubscriber>(executor, options.maxQueuedEvents);
+        auto lastEventId = request["Last-Event-ID"];
+        hub->subscribe(subscriber, { lastEventId.data(), lastEventId.size() });
+
+        // clients don't send anything, so readable socket means eof
+        auto gone = std::make_shared<bool>(false);
+        socket.async_wait(Socket::wait_read,
+                          boost::asio::bind_executor(executor, [gone, subscriber](boost::system::error_code ec) {
+                              if (!ec) {
+                                  *gone = true;
+                                  subscriber->signal.cancel();
+                              }
+                          }));
+        // clients reconnect on their own, so there is nothing to wait for on drain
+        DrainHook drainHook(connection, [&stream, gone, subscriber](bool force) {
+            *gone = true;
+            subscriber->signal.cancel();
+            if (force) {
+                beast::get_lowest_layer(stream).close();
+            }
+        });
+        *gone = connection.draining;
+
+        static const std::string               keepAlive = ":\n\n";
+        std::vector<boost::asio::const_buffer> buffers;
+        while (!*gone && !subscriber->evicted()) {
+            auto events = subscriber->take();
+            buffers.clear();
+            if (events.empty()) {
+                subscriber->signal.expires_after(options.keepAlive);
+                co_await subscriber->signal.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+                if (ec) {
+                    continue; // woken up
+                }
+                buffers.emplace_back(boost::asio::buffer(keepAlive));
+            }
+            for (auto const &event : events) {
+                buffers.emplace_back(boost::asio::buffer(*event));
+            }
+            // everything queued goes with a single write. a client stuck for long is dropped
+            beast::get_lowest_layer(stream).expires_after(2 * options.keepAlive);
+            co_await boost::asio::async_write(stream, buffers, boost::asio::redirect_error(use_awaitable, ec));
+            beast::get_lowest_layer(stream).expires_never();
             if (ec) {
-                if (ec != http::error::end_of_stream)
-                    RESTIO_ERROR("Session failed: " << ec);
                 break;
             }
+        }
+        if (subscriber->evicted()) {
+            RESTIO_WARN("Event stream client doesn't keep up with events. Disconnecting");
+        }
+        hub->unsubscribe(subscriber.get());
+        socket.cancel(ec);
+    }
+
+    // the request/response loop. Stream is either basic_stream or ssl_stream over it
+    template <typename Stream> awaitable<void> runSession(Stream &stream, Connection &connection)
+    {
+        beast::flat_buffer                                     buffer; // borrowed only while there is input
+        BufferLease                                            bufferLease(buffer);
+        std::optional<http::request_parser<http::string_body>> parser;
+        ResponseBatch                                          batch;
+        std::vector<AccessLogRecord>                           logRecords; // of the batch
+        std::vector<RequestSpan>                               spans;      // of the batch
+        auto                                                   exchange = std::make_shared<Exchange>();
+        auto                                                  &socket   = beast::get_lowest_layer(stream).socket();
+        boost::system::error_code                              ec;
+        setPeer(socket, exchange->context);
+
+        // Idle connections are closed on drain right away, the others once the request in progress is answered.
+        // A request may be on its way while the connection is considered idle. Clients retry then.
+        DrainHook drainHook(connection, [&](bool force) {
+            if (force) {
+                exchange->stopSource.request_stop();
+                beast::get_lowest_layer(stream).close();
+            } else if (connection.idle) {
+                beast::get_lowest_layer(stream).cancel();
+            }
+        });
+
+        connection.idle = true;
+        co_await awaitInput(stream, buffer, ec);
+        connection.idle = false;
+        if (ec) {
+            co_return; // closed before sending anything
+        }
+        auto readStart = RequestContext::Clock::now();
+        if (http2.enabled && co_await readPreface(stream, buffer)) {
+            // the buffer is kept. HTTP/2 connections are few and busy
+            auto dispatch = [this, connection = exchange](Request &request, Response &response, std::stop_source stop) {
+                return handleStream(request, response, std::move(stop), *connection);
+            };
+            Http2Session<Stream, decltype(dispatch)> session(
+                stream, buffer, http2, std::move(dispatch), co_await this_coro::executor);
+            DrainHook h2DrainHook(connection, [&session](bool force) { session.drain(force); });
+            if (connection.draining) {
+                // accepted just before drain(). whatever is buffered already is served once run() starts
+                boost::asio::post(co_await this_coro::executor, [&session]() { session.drain(false); });
+            }
+            co_await session.run();
+            co_return;
+        }
 
-            response = {};
-            response.version(request.version());
-            response.set(http::field::server, "Restio/" RESTIO_VERSION);
-            response.keep_alive(request.keep_alive());
-            response.result(http::status::ok);
+        for (;;) {
+            if (!parser) {
+                parser.emplace();
+            }
+            if (!parser->is_done()) {
+                if (connection.draining && !buffer.size()) {
+                    break;
+                }
+                connection.idle = !buffer.size();
+                co_await awaitInput(stream, buffer, ec);
+                connection.idle = false;
+                readStart       = RequestContext::Clock::now();
+                if (!ec) {
+                    co_await http::async_read(
+                        stream, buffer, *parser, boost::asio::redirect_error(use_awaitable, ec));
+                }
+                if (ec) {
+                    if (ec != http::error::end_of_stream && !connection.draining)
+                        RESTIO_ERROR("Session failed: " << ec);
+                    break;
+                }
+            }
+            exchange->request                  = parser->release();
+            exchange->context.deadline         = RequestContext::Clock::time_point::max();
+            exchange->context.timings          = {};
+            exchange->context.arena.release(); // of the previous pipelined request. its response is serialized
+            exchange->context.timings.received = readStart;
+            exchange->context.timings.parsed   = RequestContext::Clock::now();
+            parser.reset();
 
-            co_await processRequest(request, response);
+            auto version       = exchange->request.version();
+            auto keep_alive    = exchange->request.keep_alive();
+            exchange->response = {};
+            prepareResponse(exchange->response, version, keep_alive);
 
-            response.prepare_payload();
-            co_await http::async_write(stream, response, boost::asio::redirect_error(use_awaitable, ec));
+            bool answered = false; // by the server checks of a stream
+            if (auto target = exchange->request.target(); exchange->request.method() == http::verb::get) {
+                std::shared_ptr<const WebSocketEndpoint> endpoint;
+                std::shared_ptr<EventHub>                hub;
+                if (beast::websocket::is_upgrade(exchange->request)) {
+                    endpoint = findExact(websockets, { target.data(), target.size() });
+                } else {
+                    hub = findExact(eventHubs, { target.data(), target.size() });
+                }
+                // the checks see streams like any other request. a rejected one is answered as usual
+                answered = (endpoint || hub) && !enterRequest(*exchange);
+                if ((endpoint || hub) && !answered) {
+                    if (!batch.empty()) { // responses to the requests pipelined before
+                        co_await writeBatch(stream, batch, spans, logRecords, ec);
+                        if (ec) {
+                            break;
+                        }
+                    }
+                    BufferPool::release(buffer); // not used by the stream
+                    if (endpoint) {
+                        auto session = std::make_shared<WebSocketSession<Stream>>(
+                            stream, std::move(endpoint), co_await this_coro::executor);
+                        DrainHook wsDrainHook(connection, [&stream, session](bool force) {
+                            if (force) {
+                                beast::get_lowest_layer(stream).close();
+                            } else {
+                                session->close();
+                            }
+                        });
+                        if (connection.draining) {
+                            session->close();
+                        }
+                        co_await session->run(exchange->request);
+                    } else {
+                        co_await serveEvents(stream, std::move(hub), exchange->request, connection);
+                    }
+                    break; // the connection was dedicated to the stream
+                }
+            }
 
+            if (!answered) {
+                auto routes  = handlers.snapshot(); // keeps the handler alive if routes are changed meanwhile
+                auto pending = processRequest(*routes, *exchange);
+                if (pending.valid()) {
+                    // only the responses which are ready are batched, the ones before don't wait for this one
+                    if (!batch.empty()) {
+                        co_await writeBatch(stream, batch, spans, logRecords, ec);
+                        if (ec) {
+                            if (!connection.draining)
+                                RESTIO_ERROR("Session failed: " << ec);
+                            break;
+                        }
+                    }
+                    if (!co_await completeExchange(exchange, std::move(routes), std::move(pending), &socket)) {
+                        break;
+                    }
+                }
+            }
+            leaveMiddleware(*exchange);
+            exchange->context.timings.handled = RequestContext::Clock::now();
+            if (accessLog) {
+                logRecords.push_back(makeLogRecord(*exchange));
+            }
+            spans.push_back(makeSpan(*exchange, bool(requestObserver)));
+
+            if (connection.draining) {
+                exchange->response.keep_alive(false);
+            }
+            bool close = !exchange->response.keep_alive();
+            batch.add(exchange->response, std::move(exchange->context.sharedBody));
+            spans.back().timings.serialized = RequestContext::Clock::now();
+
+            // If the client pipelines, next requests may be buffered already. Answer them all with a single write.
+            if (!close && buffer.size() && batch.size() < max_pipelined_responses) {
+                parser.emplace();
+                if (parseBuffered(*parser, buffer, ec)) {
+                    readStart = RequestContext::Clock::now();
+                    continue;
+                }
+                if (ec) {
+                    RESTIO_ERROR("Session failed: " << ec);
+                    close = true;
+                }
+            }
+
+            co_await writeBatch(stream, batch, spans, logRecords, ec);
             RESTIO_TRACE("onWritten: " << ec);
+            exchange->context.arena.release();
             if (ec) {
-                RESTIO_ERROR("Session failed: " << ec);
+                if (!connection.draining)
+                    RESTIO_ERROR("Session failed: " << ec);
                 break;
             }
-            if (response.need_eof()) {
+            if (close) {
                 RESTIO_TRACE("Session needs eof. closing.");
                 break;
             }
         }
         RESTIO_TRACE("Finishing http session: " << ec);
+    }
+
+    awaitable<void> makeSession(Socket socket)
+    {
+        TrackedConnection             tracked(registry, co_await this_coro::executor);
+        beast::basic_stream<Protocol> stream(std::move(socket));
+        co_await runSession(stream, *tracked.connection);
         if (stream.socket().is_open()) {
             // Send a TCP shutdown
-            stream.socket().shutdown(tcp::socket::shutdown_send, ec);
+            boost::system::error_code ec;
+            stream.socket().shutdown(Socket::shutdown_send, ec);
             stream.close();
         }
     }
 
-    awaitable<void> listen()
+    awaitable<void> makeTlsSession(Socket socket, std::shared_ptr<TlsContext> tls)
     {
-        auto executor = co_await this_coro::executor;
+        TrackedConnection tracked(registry, co_await this_coro::executor);
+        beast::ssl_stream<beast::basic_stream<Protocol>> stream(beast::basic_stream<Protocol>(std::move(socket)),
+                                                                tls->context());
+        boost::system::error_code                        ec;
+        // the handshake and close_notify are waited for till the drain deadline
+        DrainHook drainHook(*tracked.connection, [&stream](bool force) {
+            if (force) {
+                beast::get_lowest_layer(stream).close();
+            }
+        });
+
+        beast::get_lowest_layer(stream).expires_after(tls_handshake_timeout);
+        co_await stream.async_handshake(boost::asio::ssl::stream_base::server,
+                                        boost::asio::redirect_error(use_awaitable, ec));
+        beast::get_lowest_layer(stream).expires_never();
+        if (ec) {
+            RESTIO_DEBUG("TLS handshake failed: " << ec.message());
+            co_return;
+        }
+        RESTIO_TRACE("TLS session established. resumed: " << SSL_session_reused(stream.native_handle()));
+
+        co_await runSession(stream, *tracked.connection);
+        if (beast::get_lowest_layer(stream).socket().is_open()) {
+            beast::get_lowest_layer(stream).expires_after(tls_handshake_timeout);
+            co_await stream.async_shutdown(boost::asio::redirect_error(use_awaitable, ec));
+            beast::get_lowest_layer(stream).close();
+        }
+    }
+
+    awaitable<void> listen(Acceptor &acceptor)
+    {
+        boost::system::error_code ec;
+        auto                      executor = co_await this_coro::executor;
+        auto                      family   = acceptor.local_endpoint(ec).protocol().family();
         for (;;) {
             try {
-                tcp::socket socket = co_await acceptor.async_accept(use_awaitable);
-                co_spawn(executor, makeSession(std::move(socket)), detached);
+                Socket socket = co_await acceptor.async_accept(use_awaitable);
+                setCloseOnExec(socket.native_handle());
+                tuneConnection(socket, family);
+                // a strand per session: handlers offloaded to other threads resume the session here
+                auto strand = boost::asio::make_strand(executor);
+                if (tls) {
+                    co_spawn(strand, makeTlsSession(std::move(socket), tls), detached);
+                } else {
+                    co_spawn(strand, makeSession(std::move(socket)), detached);
+                }
             } catch (boost::system::system_error &e) {
                 if (e.code() == boost::asio::error::operation_aborted) {
-                    RESTIO_INFO("Listening restio tcp socket closed");
+                    RESTIO_INFO("Listening restio socket closed");
                     break;
                 }
                 RESTIO_ERROR("Failed to accept restio socket: " << e.what());
@@ -151,55 +1115,252 @@ class HttpServerPrivate {
         }
     }
 
-    tcp::acceptor setup_acceptor(boost::asio::io_context &io_context,
-                                 const std::string       &bind_address,
-                                 uint16_t                 bind_port,
-                                 const std::string       &service_name)
+    static bool isTcp(int family) { return family == AF_INET || family == AF_INET6; }
+
+    // IPv4 clients of dual-stack listeners are shown as IPv4 ones
+    static void setPeer(Socket &socket, RequestContext &context)
+    {
+        boost::system::error_code ec;
+        auto                      endpoint = socket.remote_endpoint(ec);
+        if (ec || !isTcp(endpoint.protocol().family())) {
+            return;
+        }
+        tcp::endpoint ip;
+        std::memcpy(ip.data(), endpoint.data(), std::min(endpoint.size(), ip.capacity()));
+        auto address = ip.address();
+        if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+            address = boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, address.to_v6());
+        }
+        context.peer     = address.to_string();
+        context.peerPort = ip.port();
+    }
+
+    // logs instead of throwing. a system without some tuning still serves
+    static void setOption(int fd, int level, int name, int value, const char *what)
     {
-        boost::beast::error_code ec;
-        tcp::endpoint            endpoint;
-        try {
-            endpoint = { boost::asio::ip::make_address(bind_address), bind_port };
-        } catch (std::exception &) {
-            // try to resolve bind_address. maybe it's not an IP
-            boost::asio::ip::tcp::resolver resolver(io_context.get_executor());
-            auto                           resolved = resolver.resolve(bind_address, "");
-            auto                           it       = std::find_if(
-                resolved.begin(), resolved.end(), [](auto &e) { return e.endpoint().address().is_v4(); });
-            if (it == resolved.end()) {
-                throw std::runtime_error(std::string("Failed to resolve IPv4 address for ") + bind_address);
-            }
-            endpoint = { it->endpoint().address(), bind_port };
-        }
-
-        tcp::acceptor acceptor(io_context.get_executor());
-        RESTIO_INFO("Bind " << (service_name.empty() ? std::string("restio http service") : service_name) << " to "
-                            << endpoint.address().to_string() << ":" << bind_port);
+        if (::setsockopt(fd, level, name, &value, sizeof(value)) != 0) {
+            RESTIO_WARN("Failed to set " << what << " to " << value << ": " << std::strerror(errno));
+        }
+    }
+
+    // Asio opens and accepts sockets without SOCK_CLOEXEC. They shouldn't leak to processes started by handlers
+    static void setCloseOnExec(int fd) { ::fcntl(fd, F_SETFD, ::fcntl(fd, F_GETFD) | FD_CLOEXEC); }
+
+    // async-signal-safe, for the child after fork()
+    static void closeFrom(int first, long openMax)
+    {
+#ifdef SYS_close_range
+        if (::syscall(SYS_close_range, unsigned(first), ~0U, 0) == 0) {
+            return;
+        }
+#endif
+        for (long fd = first; fd < openMax; fd++) {
+            ::close(int(fd));
+        }
+    }
+
+    // before listen(), so the buffer sizes apply to the TCP window of the accepted connections
+    void tuneListener(Acceptor &acceptor, int family)
+    {
+        auto fd = acceptor.native_handle();
+        if (socketOptions.receiveBuffer) {
+            setOption(fd, SOL_SOCKET, SO_RCVBUF, socketOptions.receiveBuffer, "SO_RCVBUF");
+        }
+        if (socketOptions.sendBuffer) {
+            setOption(fd, SOL_SOCKET, SO_SNDBUF, socketOptions.sendBuffer, "SO_SNDBUF");
+        }
+        if (!isTcp(family)) {
+            return;
+        }
+        if (socketOptions.deferAccept) {
+            setOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, socketOptions.deferAccept, "TCP_DEFER_ACCEPT");
+        }
+        if (socketOptions.fastOpen) {
+            setOption(fd, IPPROTO_TCP, TCP_FASTOPEN, socketOptions.fastOpen, "TCP_FASTOPEN");
+        }
+    }
+
+    void tuneConnection(Socket &socket, int family)
+    {
+        if (!isTcp(family)) {
+            return;
+        }
+        auto fd = socket.native_handle();
+        if (socketOptions.noDelay) {
+            setOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+        }
+        if (socketOptions.busyPoll) {
+            setOption(fd, SOL_SOCKET, SO_BUSY_POLL, socketOptions.busyPoll, "SO_BUSY_POLL");
+        }
+    }
+
+    int backlog() const
+    {
+        return socketOptions.backlog ? socketOptions.backlog : boost::asio::socket_base::max_listen_connections;
+    }
+
+    void startListening(Acceptor &&acceptor)
+    {
+        acceptors.push_back(std::move(acceptor));
+        co_spawn(ioContext, listen(acceptors.back()), detached);
+    }
+
+    void bindAcceptor(const Protocol::endpoint &endpoint, const std::string &where, bool v6Only)
+    {
+        boost::system::error_code ec;
+        Acceptor                  acceptor(ioContext.get_executor());
+        RESTIO_INFO("Bind " << (serviceName.empty() ? std::string("restio http service") : serviceName) << " to "
+                            << where);
         acceptor.open(endpoint.protocol(), ec);
-        ensure_success(ec, "open http endpoint");
+        ensure_success(ec, "open http endpoint", where);
+        setCloseOnExec(acceptor.native_handle());
 
-        acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
-        ensure_success(ec, "set_option");
+        if (endpoint.protocol().family() != AF_UNIX) {
+            acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+            ensure_success(ec, "set_option", where);
+        }
+        if (endpoint.protocol().family() == AF_INET6) {
+            acceptor.set_option(boost::asio::ip::v6_only(v6Only), ec);
+            ensure_success(ec, "set_option", where);
+        }
 
         acceptor.bind(endpoint, ec);
-        ensure_success(ec, "bind");
+        ensure_success(ec, "bind", where);
 
-        acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
-        ensure_success(ec, "listen");
+        tuneListener(acceptor, endpoint.protocol().family());
+        acceptor.listen(backlog(), ec);
+        ensure_success(ec, "listen", where);
 
-        return acceptor;
+        startListening(std::move(acceptor));
+    }
+
+    static std::string describe(const tcp::endpoint &endpoint)
+    {
+        auto address = endpoint.address().to_string();
+        if (endpoint.address().is_v6()) {
+            address = "[" + address + "]";
+        }
+        return address + ":" + std::to_string(endpoint.port());
     }
 
 public:
     HttpServerPrivate(boost::asio::io_context &io_context,
-                      const std::string       &bind_address,
-                      uint16_t                 bind_port,
                       const std::string       &base_path,
                       const std::string       &service_name) :
-        handlers(base_path),
-        acceptor(setup_acceptor(io_context, bind_address, bind_port, service_name))
+        ioContext(io_context),
+        serviceName(service_name), handlers(base_path),
+        basePath(boost::trim_right_copy_if(base_path, boost::is_any_of("/"))),
+        websockets(std::make_shared<const ExactRoutes<const WebSocketEndpoint>>()),
+        eventHubs(std::make_shared<const ExactRoutes<EventHub>>())
     {
-        co_spawn(io_context, listen(), detached);
+    }
+
+    void listenTcp(const std::string &bind_address, uint16_t bind_port)
+    {
+        boost::system::error_code ec;
+        auto                      address = boost::asio::ip::make_address(bind_address, ec);
+        if (!ec) {
+            // "::" accepts IPv4 connections too
+            tcp::endpoint endpoint { address, bind_port };
+            bindAcceptor(endpoint, describe(endpoint), !address.is_unspecified());
+            return;
+        }
+
+        // maybe it's a host name. listen on all its addresses
+        tcp::resolver resolver(ioContext.get_executor());
+        auto          resolved = resolver.resolve(bind_address, "", ec);
+        if (ec || resolved.empty()) {
+            throw std::runtime_error(std::string("Failed to resolve ") + bind_address);
+        }
+        std::vector<tcp::endpoint> endpoints;
+        for (auto const &entry : resolved) {
+            tcp::endpoint endpoint { entry.endpoint().address(), bind_port };
+            if (std::find(endpoints.begin(), endpoints.end(), endpoint) == endpoints.end()) {
+                endpoints.push_back(endpoint);
+            }
+        }
+        std::size_t bound = 0;
+        for (auto const &endpoint : endpoints) {
+            try {
+                bindAcceptor(endpoint, describe(endpoint), true);
+                bound++;
+            } catch (std::runtime_error &e) {
+                if (endpoints.size() == 1) {
+                    throw;
+                }
+                RESTIO_WARN(e.what());
+            }
+        }
+        if (!bound) {
+            throw std::runtime_error(std::string("Failed to listen on any address of ") + bind_address);
+        }
+    }
+
+    void listenUnix(const std::string &path)
+    {
+        if (path.empty()) {
+            throw std::invalid_argument("empty unix socket path");
+        }
+        auto name = path;
+        if (name[0] == '@') {
+            name[0] = '\0'; // abstract namespace
+        } else {
+            // remove the socket left by a previous instance, otherwise bind fails. a live one is someone else's
+            struct stat st;
+            if (::stat(name.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                boost::asio::local::stream_protocol::socket probe(ioContext);
+                boost::system::error_code                   ec;
+                probe.connect(boost::asio::local::stream_protocol::endpoint(name), ec);
+                if (!ec) {
+                    throw std::runtime_error("Failed to listen on unix:" + path + ": a server is already listening");
+                }
+                if (ec == boost::asio::error::connection_refused) {
+                    ::unlink(name.c_str());
+                }
+            }
+        }
+        bindAcceptor(boost::asio::local::stream_protocol::endpoint(name), "unix:" + path, false);
+    }
+
+    void adoptListener(int fd)
+    {
+        sockaddr_storage address;
+        socklen_t        length       = sizeof(address);
+        int              listening    = 0;
+        socklen_t        optionLength = sizeof(listening);
+        if (::getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) != 0
+            || ::getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optionLength) != 0 || !listening) {
+            throw std::invalid_argument("fd " + std::to_string(fd) + " is not a listening socket");
+        }
+        setCloseOnExec(fd);
+
+        int                       family = address.ss_family;
+        Acceptor                  acceptor(ioContext.get_executor());
+        boost::system::error_code ec;
+        acceptor.assign(Protocol(family, family == AF_UNIX ? 0 : IPPROTO_TCP), fd, ec);
+        ensure_success(ec, "adopt listening socket", "fd " + std::to_string(fd));
+        tuneListener(acceptor, family); // the backlog is left as it is
+        RESTIO_INFO("Adopted listening socket fd " << fd);
+        startListening(std::move(acceptor));
+    }
+
+    std::size_t adoptSystemdListeners()
+    {
+        // see sd_listen_fds(3)
+        constexpr int first_fd = 3;
+        auto          pid      = std::getenv("LISTEN_PID");
+        auto          fds      = std::getenv("LISTEN_FDS");
+        if (!pid || !fds || std::strtol(pid, nullptr, 10) != ::getpid()) {
+            return 0;
+        }
+        auto count = std::strtol(fds, nullptr, 10);
+        ::unsetenv("LISTEN_PID"); // not for children
+        ::unsetenv("LISTEN_FDS");
+        ::unsetenv("LISTEN_FDNAMES");
+        for (int fd = first_fd; fd < first_fd + count; fd++) {
+            adoptListener(fd);
+        }
+        return count > 0 ? std::size_t(count) : 0;
     }
 
     void addRoute(http::verb method, std::string &&path, RequestHandler &&handler)
@@ -207,12 +1368,227 @@ public:
         handlers.add(method, std::move(path), std::move(handler));
     }
 
-    void stop() { acceptor.close(); }
+    void removeRoute(http::verb method, const std::string &path) { handlers.remove(method, path); }
+
+    void setWebSocket(std::string_view path, std::shared_ptr<const WebSocketEndpoint> &&endpoint)
+    {
+        setExact(websockets, path, std::move(endpoint));
+    }
+
+    void setEventHub(std::string_view path, std::shared_ptr<EventHub> &&hub) { setExact(eventHubs, path, std::move(hub)); }
+
+    void stop()
+    {
+        boost::system::error_code ec;
+        for (auto &acceptor : acceptors) {
+            acceptor.close(ec);
+        }
+    }
+
+    // on a strand, so the wake up by untrack() can't come before the wait starts
+    awaitable<bool> waitDrained(RequestContext::Clock::time_point deadline)
+    {
+        auto waiter = std::make_shared<boost::asio::steady_timer>(co_await this_coro::executor, deadline);
+        {
+            std::lock_guard<std::mutex> lock(registry->mutex);
+            registry->draining    = true;
+            registry->drainWaiter = waiter;
+            for (auto const &connection : registry->connections) {
+                drainConnection(connection, false);
+            }
+        }
+        boost::system::error_code ec;
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(registry->mutex);
+                if (registry->connections.empty()) {
+                    registry->drainWaiter.reset();
+                    co_return true;
+                }
+                if (RequestContext::Clock::now() >= deadline) {
+                    RESTIO_WARN("Drain deadline hit. Closing " << registry->connections.size() << " connections");
+                    for (auto const &connection : registry->connections) {
+                        drainConnection(connection, true);
+                    }
+                    registry->drainWaiter.reset();
+                    co_return false;
+                }
+            }
+            co_await waiter->async_wait(boost::asio::redirect_error(use_awaitable, ec));
+        }
+    }
+
+    awaitable<bool> drain(RequestContext::Clock::time_point deadline)
+    {
+        stop();
+        RESTIO_INFO("Draining " << (serviceName.empty() ? std::string("restio http service") : serviceName));
+        co_return co_await co_spawn(boost::asio::make_strand(ioContext), waitDrained(deadline), use_awaitable);
+    }
+
+    int spawnSuccessor(const std::vector<std::string> &command)
+    {
+        constexpr int    first_fd = 3; // see adoptSystemdListeners()
+        std::vector<int> fds;
+        for (auto &acceptor : acceptors) {
+            if (acceptor.is_open()) {
+                fds.push_back(acceptor.native_handle());
+            }
+        }
+        if (command.empty() || fds.empty()) {
+            throw std::invalid_argument("no command or no listeners to hand off");
+        }
+
+        // everything the child needs is allocated before fork(). only async-signal-safe calls are allowed there
+        std::vector<std::string> env;
+        for (char **var = environ; *var; var++) {
+            std::string_view name(*var);
+            if (!name.starts_with("LISTEN_PID=") && !name.starts_with("LISTEN_FDS=")
+                && !name.starts_with("LISTEN_FDNAMES=")) {
+                env.emplace_back(name);
+            }
+        }
+        env.push_back("LISTEN_FDS=" + std::to_string(fds.size()));
+        env.push_back("LISTEN_PID=" + std::string(std::numeric_limits<pid_t>::digits10 + 1, '\0'));
+        auto                 pidDigits = env.back().data() + env.back().find('=') + 1;
+        std::vector<char *>  argv;
+        std::vector<char *>  envp;
+        std::vector<int>     moved(fds.size());
+        for (auto const &arg : command) {
+            argv.push_back(const_cast<char *>(arg.c_str()));
+        }
+        for (auto &var : env) {
+            envp.push_back(var.data());
+        }
+        argv.push_back(nullptr);
+        envp.push_back(nullptr);
+        auto openMax = ::sysconf(_SC_OPEN_MAX);
+
+        auto pid = ::fork();
+        if (pid < 0) {
+            throw std::system_error(errno, std::generic_category(), "fork");
+        }
+        if (pid == 0) {
+            // out of the way first, so dup2() doesn't overwrite a socket not moved yet
+            int count = int(fds.size());
+            for (int i = 0; i < count; i++) {
+                moved[i] = ::fcntl(fds[i], F_DUPFD, first_fd + count);
+            }
+            for (int i = 0; i < count; i++) {
+                ::dup2(moved[i], first_fd + i); // without FD_CLOEXEC
+                ::close(moved[i]);
+            }
+            closeFrom(first_fd + count, openMax); // connections, files and whatever else lacks FD_CLOEXEC
+            char digits[std::numeric_limits<pid_t>::digits10 + 1];
+            int  length = 0;
+            for (auto self = ::getpid(); self; self /= 10) {
+                digits[length++] = char('0' + self % 10);
+            }
+            while (length) {
+                *pidDigits++ = digits[--length];
+            }
+            ::execve(argv[0], argv.data(), envp.data());
+            ::_exit(127);
+        }
+        RESTIO_INFO("Handed " << fds.size() << " listeners off to " << command[0] << " pid " << pid);
+        return pid;
+    }
+
+    // of the first TCP listener
+    std::uint16_t port() const
+    {
+        for (auto const &acceptor : acceptors) {
+            boost::system::error_code ec;
+            auto                      endpoint = acceptor.local_endpoint(ec);
+            auto                      family   = endpoint.protocol().family();
+            if (!ec && (family == AF_INET || family == AF_INET6)) {
+                // sin_port and sin6_port are at the same offset
+                return ntohs(reinterpret_cast<const sockaddr_in *>(endpoint.data())->sin_port);
+            }
+        }
+        return 0;
+    }
+
+    void enableTls(const HttpServer::TlsOptions &options) { tls = std::make_shared<TlsContext>(options); }
+
+    void setRequestTimeout(RequestContext::Clock::duration timeout) { requestTimeout = timeout; }
+
+    void setCancelOnDisconnect(bool enabled) { cancelOnDisconnect = enabled; }
+
+    void setHttp2Options(const HttpServer::Http2Options &options)
+    {
+        // they are advertised in SETTINGS, the peers drop connections with invalid values (RFC 7540 6.5.2)
+        if (options.maxFrameSize < http2::default_frame_size || options.maxFrameSize > http2::max_frame_size) {
+            throw std::invalid_argument("HTTP/2 max frame size has to be within 16384..16777215");
+        }
+        if (options.initialWindowSize > http2::max_window_size) {
+            throw std::invalid_argument("HTTP/2 initial window size can't exceed 2^31-1");
+        }
+        http2 = options;
+    }
+
+    void setSocketOptions(const HttpServer::SocketOptions &options)
+    {
+        socketOptions = options;
+        for (auto &acceptor : acceptors) {
+            boost::system::error_code ec;
+            auto                      family = acceptor.local_endpoint(ec).protocol().family();
+            if (!ec) {
+                tuneListener(acceptor, family);
+                if (options.backlog && ::listen(acceptor.native_handle(), options.backlog) != 0) {
+                    RESTIO_WARN("Failed to change the backlog: " << std::strerror(errno));
+                }
+            }
+        }
+    }
+
+    void setRateLimit(const HttpServer::RateLimitOptions &options)
+    {
+        rateLimitOptions = options;
+        rateLimiter      = options.limit.rate > 0 ? std::make_unique<RateLimiter>(options.clients) : nullptr;
+    }
+
+    void setMiddleware(std::shared_ptr<Middleware> newMiddleware) { middleware = std::move(newMiddleware); }
+
+    bool enterSubrequest(Request                    &request,
+                         Response                   &response,
+                         RequestContext             &context,
+                         std::optional<std::size_t> &middlewarePassed)
+    {
+        middlewarePassed.reset();
+        return admit(request, response, context)
+            && (!middleware || enterMiddleware(request, response, context, middlewarePassed));
+    }
+
+    void leaveSubrequest(const std::optional<std::size_t> &middlewarePassed,
+                         Request                          &request,
+                         Response                         &response,
+                         RequestContext                   &context)
+    {
+        leaveMiddleware(middlewarePassed, request, response, context);
+    }
+
+    void setAccessLog(std::shared_ptr<AccessLog> log) { accessLog = std::move(log); }
+
+    void setRequestObserver(RequestObserver observer) { requestObserver = std::move(observer); }
 
     HttpServer::Stats takeStats()
     {
-        auto ret = stats;
-        stats    = {};
+        HttpServer::Stats ret;
+        ret.requests             = stats.requests.take();
+        ret.unknown_requests     = stats.unknown_requests.take();
+        ret.exceptions           = stats.exceptions.take();
+        ret.timeouts             = stats.timeouts.take();
+        ret.disconnects          = stats.disconnects.take();
+        ret.rateLimited          = stats.rateLimited.take();
+        ret.readLatency          = stats.readLatency.take();
+        ret.routingLatency       = stats.routingLatency.take();
+        ret.handlerLatency       = stats.handlerLatency.take();
+        ret.serializationLatency = stats.serializationLatency.take();
+        ret.writeLatency         = stats.writeLatency.take();
+        auto pool                = BufferPool::stats();
+        ret.readBuffersInUse     = pool.borrowed;
+        ret.readBuffersPooled    = pool.pooled;
+        ret.readBufferPoolBytes  = pool.bytes;
         return ret;
     }
 };
@@ -222,17 +1598,88 @@ HttpServer::HttpServer(boost::asio::io_context &io_context,
                        uint16_t                 bind_port,
                        const std::string       &base_path,
                        const std::string       &service_name) :
-    d(std::make_unique<HttpServerPrivate>(io_context, bind_address, bind_port, base_path, service_name))
+    HttpServer(io_context, base_path, service_name)
 {
+    listen(bind_address, bind_port);
 }
 
+HttpServer::HttpServer(boost::asio::io_context &io_context,
+                       const std::string       &base_path,
+                       const std::string       &service_name) :
+    d(std::make_unique<HttpServerPrivate>(io_context, base_path, service_name))
+{
+}
+
+void HttpServer::listen(const std::string &bind_address, std::uint16_t bind_port)
+{
+    d->listenTcp(bind_address, bind_port);
+}
+
+void HttpServer::listenUnix(const std::string &path) { d->listenUnix(path); }
+
+void HttpServer::adoptListener(int fd) { d->adoptListener(fd); }
+
+std::size_t HttpServer::adoptSystemdListeners() { return d->adoptSystemdListeners(); }
+
 void HttpServer::stop() { d->stop(); }
 
-void HttpServer::route(http::verb method, std::string &&path, RequestHandler &&handler)
+boost::asio::awaitable<bool> HttpServer::drain(std::chrono::steady_clock::time_point deadline)
+{
+    return d->drain(deadline);
+}
+
+int HttpServer::spawnSuccessor(const std::vector<std::string> &command) { return d->spawnSuccessor(command); }
+
+std::uint16_t HttpServer::port() const { return d->port(); }
+
+void HttpServer::enableTls(const TlsOptions &options) { d->enableTls(options); }
+
+void HttpServer::setRequestTimeout(RequestContext::Clock::duration timeout) { d->setRequestTimeout(timeout); }
+
+void HttpServer::setCancelOnDisconnect(bool enabled) { d->setCancelOnDisconnect(enabled); }
+
+void HttpServer::setHttp2Options(const Http2Options &options) { d->setHttp2Options(options); }
+
+void HttpServer::setSocketOptions(const SocketOptions &options) { d->setSocketOptions(options); }
+
+void HttpServer::setRateLimit(const RateLimitOptions &options) { d->setRateLimit(options); }
+
+void HttpServer::setMiddleware(std::shared_ptr<Middleware> middleware) { d->setMiddleware(std::move(middleware)); }
+
+bool HttpServer::enterSubrequest(Request                    &request,
+                                 Response                   &response,
+                                 RequestContext             &context,
+                                 std::optional<std::size_t> &middlewarePassed)
+{
+    return d->enterSubrequest(request, response, context, middlewarePassed);
+}
+
+void HttpServer::leaveSubrequest(const std::optional<std::size_t> &middlewarePassed,
+                                 Request                          &request,
+                                 Response                         &response,
+                                 RequestContext                   &context)
+{
+    d->leaveSubrequest(middlewarePassed, request, response, context);
+}
+
+void HttpServer::setAccessLog(std::shared_ptr<AccessLog> log) { d->setAccessLog(std::move(log)); }
+
+void HttpServer::setRequestObserver(RequestObserver observer) { d->setRequestObserver(std::move(observer)); }
+
+void HttpServer::addRoute(http::verb method, std::string &&path, RequestHandler &&handler)
 {
     d->addRoute(method, std::move(path), std::move(handler));
 }
 
+void HttpServer::removeRoute(http::verb method, const std::string &path) { d->removeRoute(method, path); }
+
+void HttpServer::websocket(std::string &&path, std::shared_ptr<const WebSocketEndpoint> endpoint)
+{
+    d->setWebSocket(path, std::move(endpoint));
+}
+
+void HttpServer::events(std::string &&path, std::shared_ptr<EventHub> hub) { d->setEventHub(path, std::move(hub)); }
+
 HttpServer::Stats HttpServer::takeStats() { return d->takeStats(); }
 
 HttpServer::~HttpServer() = default;
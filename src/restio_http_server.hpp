@@ -25,13 +25,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma once
 
 #include "restio_common.hpp"
+#include "restio_middleware.hpp"
 
 #include <boost/asio/awaitable.hpp>
 #include <boost/beast/http.hpp>
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace boost::asio {
 class io_context;
@@ -42,15 +46,73 @@ namespace restio {
 namespace http = ::boost::beast::http;
 
 class HttpServerPrivate;
+class AccessLog;
+class WebSocketEndpoint;
+class EventHub;
 class HttpServer {
 public:
     struct Stats {
         uint32_t requests         = 0;
         uint32_t unknown_requests = 0;
         uint32_t exceptions       = 0;
+        uint32_t timeouts         = 0; // answered 504 since the handler didn't finish in time
+        uint32_t disconnects      = 0; // clients gone while their request was being handled
+        uint32_t rateLimited      = 0; // answered 429. see setRateLimit
+
+        // durations of the phases of the requests, see RequestTimings. Requests are counted once they are done
+        // with, the phases they didn't get to are not counted
+        LatencyHistogram readLatency;
+        LatencyHistogram routingLatency;
+        LatencyHistogram handlerLatency;
+        LatencyHistogram serializationLatency;
+        LatencyHistogram writeLatency;
+
+        // read buffers of all the servers. the current numbers, not reset
+        std::size_t readBuffersInUse    = 0; // borrowed by connections reading a request
+        std::size_t readBuffersPooled   = 0; // cached by threads for reuse
+        std::size_t readBufferPoolBytes = 0;
+    };
+
+    struct TlsOptions {
+        std::string certificateChainFile; // PEM
+        std::string privateKeyFile;       // PEM
+        std::string certificateChain;     // PEM content. used if certificateChainFile is empty
+        std::string privateKey;           // PEM content. used if privateKeyFile is empty
+        std::string ciphers;              // TLS 1.2 cipher list. OpenSSL defaults if empty
+        std::string cipherSuites;         // TLS 1.3 cipher suites. OpenSSL defaults if empty
+        bool        sessionTickets   = true;      // stateless session resumption
+        std::size_t sessionCacheSize = 20 * 1024; // sessions cached for resumption by id. 0 disables the cache
+        std::vector<std::string> alpn { "http/1.1" }; // in the order of preference. add "h2" to offer HTTP/2
+    };
+
+    struct Http2Options {
+        bool          enabled              = true; // clients starting with the HTTP/2 preface get HTTP/2
+        std::uint32_t maxConcurrentStreams = 100;  // more streams are refused
+        std::uint32_t initialWindowSize    = 1 << 20; // flow control window of request bodies
+        std::uint32_t maxFrameSize         = 16384;
+        std::uint32_t maxHeaderListSize    = 64 * 1024; // larger request headers get 431
+        std::uint32_t maxResetsPerSecond   = 200; // more streams reset by the client get GOAWAY ENHANCE_YOUR_CALM
+    };
+
+    // zeros mean the system defaults. Options of TCP are not applied to unix domain sockets
+    struct SocketOptions {
+        bool noDelay       = true; // TCP_NODELAY. responses are written at once anyway, Nagle only delays them
+        int  deferAccept   = 0;    // TCP_DEFER_ACCEPT seconds. connections are accepted once the request comes
+        int  fastOpen      = 0;    // TCP_FASTOPEN queue length. data of SYN is accepted
+        int  receiveBuffer = 0;    // SO_RCVBUF bytes. inherited by the accepted connections
+        int  sendBuffer    = 0;    // SO_SNDBUF bytes. inherited by the accepted connections
+        int  busyPoll      = 0;    // SO_BUSY_POLL microseconds of accepted connections. may need CAP_NET_ADMIN
+        int  backlog       = 0;    // pending connections of listeners. SOMAXCONN by default
+    };
+
+    struct RateLimitOptions {
+        RateLimit   limit;             // of every client. zero rate disables limiting
+        std::string keyHeader;         // a bucket per its value (e.g. an API key) besides the one of the address
+        std::size_t clients = 1 << 16; // tracked at once. the ones idle for the longest time are forgotten
     };
 
     /**
+     * @param bind_address - IP address or host name. All the addresses of the host are listened on.
      * @param base_path - if something is passed outside of base_path, 404 will be returned
      */
     HttpServer(boost::asio::io_context &io_context,
@@ -58,10 +120,132 @@ public:
                std::uint16_t            bind_port,
                const std::string       &base_path    = {},
                const std::string       &service_name = {});
+
+    /**
+     * @brief a server without listeners. Add them with listen(), listenUnix() or adopt*().
+     */
+    explicit HttpServer(boost::asio::io_context &io_context,
+                        const std::string       &base_path    = {},
+                        const std::string       &service_name = {});
     ~HttpServer();
 
+    /**
+     * @brief tune the sockets of the listeners, existing and added later, and of the connections they accept
+     *
+     * Has to be called before the io_context is run. Options the system doesn't support are logged and ignored.
+     */
+    void setSocketOptions(const SocketOptions &options);
+
+    /**
+     * @brief listen on one more TCP address. Throws if it can't be bound.
+     *
+     * "::" accepts both IPv6 and IPv4 connections (dual-stack). A host name is resolved and every its address
+     * is listened on.
+     */
+    void listen(const std::string &bind_address, std::uint16_t bind_port);
+
+    /**
+     * @brief listen on a unix domain socket
+     *
+     * A path starting with '@' is in the abstract namespace (Linux). Otherwise a socket file left by a previous
+     * process at the path is replaced, unless something still listens on it: then it throws std::runtime_error.
+     */
+    void listenUnix(const std::string &path);
+
+    // take over a listening socket opened by someone else, e.g. inherited from the parent process
+    void adoptListener(int fd);
+
+    // take over the sockets passed with systemd socket activation (LISTEN_FDS). returns their number
+    std::size_t adoptSystemdListeners();
+
+    // closes all the listeners
     void stop();
 
+    /**
+     * @brief stop accepting and close the connections as soon as they are done with the requests in progress.
+     *
+     * Responses written meanwhile go with "Connection: close", idle keep-alive connections are closed at once.
+     * HTTP/2 clients get GOAWAY, WebSocket clients a close frame and Server-Sent Events streams just end.
+     * Whatever is left at the deadline is closed and its handlers are requested to stop.
+     * Completes with false in the latter case.
+     */
+    boost::asio::awaitable<bool> drain(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief start a process which takes over the listeners, e.g. a newer version of this one.
+     *
+     * The listening sockets are passed the systemd way, so the successor gets them with adoptSystemdListeners().
+     * No other descriptor of this process is left open in the successor.
+     * Both processes accept connections till this one is drained. Nothing is refused while restarting then.
+     * @param command - the path of the executable and its arguments
+     * @return the pid of the successor. Throws std::system_error if fork() fails. It exits with 127 if exec fails.
+     */
+    int spawnSuccessor(const std::vector<std::string> &command);
+
+    /**
+     * @brief answer 429 with Retry-After to clients sending requests faster than the limit.
+     *
+     * Clients are told apart by their IP address. If RateLimitOptions::keyHeader is set, each of its values is
+     * limited as well, so a client can't get around the limit by changing the header. Peers of unix domain sockets
+     * are limited only by the header. Checked before the request is routed. API methods may have limits
+     * of their own (see API::Method::setRateLimit).
+     * Has to be called before the io_context is run.
+     */
+    void setRateLimit(const RateLimitOptions &options);
+
+    /**
+     * @brief write a record of every answered request to the log, nullptr stops logging
+     *
+     * The log may be shared by several servers. Has to be called before the io_context is run.
+     */
+    void setAccessLog(std::shared_ptr<AccessLog> log);
+
+    /**
+     * @brief call the observer with every request once its response is written (HTTP/2: handed over to
+     * the connection). nullptr removes it
+     *
+     * The span has the timings of all the phases and the trace of the request. The observer is called on
+     * the connection's thread, it should be quick. See JsonLinesExporter. Has to be called before the io_context
+     * is run.
+     */
+    void setRequestObserver(RequestObserver observer);
+
+    // the port of the first TCP listener. useful if it was bound to port 0
+    std::uint16_t port() const;
+
+    /**
+     * @brief serve HTTPS instead of plain HTTP.
+     *
+     * Has to be called before the io_context is run. Throws if the certificate or the key can't be loaded.
+     */
+    void enableTls(const TlsOptions &options);
+
+    /**
+     * @brief answer 504 if a handler doesn't finish in time. zero (default) means no timeout.
+     *
+     * The handler isn't waited for anymore but it's not killed. Stop is requested via RequestContext::stopToken
+     * instead. API methods may set shorter timeouts on their own.
+     */
+    void setRequestTimeout(RequestContext::Clock::duration timeout);
+
+    /**
+     * @brief request stop via RequestContext::stopToken if the client disconnects while its request is handled.
+     *
+     * Enabled by default.
+     */
+    void setCancelOnDisconnect(bool enabled);
+
+    /**
+     * @brief configure HTTP/2. Has to be called before the io_context is run.
+     *
+     * HTTP/2 is used with clients that start with its connection preface: prior knowledge (h2c) on plain
+     * connections or "h2" selected with ALPN (see TlsOptions::alpn). Requests of the streams are handled
+     * concurrently by the same routes. Upgrade from HTTP/1.1 is not supported.
+     *
+     * Throws std::invalid_argument if maxFrameSize or initialWindowSize can't be advertised (RFC 7540 6.5.2).
+     */
+    void setHttp2Options(const Http2Options &options);
+
     /**
      * @brief route a part of the path relative to base_path passed to contructor
      * @param path something a/b/c where all the remaining after "c" if started with [/,?,#,<nothing>]
@@ -73,17 +257,77 @@ public:
      *   a/b
      *   a/b/c
      * The one with the longest path will have preference for the mathing path, the others won't be called at all.
+     *
+     * Routes may be added and removed at any time, including while requests are served on other threads.
+     *
+     * The handler may also be a synchronous function returning void. It's invoked inline without any coroutine
+     * machinery involved.
      */
-    inline void route(std::string &&path, RequestHandler &&handler)
+    template <typename Handler> inline void route(std::string &&path, Handler &&handler)
     {
-        route(http::verb::unknown, std::move(path), std::move(handler));
+        route(http::verb::unknown, std::move(path), std::forward<Handler>(handler));
     }
 
-    void route(http::verb method, std::string &&path, RequestHandler &&handler);
+    template <typename Handler> inline void route(http::verb method, std::string &&path, Handler &&handler)
+    {
+        addRoute(method, std::move(path), makeRequestHandler(std::forward<Handler>(handler)));
+    }
+
+    inline void removeRoute(const std::string &path) { removeRoute(http::verb::unknown, path); }
+    void        removeRoute(http::verb method, const std::string &path);
+
+    /**
+     * @brief run the middlewares around all the routes, see MiddlewareChain
+     *
+     * They see every request, unknown ones too, before it's routed. Replaces the ones used before.
+     * Has to be called before the io_context is run.
+     */
+    template <typename... M> inline void use(M &&...middlewares)
+    {
+        setMiddleware(makeMiddleware(std::forward<M>(middlewares)...));
+    }
+
+    // nullptr removes the middleware
+    void setMiddleware(std::shared_ptr<Middleware> middleware);
+
+    /**
+     * @brief check a request dispatched in-process like the ones read from clients: the rate limit, the middleware
+     *
+     * For handlers serving several requests in one, e.g. the batches of RestHandler. Returns false if
+     * the request is answered already, its handler mustn't be called then. Either way leaveSubrequest() has
+     * to be called once the response is ready.
+     * @param middlewarePassed - set for leaveSubrequest()
+     */
+    bool enterSubrequest(Request                    &request,
+                         Response                   &response,
+                         RequestContext             &context,
+                         std::optional<std::size_t> &middlewarePassed);
+    void leaveSubrequest(const std::optional<std::size_t> &middlewarePassed,
+                         Request                          &request,
+                         Response                         &response,
+                         RequestContext                   &context);
+
+    /**
+     * @brief accept WebSocket connections on the path relative to base_path
+     *
+     * Unlike routes the path has to match exactly (query is ignored). Upgrade requests to other paths go to
+     * the routes as usual. Pass nullptr to remove the endpoint. Established connections are not affected.
+     */
+    void websocket(std::string &&path, std::shared_ptr<const WebSocketEndpoint> endpoint);
 
+    /**
+     * @brief stream events of the hub to GET requests on the path relative to base_path (Server-Sent Events)
+     *
+     * Matched exactly like websocket(). Pass nullptr to remove. Connected clients stay subscribed.
+     */
+    void events(std::string &&path, std::shared_ptr<EventHub> hub);
+
+    // the counters since the last call. may be called from any thread while requests are served
     Stats takeStats();
 
 private:
+    void addRoute(http::verb method, std::string &&path, RequestHandler &&handler);
+
     std::unique_ptr<HttpServerPrivate> d;
 };
 
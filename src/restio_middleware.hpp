@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_common.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace restio {
+
+/**
+ * @brief A chain of middlewares type-erased as a whole. Made by MiddlewareChain.
+ *
+ * The server calls before() once the request is read. The handler is called if all the middlewares let
+ * the request through, otherwise the response is ready already. after() is called once the response is ready,
+ * unless the client is gone. WebSocket upgrades and event streams pass before() too, but there is no response
+ * to call after() with once they are let through.
+ */
+class Middleware {
+public:
+    virtual ~Middleware() = default;
+
+    // the number of middlewares letting the request through. the handler is called only if it's size()
+    virtual std::size_t before(Request &request, Response &response, RequestContext &context) = 0;
+
+    // passed - what before() returned
+    virtual void after(std::size_t passed, Request &request, Response &response, RequestContext &context) = 0;
+
+    inline std::size_t size() const { return size_; }
+    inline bool        proceeds(std::size_t passed) const { return passed == size_; }
+
+protected:
+    inline explicit Middleware(std::size_t size) : size_(size) { }
+
+private:
+    std::size_t size_;
+};
+
+/**
+ * @brief Middlewares composed at compile time, so the calls of the chain are inlined.
+ *
+ * A middleware is any class with either or both of
+ *   bool|void before(Request &, Response &, RequestContext &)
+ *   void      after(Request &, Response &, RequestContext &)
+ * before() returning false short-circuits: the rest of the chain and the handler are skipped, the response
+ * has to be set by the middleware. after() of the middlewares before() of which was called runs in reverse
+ * order, e.g. to add headers or log the result. The calls are concurrent, the middlewares have to be thread-safe.
+ *
+ * Example:
+ *   server.use(Cors { "*" }, Auth { tokens }, AccessLog {});
+ */
+template <typename... M> class MiddlewareChain final : public Middleware {
+public:
+    inline explicit MiddlewareChain(M... middlewares) :
+        Middleware(sizeof...(M)), middlewares_(std::move(middlewares)...)
+    {
+    }
+
+    std::size_t before(Request &request, Response &response, RequestContext &context) override
+    {
+        std::size_t passed = 0;
+        [&]<std::size_t... I>(std::index_sequence<I...>) {
+            ((callBefore(std::get<I>(middlewares_), request, response, context) && ++passed) && ...);
+        }(std::index_sequence_for<M...> {});
+        return passed;
+    }
+
+    void after(std::size_t passed, Request &request, Response &response, RequestContext &context) override
+    {
+        auto entered = std::min(passed + 1, sizeof...(M)); // the one short-circuiting too
+        [&]<std::size_t... I>(std::index_sequence<I...>) {
+            ((sizeof...(M) - 1 - I < entered
+                  ? callAfter(std::get<sizeof...(M) - 1 - I>(middlewares_), request, response, context)
+                  : void()),
+             ...);
+        }(std::index_sequence_for<M...> {});
+    }
+
+private:
+    template <typename T>
+    static inline bool callBefore(T &middleware, Request &request, Response &response, RequestContext &context)
+    {
+        if constexpr (!requires { middleware.before(request, response, context); }) {
+            return true;
+        } else if constexpr (std::is_void_v<decltype(middleware.before(request, response, context))>) {
+            middleware.before(request, response, context);
+            return true;
+        } else {
+            return middleware.before(request, response, context);
+        }
+    }
+
+    template <typename T>
+    static inline void callAfter(T &middleware, Request &request, Response &response, RequestContext &context)
+    {
+        if constexpr (requires { middleware.after(request, response, context); }) {
+            middleware.after(request, response, context);
+        }
+    }
+
+    std::tuple<M...> middlewares_;
+};
+
+template <typename... M> inline std::shared_ptr<Middleware> makeMiddleware(M &&...middlewares)
+{
+    return std::make_shared<MiddlewareChain<std::decay_t<M>...>>(std::forward<M>(middlewares)...);
+}
+
+} // namespace restio
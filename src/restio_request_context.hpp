@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <stop_token>
+#include <string>
+
+namespace restio {
+
+/**
+ * @brief Scratch memory of a request for std::pmr containers, e.g. std::pmr::vector<int> ids(&context.arena).
+ *
+ * Allocation is a pointer bump, deallocation does nothing. Everything is freed at once when the request is
+ * done with, see RequestContext::arena. The first block is allocated on the first use and kept for the next
+ * requests of the connection, so handlers fitting into it don't allocate at all. Not thread-safe.
+ * Copies start empty.
+ */
+class RequestArena : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t initial_size = 4096; // larger requests get more blocks, freed on release
+
+    RequestArena() = default;
+    RequestArena(const RequestArena &) : std::pmr::memory_resource() { }
+    RequestArena(RequestArena &&)            = default;
+    RequestArena &operator=(RequestArena &&) = default;
+    RequestArena &operator=(const RequestArena &) { return *this; }
+
+    // frees everything allocated so far. Called by the server
+    inline void release()
+    {
+        if (used_) {
+            blocks_->resource.release();
+            used_ = false;
+        }
+    }
+
+private:
+    struct Blocks {
+        alignas(std::max_align_t) std::byte initial[initial_size];
+        std::pmr::monotonic_buffer_resource resource { initial, sizeof(initial) };
+    };
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if (!blocks_) {
+            blocks_ = std::make_unique<Blocks>();
+        }
+        used_ = true;
+        return blocks_->resource.allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *, std::size_t, std::size_t) override { }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+    std::unique_ptr<Blocks> blocks_;
+    bool                    used_ = false;
+};
+
+/**
+ * @brief Per-request state passed to handlers along with the request and the response.
+ */
+struct RequestContext {
+    using Clock = std::chrono::steady_clock;
+
+    // When the server stops waiting for the handler and answers 504. Handlers may only shorten it.
+    Clock::time_point deadline = Clock::time_point::max();
+
+    // Stop is requested when the deadline expired or the client disconnected (or was disconnected by a drain),
+    // i.e. nobody waits for the response anymore. Long running handlers should check it or install
+    // a std::stop_callback to cancel their own asynchronous operations.
+    std::stop_token stopToken;
+
+    // IP address of the client, e.g. "192.0.2.1" or "2001:db8::1". Empty for unix domain sockets
+    std::string   peer;
+    std::uint16_t peerPort = 0;
+
+    // Sent as the body when the body of the response is empty, to avoid copying bodies kept elsewhere, e.g. by
+    // the response cache. Code looking at the body of the response has to check it as well
+    std::shared_ptr<const std::string> sharedBody;
+
+    // of the request's caller. Pass trace.traceparent() on to the services called while handling the request
+    TraceContext trace;
+
+    // the phases passed so far. see HttpServer::setRequestObserver for all of them
+    RequestTimings timings;
+
+    // Freed once the response is written. Nothing allocated from it may be referred to by the response
+    // or outlive the handler. HTTP/2 streams have arenas of their own
+    RequestArena arena;
+
+    inline bool cancelled() const { return stopToken.stop_requested(); }
+    inline void setTimeout(Clock::duration timeout) { deadline = std::min(deadline, Clock::now() + timeout); }
+};
+
+} // namespace restio
@@ -24,54 +24,646 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "restio_rest_handler.hpp"
 
+#include "atomic_shared_ptr.hpp"
+#include "rate_limiter.hpp"
+#include "response_cache.hpp"
+#include "single_flight.hpp"
 #include "restio_api_mapper.hpp"
 #include "restio_log.hpp"
 #include "restio_util.hpp"
 
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
+#include <charconv>
+#include <mutex>
+#include <optional>
+#include <thread>
+
 namespace http = ::boost::beast::http; // from <boost/beast/http.hpp>
 using ::boost::asio::awaitable;
 
 namespace restio {
 
+using nlohmann::json;
+
+constexpr std::size_t max_batch_calls = 100;
+
 struct RestHandler::Private {
-    Private(RouteAdder &&routerAdder) : routerAdder(std::move(routerAdder)) { }
+    // APIs are immutable once registered. The whole list is replaced on registration so requests in flight
+    // keep using the version they started with. Sorted by version. Only negotiation needs it, the routes of
+    // the versions refer to their APIs directly.
+    using APIs = std::vector<std::shared_ptr<const api::API>>;
+
+    Private(RouteAdder &&routerAdder, CallChecks &&callChecks) :
+        routerAdder(std::move(routerAdder)), callChecks(std::move(callChecks)), apis(std::make_shared<const APIs>())
+    {
+    }
 
     void registerAPI(api::API &&api)
     {
-        auto api_path = "api/v" + std::to_string(api.version);
-        using namespace std::placeholders;
-        // routerAdder(std::move(api_path), std::bind(&Private::handleRequest, this, _1, _2));
+        auto version  = api.version;
+        auto api_path = "api/v" + std::to_string(version);
+        auto new_api  = std::make_shared<api::API>(std::move(api));
+        new_api->buildParser();
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(registerMutex);
+            bool                        needs_pool = std::any_of(
+                new_api->methods.begin(), new_api->methods.end(), [](auto const &m) {
+                    return m.execution == api::API::Execution::Offload;
+                });
+            if (needs_pool && !offloadPool && !offloadExecutor.load()) {
+                offloadPool = std::make_unique<boost::asio::thread_pool>(
+                    std::max(1u, std::thread::hardware_concurrency()));
+                offloadExecutor.store(
+                    std::make_shared<const boost::asio::any_io_executor>(offloadPool->get_executor()));
+            }
+            bool limited = std::any_of(new_api->methods.begin(), new_api->methods.end(), [](auto const &m) {
+                return m.rateLimit.rate > 0;
+            });
+            if (limited && !limiter) {
+                limiter = std::make_unique<RateLimiter>();
+            }
+            auto new_apis = std::make_shared<APIs>(*apis.load());
+            auto it       = std::lower_bound(new_apis->begin(), new_apis->end(), version, [](auto const &a, int v) {
+                return a->version < v;
+            });
+            first = new_apis->empty();
+            if (it != new_apis->end() && (*it)->version == version) {
+                *it = new_api;
+            } else {
+                new_apis->insert(it, new_api);
+            }
+            apis.store(std::move(new_apis));
+        }
         routerAdder(std::move(api_path),
-                    [this, version = api.version](std::string_view path, Request &request, Response &response)
-                        -> boost::asio::awaitable<void> { return onRequest(version, path, request, response); });
-        (apis[api.version] = std::move(api)).buildParser();
+                    [this, api = std::shared_ptr<const api::API>(std::move(new_api))](
+                        std::string_view path, Request &request, Response &response, RequestContext &context)
+                        -> boost::asio::awaitable<void> { return onRequest(api, path, request, response, context); });
+        if (first) {
+            routerAdder("api",
+                        [this](std::string_view path, Request &request, Response &response, RequestContext &context)
+                            -> boost::asio::awaitable<void> {
+                            return onNegotiatedRequest(path, request, response, context);
+                        });
+        }
+    }
+
+    // "/api/..." without the version in the path
+    awaitable<void>
+    onNegotiatedRequest(std::string_view target, Request &request, Response &response, RequestContext &context)
+    {
+        auto current = apis.load();
+        auto api     = selectVersion(*current, requestedVersion(request));
+        if (!api) {
+            response.result(http::status::not_acceptable);
+            return {};
+        }
+        return onRequest(*api, target, request, response, context);
+    }
+
+    /**
+     * Accept-Version: 2 (or v2) or the version parameter of the media type, e.g. Accept: application/json; version=2.
+     * nullopt if neither is set, 0 if the version is malformed.
+     */
+    static std::optional<int> requestedVersion(const Request &request)
+    {
+        auto parse = [](std::string_view value) {
+            value = trimmed(value);
+            if (value.starts_with('v') || value.starts_with('V')) {
+                value.remove_prefix(1);
+            }
+            int  version = 0;
+            auto result  = std::from_chars(value.data(), value.data() + value.size(), version);
+            return result.ec == std::errc() && result.ptr == value.data() + value.size() ? version : 0;
+        };
+        if (auto it = request.find("Accept-Version"); it != request.end()) {
+            return parse({ it->value().data(), it->value().size() });
+        }
+        auto field  = request[http::field::accept];
+        auto accept = std::string_view(field.data(), field.size());
+
+        constexpr std::string_view parameter = "version=";
+        for (auto pos = accept.find(parameter); pos != std::string_view::npos; pos = accept.find(parameter, pos + 1)) {
+            if (trimmed(accept.substr(0, pos)).ends_with(';')) { // a parameter, not a part of another one's name
+                auto value = accept.substr(pos + parameter.size());
+                return parse(value.substr(0, value.find_first_of(";,")));
+            }
+        }
+        return std::nullopt;
+    }
+
+    static std::string_view trimmed(std::string_view value)
+    {
+        auto start = value.find_first_not_of(" \t");
+        if (start == std::string_view::npos) {
+            return {};
+        }
+        return value.substr(start, value.find_last_not_of(" \t") - start + 1);
+    }
+
+    // the requested version or the newest one compatible with it. the newest one if nothing was requested
+    static const std::shared_ptr<const api::API> *selectVersion(const APIs &apis, std::optional<int> requested)
+    {
+        if (!requested) {
+            return apis.empty() ? nullptr : &apis.back();
+        }
+        const std::shared_ptr<const api::API> *compatible = nullptr;
+        for (auto it = apis.rbegin(); it != apis.rend(); ++it) {
+            auto const &api = **it;
+            if (api.version == *requested) {
+                return &*it;
+            }
+            if (!compatible && api.compatibleFrom && api.compatibleFrom <= *requested && *requested < api.version) {
+                compatible = &*it;
+            }
+        }
+        return compatible;
+    }
+
+    // Not a coroutine: synchronous API handlers and introspection complete inline and return an empty awaitable.
+    awaitable<void> onRequest(const std::shared_ptr<const api::API> &api,
+                              std::string_view                       target,
+                              Request                               &request,
+                              Response                              &response,
+                              RequestContext                        &context)
+    {
+        if (!api->middleware) {
+            return dispatch(api, target, request, response, context);
+        }
+
+        std::size_t passed = 0;
+        try {
+            passed = api->middleware->before(request, response, context);
+        } catch (std::exception &e) {
+            RESTIO_ERROR("Unexpected error on HTTP request handling: " << e.what());
+            response.result(http::status::internal_server_error);
+            return {};
+        }
+        if (!api->middleware->proceeds(passed)) {
+            leave(*api->middleware, passed, request, response, context);
+            return {};
+        }
+        auto pending = dispatch(api, target, request, response, context);
+        if (!pending.valid()) {
+            leave(*api->middleware, passed, request, response, context);
+            return {};
+        }
+        return leaveWhenDone(std::move(pending), api, passed, request, response, context);
     }
 
-    awaitable<void> onRequest(int apiVersion, std::string_view target, Request &request, Response &response)
+    static void
+    leave(Middleware &middleware, std::size_t passed, Request &request, Response &response, RequestContext &context)
     {
         try {
-            auto it = apis.find(apiVersion);
-            BOOST_ASSERT(it != apis.end());
-            if (target.empty())
-                handleAPIIntrospection(it->second, response);
-            else {
-                auto lookupResult = it->second.lookup(request.method(), target);
-                if (!lookupResult) {
-                    RESTIO_ERROR("Failed to lookup API handler for " << request.method_string() << " " << target);
-                    response.result(http::status::not_found);
-                } else {
-                    co_await lookupResult->method.get().handler(request, response, lookupResult->properties);
+            middleware.after(passed, request, response, context);
+        } catch (std::exception &e) {
+            RESTIO_ERROR("Unexpected error on HTTP request handling: " << e.what());
+            response.result(http::status::internal_server_error);
+        }
+    }
+
+    static awaitable<void> leaveWhenDone(awaitable<void>                 pending,
+                                         std::shared_ptr<const api::API> api,
+                                         std::size_t                     passed,
+                                         Request                        &request,
+                                         Response                       &response,
+                                         RequestContext                 &context)
+    {
+        co_await std::move(pending);
+        leave(*api->middleware, passed, request, response, context);
+    }
+
+    awaitable<void> dispatch(const std::shared_ptr<const api::API> &api,
+                             std::string_view                       target,
+                             Request                               &request,
+                             Response                              &response,
+                             RequestContext                        &context)
+    {
+        auto apiVersion = api->version;
+        try {
+            if (target.empty()) {
+                handleAPIIntrospection(*api, response);
+                return {};
+            }
+            auto lookupResult      = api->lookup(request.method(), target);
+            context.timings.routed = RequestContext::Clock::now(); // the server's routing was only a part of it
+            if (!lookupResult && request.method() == http::verb::post && isBatchTarget(target)) {
+                return handleBatch(api, target, request, response, context);
+            }
+            if (!lookupResult) {
+                RESTIO_ERROR("Failed to lookup API handler for " << request.method_string() << " " << target);
+                response.result(http::status::not_found);
+                return {};
+            }
+            auto const &method = lookupResult->method.get();
+            if (method.rateLimit.rate > 0 && !admit(method, request, response, context)) {
+                return {};
+            }
+            if (method.timeout != RequestContext::Clock::duration::zero()) {
+                context.setTimeout(method.timeout);
+            }
+            bool cached = method.caching.ttl != RequestContext::Clock::duration::zero();
+            if ((!cached && !method.coalesce) || request.method() != http::verb::get) {
+                return invoke(api, method, std::move(*lookupResult), request, response, context);
+            }
+
+            Completion completion {
+                apiVersion, method.caching.ttl, cache.generation(), {}, ResponseCache::normalizeTarget(target), {}, {}
+            };
+            completion.key = ResponseCache::makeKey(apiVersion, request, completion.target, method.caching.vary);
+            if (cached) {
+                if (auto entry = cache.find(completion.key)) {
+                    ResponseCache::apply(*entry, request, response, context);
+                    return {};
+                }
+            }
+            if (method.coalesce) {
+                completion.flightKey  = SingleFlight::makeKey(completion.key, request);
+                auto [flight, leader] = inFlight.join(completion.flightKey);
+                if (!leader) {
+                    return follow(std::move(flight), api, method, std::move(*lookupResult), request, response, context);
+                }
+                completion.flight = std::move(flight);
+            }
+
+            auto pending = [&]() {
+                try {
+                    return invoke(api, method, std::move(*lookupResult), request, response, context);
+                } catch (...) {
+                    complete(completion, request, response, context, false); // don't leave followers waiting
+                    throw;
                 }
+            }();
+            if (!pending.valid()) {
+                complete(completion, request, response, context, true);
+                return {};
             }
+            return completeWhenDone(std::move(pending), std::move(completion), request, response, context);
         } catch (std::exception &e) {
             RESTIO_ERROR("Unexpected error on HTTP request handling: " << e.what());
             response.result(http::status::internal_server_error);
         }
+        return {};
     }
 
-    void handleAPIIntrospection(api::API &api, Response &response)
+    awaitable<void> invoke(const std::shared_ptr<const api::API> &api,
+                           const api::API::Method                &method,
+                           api::API::LookupResult               &&lookupResult,
+                           Request                               &request,
+                           Response                              &response,
+                           RequestContext                        &context)
+    {
+        if (method.execution == api::API::Execution::Offload) {
+            return invokeOffloaded(
+                api, method, std::move(lookupResult.properties), request, response, context, *offloadExecutor.load());
+        }
+        if (method.syncHandler) {
+            method.syncHandler(request, response, lookupResult.properties, context);
+            return {};
+        }
+        return invokeAsync(api, method, std::move(lookupResult.properties), request, response, context);
+    }
+
+    // the method's buckets are separate from the ones of other methods
+    bool admit(const api::API::Method &method, const Request &request, Response &response, RequestContext &context)
+    {
+        auto wait = limiter->acquire(
+            request, context, rateLimitHeader, method.rateLimit, reinterpret_cast<std::uintptr_t>(&method));
+        if (wait == RateLimiter::Clock::duration::zero()) {
+            return true;
+        }
+        RateLimiter::reject(response, wait);
+        return false;
+    }
+
+    // what to do with the response of a cached or coalesced method once its handler is done
+    struct Completion {
+        int                                   apiVersion;
+        RequestContext::Clock::duration       cacheTtl;
+        std::uint64_t                         cacheGeneration; // see ResponseCache::generation
+        std::string                           key;
+        std::string                           target;    // normalized
+        std::shared_ptr<SingleFlight::Flight> flight;    // set if the request leads a flight
+        std::string                           flightKey; // see SingleFlight::makeKey
+    };
+
+    void complete(Completion &completion, const Request &request, Response &response, RequestContext &context, bool ok)
+    {
+        bool usable = ok && !context.cancelled();
+        if (usable && completion.cacheTtl != RequestContext::Clock::duration::zero()) {
+            cache.store(std::string(completion.key),
+                        completion.apiVersion,
+                        std::move(completion.target),
+                        response,
+                        completion.cacheTtl,
+                        completion.cacheGeneration);
+        }
+        if (completion.flight) {
+            inFlight.finish(completion.flightKey, *completion.flight, usable ? &response : nullptr);
+        }
+        if (usable) {
+            revalidate(request, response);
+        }
+    }
+
+    awaitable<void> completeWhenDone(awaitable<void> pending,
+                                     Completion      completion,
+                                     Request        &request,
+                                     Response       &response,
+                                     RequestContext &context)
+    {
+        try {
+            co_await std::move(pending);
+        } catch (...) {
+            complete(completion, request, response, context, false);
+            throw;
+        }
+        complete(completion, request, response, context, true);
+    }
+
+    // gets the response of the flight's leader. runs the handler itself if the leader failed
+    awaitable<void> follow(std::shared_ptr<SingleFlight::Flight> flight,
+                           std::shared_ptr<const api::API>       api,
+                           const api::API::Method               &method,
+                           api::API::LookupResult                lookupResult,
+                           Request                              &request,
+                           Response                             &response,
+                           RequestContext                       &context)
+    {
+        if (co_await SingleFlight::wait(std::move(flight), response, context)) {
+            revalidate(request, response);
+            co_return;
+        }
+        if (context.cancelled()) {
+            co_return;
+        }
+        auto pending = invoke(api, method, std::move(lookupResult), request, response, context);
+        if (pending.valid()) {
+            co_await std::move(pending);
+        }
+    }
+
+    // answers 304 if the client has the response already
+    static void revalidate(const Request &request, Response &response)
+    {
+        auto etag = response[http::field::etag];
+        if (!etag.empty() && ResponseCache::notModified(request, { etag.data(), etag.size() })) {
+            response.result(http::status::not_modified);
+            response.body().clear();
+        }
+    }
+
+    // the api is kept alive till the handler finishes even if the version is replaced meanwhile
+    static awaitable<void> invokeAsync(std::shared_ptr<const api::API> /* api */,
+                                       const api::API::Method         &method,
+                                       Properties                      properties,
+                                       Request                        &request,
+                                       Response                       &response,
+                                       RequestContext                 &context)
+    {
+        try {
+            co_await method.handler(request, response, properties, context);
+        } catch (std::exception &e) {
+            RESTIO_ERROR("Unexpected error on HTTP request handling: " << e.what());
+            response.result(http::status::internal_server_error);
+        }
+    }
+
+    // Runs the handler on the offload executor. The session's executor is resumed once it's done.
+    static awaitable<void> invokeOffloaded(std::shared_ptr<const api::API> /* api */,
+                                           const api::API::Method         &method,
+                                           Properties                      properties,
+                                           Request                        &request,
+                                           Response                       &response,
+                                           RequestContext                 &context,
+                                           boost::asio::any_io_executor    executor)
+    {
+        try {
+            co_await boost::asio::co_spawn(
+                executor, invokeAny(method, properties, request, response, context), boost::asio::use_awaitable);
+        } catch (std::exception &e) {
+            RESTIO_ERROR("Unexpected error on HTTP request handling: " << e.what());
+            response.result(http::status::internal_server_error);
+        }
+    }
+
+    static awaitable<void> invokeAny(const api::API::Method &method,
+                                     const Properties       &properties,
+                                     Request                &request,
+                                     Response               &response,
+                                     RequestContext         &context)
+    {
+        if (method.syncHandler) {
+            method.syncHandler(request, response, properties, context);
+        } else {
+            co_await method.handler(request, response, properties, context);
+        }
+    }
+
+    // one call of a batch
+    struct BatchCall {
+        Request                    request;
+        Response                   response;
+        RequestContext             context;
+        std::optional<std::size_t> middlewarePassed; // see CallChecks
+        std::size_t                pathOffset = 0;     // where the target relative to the api root starts
+        bool                       valid      = false; // the description of the call was fine
+    };
+    using BatchCalls = std::vector<BatchCall>;
+
+    // the api methods of the same name have preference
+    static bool isBatchTarget(std::string_view target)
+    {
+        target = target.substr(0, target.find_first_of("?#"));
+        return target == "/_batch" || target == "_batch";
+    }
+
+    /**
+     * Each item of the JSON array in the request body is {"method": "GET", "uri": "resource/foo", "body": ...}
+     * with an uri relative to the api root. The calls inherit headers of the batch request and may add
+     * their own with "headers", except for the credentials. They are dispatched like separate requests, through
+     * the checks of the server, the ones suspending run concurrently. The response is an array
+     * of {"status": 200, "headers": {...}, "body": ...} in the same order.
+     */
+    awaitable<void> handleBatch(const std::shared_ptr<const api::API> &api,
+                                std::string_view                       target,
+                                Request                               &request,
+                                Response                              &response,
+                                RequestContext                        &context)
+    {
+        auto items = json::parse(request.body(), nullptr, false);
+        if (!items.is_array() || items.size() > max_batch_calls) {
+            response.result(http::status::bad_request);
+            response.body() = "Expected an array of at most " + std::to_string(max_batch_calls) + " calls";
+            return {};
+        }
+        auto requestTarget = request.target();
+        auto prefix        = std::string(requestTarget.data(), requestTarget.size() - target.size());
+        auto calls         = std::make_shared<BatchCalls>(items.size());
+        for (std::size_t i = 0; i < items.size(); i++) {
+            auto &call   = (*calls)[i];
+            call.valid   = makeBatchCall(items[i], prefix, request, call);
+            call.context = context;
+            if (!call.valid) {
+                call.response.result(http::status::bad_request);
+            }
+        }
+
+        // the pending ones are run once all the synchronous ones are done
+        std::vector<std::pair<std::size_t, awaitable<void>>> pending;
+        auto const                                          &checks = callChecks;
+        for (std::size_t i = 0; i < calls->size(); i++) {
+            auto &call = (*calls)[i];
+            if (!call.valid) {
+                continue;
+            }
+            if (checks.enter && !checks.enter(call.request, call.response, call.context, call.middlewarePassed)) {
+                continue;
+            }
+            auto callTarget = call.request.target();
+            auto path       = std::string_view(callTarget.data(), callTarget.size()).substr(call.pathOffset);
+            auto ret        = onRequest(api, path, call.request, call.response, call.context);
+            if (ret.valid()) {
+                pending.emplace_back(i, std::move(ret));
+            }
+        }
+        if (pending.empty()) {
+            finishBatch(*calls, response);
+            return {};
+        }
+        return awaitBatch(std::move(calls), std::move(pending), response);
+    }
+
+    // the calls act on behalf of the client of the batch request, they mustn't pass for someone else
+    static bool isCredential(std::string_view name)
+    {
+        auto field = http::string_to_field({ name.data(), name.size() });
+        return field == http::field::authorization || field == http::field::proxy_authorization
+            || field == http::field::cookie;
+    }
+
+    static bool makeBatchCall(const json &item, const std::string &prefix, const Request &batch, BatchCall &call)
+    {
+        if (!item.is_object()) {
+            return false;
+        }
+        auto method = item.find("method");
+        auto uri    = item.find("uri");
+        if (method == item.end() || !method->is_string() || uri == item.end() || !uri->is_string()) {
+            return false;
+        }
+        auto verb = http::string_to_verb(method->get_ref<const std::string &>());
+        auto path = std::string_view(uri->get_ref<const std::string &>());
+        path      = path.substr(std::min(path.find_first_not_of('/'), path.size()));
+        if (verb == http::verb::unknown || isBatchTarget(path)) {
+            return false; // no nested batches
+        }
+
+        call.request.base() = batch.base();
+        call.request.erase(http::field::content_type);
+        call.request.erase(http::field::content_length);
+        call.request.erase(http::field::if_none_match); // it's for the batch response
+        call.request.method(verb);
+        call.request.target(prefix + "/" + std::string(path));
+        call.pathOffset = prefix.size();
+        auto headers    = item.find("headers");
+        if (headers != item.end() && headers->is_object()) {
+            for (auto const &[name, value] : headers->items()) {
+                if (!value.is_string() || isCredential(name)) {
+                    return false;
+                }
+                call.request.set(name, value.get<std::string>());
+            }
+        }
+        auto body = item.find("body");
+        if (body != item.end() && !body->is_null()) {
+            if (body->is_string()) {
+                call.request.body() = body->get<std::string>();
+            } else {
+                call.request.body() = body->dump();
+                if (call.request[http::field::content_type].empty()) {
+                    call.request.set(http::field::content_type, "application/json");
+                }
+            }
+        }
+        call.request.prepare_payload();
+        return true;
+    }
+
+    // the calls are spawned on the session's strand, so they complete one by one on it
+    awaitable<void> awaitBatch(std::shared_ptr<BatchCalls>                          calls,
+                               std::vector<std::pair<std::size_t, awaitable<void>>> pending,
+                               Response                                            &response)
+    {
+        auto executor  = co_await boost::asio::this_coro::executor;
+        auto done      = std::make_shared<boost::asio::steady_timer>(executor,
+                                                                 boost::asio::steady_timer::time_point::max());
+        auto remaining = std::make_shared<std::size_t>(pending.size());
+        for (auto &[index, call] : pending) {
+            boost::asio::co_spawn(executor,
+                                  std::move(call),
+                                  [calls, index = index, done, remaining](std::exception_ptr e) {
+                                      if (e) {
+                                          (*calls)[index].response.result(http::status::internal_server_error);
+                                      }
+                                      if (--*remaining == 0) {
+                                          done->cancel();
+                                      }
+                                  });
+        }
+        if (*remaining) {
+            boost::system::error_code ec;
+            co_await done->async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        }
+        finishBatch(*calls, response);
+    }
+
+    void finishBatch(BatchCalls &calls, Response &response)
+    {
+        if (callChecks.leave) {
+            for (auto &call : calls) {
+                callChecks.leave(call.middlewarePassed, call.request, call.response, call.context);
+            }
+        }
+        makeBatchResponse(calls, response);
+    }
+
+    static void makeBatchResponse(BatchCalls &calls, Response &response)
+    {
+        auto results = json::array();
+        for (auto &call : calls) {
+            auto &result     = results.emplace_back(json::object());
+            result["status"] = call.response.result_int();
+            auto headers     = json::object();
+            for (auto const &field : call.response.base()) {
+                headers[std::string(field.name_string())] = std::string(field.value());
+            }
+            result["headers"] = std::move(headers);
+            auto &body        = call.response.body();
+            if (body.empty() && call.context.sharedBody) {
+                body = *call.context.sharedBody;
+            }
+            if (body.empty()) {
+                continue;
+            }
+            // JSON bodies are embedded as they are, the others as strings
+            auto contentType = call.response[http::field::content_type];
+            bool isJson      = contentType.find("json") != decltype(contentType)::npos;
+            auto parsed      = isJson ? json::parse(body, nullptr, false) : json(json::value_t::discarded);
+            result["body"]   = parsed.is_discarded() ? json(std::move(body)) : std::move(parsed);
+        }
+        makeOkResponse(response, results.dump());
+    }
+
+    void handleAPIIntrospection(const api::API &api, Response &response)
     {
         // we are smarter than OpenAPI 3.0
         auto        verStr        = std::to_string(api.version);
@@ -120,16 +712,45 @@ td.code { font-family: monospace; max-width: 60em; padding: 0; }
         makeOkResponse(response, std::move(introTemplate), "text/html; charset=utf-8");
     }
 
-    RouteAdder                        routerAdder;
-    std::unordered_map<int, api::API> apis;
+    RouteAdder                                          routerAdder;
+    CallChecks                                          callChecks; // of the server, for the calls of batches
+    std::mutex                                          registerMutex;
+    AtomicSharedPtr<const APIs>                         apis;
+    AtomicSharedPtr<const boost::asio::any_io_executor> offloadExecutor; // may be replaced while requests run
+    std::unique_ptr<boost::asio::thread_pool>           offloadPool;     // if offloadExecutor wasn't set explicitly
+    ResponseCache                                       cache;
+    SingleFlight                                        inFlight; // of coalesced methods
+    std::unique_ptr<RateLimiter>                        limiter;  // if some methods are rate limited
+    std::string                                         rateLimitHeader;
 };
 
-RestHandler::RestHandler(RouteAdder &&routerAdder) : impl(std::make_unique<Private>(std::move(routerAdder))) { }
+RestHandler::RestHandler(RouteAdder &&routerAdder, CallChecks &&callChecks) :
+    impl(std::make_unique<Private>(std::move(routerAdder), std::move(callChecks)))
+{
+}
 
 RestHandler::~RestHandler() { }
 
 void RestHandler::registerAPI(api::API &&api) { impl->registerAPI(std::move(api)); }
 
+void RestHandler::setOffloadExecutor(boost::asio::any_io_executor executor)
+{
+    std::lock_guard<std::mutex> lock(impl->registerMutex);
+    impl->offloadExecutor.store(std::make_shared<const boost::asio::any_io_executor>(std::move(executor)));
+}
+
+void RestHandler::invalidateCache(int apiVersion, std::string_view targetPrefix)
+{
+    impl->cache.invalidate(apiVersion, targetPrefix);
+}
+
+void RestHandler::setCacheLimits(std::size_t maxBytes, std::size_t maxEntries)
+{
+    impl->cache.setLimits(maxBytes, maxEntries);
+}
+
+void RestHandler::setRateLimitKey(std::string header) { impl->rateLimitHeader = std::move(header); }
+
 void RestHandler::makeOkResponse(Response &response, std::string &&body, const std::string_view contentType)
 {
     if (body.size()) {
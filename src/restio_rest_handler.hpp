@@ -26,9 +26,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "restio_common.hpp"
 
+#include <boost/asio/any_io_executor.hpp>
 #include <nlohmann/json.hpp>
 
 #include <memory>
+#include <optional>
 
 namespace restio {
 
@@ -40,18 +42,69 @@ class RestHandler {
 public:
     using RouteAdder = std::function<void(std::string &&, RequestHandler &&)>;
 
+    // the checks of the server (rate limit, middleware) run for every call of a batch, see HttpServer::enterSubrequest
+    struct CallChecks {
+        std::function<bool(Request &, Response &, RequestContext &, std::optional<std::size_t> &)>       enter;
+        std::function<void(const std::optional<std::size_t> &, Request &, Response &, RequestContext &)> leave;
+    };
+
     template <class T>
     RestHandler(T &server) :
         RestHandler(
-            [&](std::string &&path, RequestHandler &&handler) { server.route(std::move(path), std::move(handler)); })
+            [&](std::string &&path, RequestHandler &&handler) { server.route(std::move(path), std::move(handler)); },
+            serverChecks(server))
     {
     }
 
-    RestHandler(RouteAdder &&routerAdder);
+    RestHandler(RouteAdder &&routerAdder, CallChecks &&callChecks = {});
     ~RestHandler();
 
+    /**
+     * @brief register a new API version or replace already registered one.
+     *
+     * Safe to call while requests are being served. Requests in flight finish with the previous version.
+     *
+     * The version is selected by the path ("api/v2/...") or negotiated for "api/..." by Accept-Version header
+     * or the version parameter of the media type in Accept ("application/json; version=2"). The newest version
+     * compatible with the requested one is used if it isn't registered (see API::compatibleWith), 406 is answered
+     * if there is none. The newest version serves requests not asking for any.
+     *
+     * Besides its methods every version serves "POST <api root>/_batch" unless the API has a method of that path.
+     * It takes a JSON array of calls {"method", "uri", "body", "headers"} with uris relative to the api root,
+     * dispatches them in-process, concurrently if their handlers suspend, and answers with an array
+     * of {"status", "headers", "body"} in the same order. The calls pass the rate limit and the middleware of
+     * the server like separate requests and can't change the credentials (Authorization, Cookie) of the batch.
+     */
     void registerAPI(api::API &&api);
 
+    /**
+     * @brief executor to run API methods marked with offload() on.
+     *
+     * Should be set before registering APIs. If it's not set, a thread pool with a thread per CPU core is
+     * created when the first API with offloaded methods is registered. May be replaced while requests are served,
+     * the offloaded handlers running already finish on the previous executor.
+     */
+    void setOffloadExecutor(boost::asio::any_io_executor executor);
+
+    /**
+     * @brief drop cached responses (see API::cache)
+     *
+     * Mutating handlers are expected to call it for the resources they change.
+     * @param apiVersion - 0 for all versions
+     * @param targetPrefix - path relative to the api root, e.g. "resource/foo". Empty for everything.
+     */
+    void invalidateCache(int apiVersion = 0, std::string_view targetPrefix = {});
+
+    void setCacheLimits(std::size_t maxBytes, std::size_t maxEntries);
+
+    /**
+     * @brief tell clients of rate limited methods (see API::rateLimit) apart by the header, e.g. an API key
+     *
+     * The clients are limited by their address in any case, the header adds a bucket per its value. Has to be called
+     * before the requests are served, it's not synchronized with them.
+     */
+    void setRateLimitKey(std::string header);
+
     static void makeOkResponse(Response              &response,
                                std::string          &&body        = std::string(),
                                const std::string_view contentType = "application/json; charset=utf-8");
@@ -63,6 +116,18 @@ public:
     }
 
 private:
+    template <class T> static CallChecks serverChecks(T &server)
+    {
+        CallChecks checks;
+        checks.enter = [&](Request &request, Response &response, RequestContext &context, auto &passed) {
+            return server.enterSubrequest(request, response, context, passed);
+        };
+        checks.leave = [&](auto const &passed, Request &request, Response &response, RequestContext &context) {
+            server.leaveSubrequest(passed, request, response, context);
+        };
+        return checks;
+    }
+
     struct Private;
     std::unique_ptr<Private> impl;
 };
@@ -0,0 +1,217 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "restio_trace.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+
+namespace restio {
+
+namespace {
+
+    constexpr std::size_t traceparent_size = 55; // of version 00
+
+    template <std::size_t N> void randomId(std::array<std::uint8_t, N> &id)
+    {
+        thread_local std::mt19937_64 generator(std::random_device {}());
+        do {
+            for (std::size_t i = 0; i < N; i += 8) {
+                auto value = generator();
+                std::copy_n(reinterpret_cast<const std::uint8_t *>(&value), std::min<std::size_t>(8, N - i), &id[i]);
+            }
+        } while (id == std::array<std::uint8_t, N> {}); // all zeros are invalid
+    }
+
+    int hexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1; // upper case is invalid too
+    }
+
+    // false if it's not lower-case hex
+    bool decodeHex(std::string_view text, std::uint8_t *bytes)
+    {
+        for (std::size_t i = 0; i < text.size(); i += 2) {
+            int high = hexDigit(text[i]);
+            int low  = hexDigit(text[i + 1]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            bytes[i / 2] = std::uint8_t(high << 4 | low);
+        }
+        return true;
+    }
+
+    template <std::size_t N> std::string encodeHex(const std::array<std::uint8_t, N> &bytes)
+    {
+        constexpr char digits[] = "0123456789abcdef";
+        std::string    text(N * 2, '0');
+        for (std::size_t i = 0; i < N; i++) {
+            text[i * 2]     = digits[bytes[i] >> 4];
+            text[i * 2 + 1] = digits[bytes[i] & 0xf];
+        }
+        return text;
+    }
+
+    // version-traceid-parentid-flags. later versions may append fields
+    bool parseTraceparent(std::string_view header, TraceContext &trace)
+    {
+        if (header.size() < traceparent_size || header[2] != '-' || header[35] != '-' || header[52] != '-') {
+            return false;
+        }
+        std::uint8_t version;
+        if (!decodeHex(header.substr(0, 2), &version) || version == 0xff
+            || (version == 0 ? header.size() != traceparent_size
+                             : header.size() > traceparent_size && header[traceparent_size] != '-')) {
+            return false;
+        }
+        return decodeHex(header.substr(3, 32), trace.traceId.data())
+            && decodeHex(header.substr(36, 16), trace.parentId.data()) && decodeHex(header.substr(53, 2), &trace.flags)
+            && trace.traceId != decltype(trace.traceId) {} && trace.hasParent();
+    }
+
+    std::uint64_t micros(std::chrono::steady_clock::duration duration)
+    {
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    }
+
+} // namespace
+
+TraceContext TraceContext::fromHeader(std::string_view traceparent)
+{
+    TraceContext trace;
+    if (!parseTraceparent(traceparent, trace)) {
+        trace = {};
+        randomId(trace.traceId);
+    }
+    randomId(trace.spanId);
+    return trace;
+}
+
+std::string TraceContext::traceparent() const
+{
+    constexpr char digits[] = "0123456789abcdef";
+    std::string    header   = "00-" + traceIdString() + "-" + spanIdString() + "-00";
+    header[53]              = digits[flags >> 4];
+    header[54]              = digits[flags & 0xf];
+    return header;
+}
+
+std::string TraceContext::traceIdString() const { return encodeHex(traceId); }
+std::string TraceContext::parentIdString() const { return encodeHex(parentId); }
+std::string TraceContext::spanIdString() const { return encodeHex(spanId); }
+
+void LatencyHistogram::add(std::chrono::steady_clock::duration duration) { buckets[bucket(duration)]++; }
+
+std::size_t LatencyHistogram::bucket(std::chrono::steady_clock::duration duration)
+{
+    return std::min<std::size_t>(std::bit_width(micros(duration)), bucket_count - 1);
+}
+
+std::uint64_t LatencyHistogram::count() const
+{
+    std::uint64_t total = 0;
+    for (auto n : buckets) {
+        total += n;
+    }
+    return total;
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double share) const
+{
+    auto total = count();
+    if (!total) {
+        return {};
+    }
+    auto          rank   = std::uint64_t(std::clamp(share, 0.0, 1.0) * double(total));
+    std::uint64_t passed = 0;
+    for (std::size_t i = 0; i < bucket_count; i++) {
+        passed += buckets[i];
+        if (passed > rank || passed == total) {
+            return std::chrono::microseconds(std::uint64_t(1) << i);
+        }
+    }
+    return {};
+}
+
+struct JsonLinesExporter::Output {
+    std::mutex    mutex;
+    std::ofstream file;
+    std::ostream *stream;
+};
+
+JsonLinesExporter::JsonLinesExporter(std::ostream &out) : output_(std::make_shared<Output>())
+{
+    output_->stream = &out;
+}
+
+JsonLinesExporter::JsonLinesExporter(const std::string &path) : output_(std::make_shared<Output>())
+{
+    output_->file.open(path, std::ios::app);
+    if (!output_->file) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    output_->stream = &output_->file;
+}
+
+void JsonLinesExporter::operator()(const RequestSpan &span) const
+{
+    using namespace std::chrono;
+    nlohmann::json line {
+        { "time", duration_cast<microseconds>(system_clock::now().time_since_epoch()).count() },
+        { "traceId", span.trace.traceIdString() },
+        { "spanId", span.trace.spanIdString() },
+        { "method", std::string(boost::beast::http::to_string(span.method)) },
+        { "target", span.target },
+        { "status", span.status },
+        { "peer", span.peer },
+        { "readUs", micros(span.timings.read()) },
+        { "routingUs", micros(span.timings.routing()) },
+        { "handlerUs", micros(span.timings.handler()) },
+        { "serializationUs", micros(span.timings.serialization()) },
+        { "writeUs", micros(span.timings.write()) },
+    };
+    if (span.trace.hasParent()) {
+        line["parentId"] = span.trace.parentIdString();
+    }
+    auto                        text = line.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+    std::lock_guard<std::mutex> lock(output_->mutex);
+    *output_->stream << text << '\n';
+    output_->stream->flush();
+}
+
+} // namespace restio
@@ -0,0 +1,154 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <boost/beast/http/verb.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace restio {
+
+/**
+ * @brief When a request passed the phases of its handling, steady clock. Unset (default) time points are
+ * the phases the request didn't get to.
+ *
+ * HTTP/2 streams are received and parsed at once and written by the connection, so serialized and written
+ * are unset for them.
+ */
+struct RequestTimings {
+    using Clock     = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    TimePoint received;   // the first byte of the request
+    TimePoint parsed;     // the request is read
+    TimePoint routed;     // the handler is looked up. RestHandler updates it once the API method is found
+    TimePoint handled;    // the response is ready
+    TimePoint serialized; // the response is rendered for writing
+    TimePoint written;
+
+    // zero if any of the time points is unset
+    static inline Clock::duration between(TimePoint from, TimePoint to)
+    {
+        return from == TimePoint {} || to == TimePoint {} ? Clock::duration::zero() : to - from;
+    }
+
+    inline Clock::duration read() const { return between(received, parsed); }
+    inline Clock::duration routing() const { return between(parsed, routed); }
+    inline Clock::duration handler() const { return between(routed, handled); }
+    inline Clock::duration serialization() const { return between(handled, serialized); }
+    inline Clock::duration write() const { return between(serialized, written); }
+};
+
+/**
+ * @brief W3C Trace Context of a request (the traceparent header).
+ *
+ * The server continues the trace of the caller or starts a new one if the request has no valid traceparent.
+ * Either way the request gets a span of its own. tracestate is left in the request as is.
+ */
+struct TraceContext {
+    std::array<std::uint8_t, 16> traceId {};
+    std::array<std::uint8_t, 8>  parentId {}; // the caller's span. zeros if the trace started here
+    std::array<std::uint8_t, 8>  spanId {};   // of the request
+    std::uint8_t                 flags = 0;   // 1 - sampled by the caller
+
+    // a child span of the traceparent header value, the root span of a new trace if it's empty or malformed
+    static TraceContext fromHeader(std::string_view traceparent);
+
+    // the traceparent header of the calls made while handling the request, the request's span is their parent
+    std::string traceparent() const;
+
+    // lower-case hex
+    std::string traceIdString() const;
+    std::string parentIdString() const;
+    std::string spanIdString() const;
+
+    inline bool hasParent() const { return parentId != decltype(parentId) {}; }
+};
+
+/**
+ * @brief Counts of durations in power of two buckets of microseconds.
+ *
+ * Bucket 0 counts the durations shorter than a microsecond, bucket i > 0 the ones from 2^(i-1) up to 2^i
+ * microseconds. The last bucket counts everything longer too.
+ */
+struct LatencyHistogram {
+    static constexpr std::size_t bucket_count = 24; // the last one starts at 2^22 microseconds (~4 s)
+
+    std::array<std::uint32_t, bucket_count> buckets {};
+
+    void          add(std::chrono::steady_clock::duration duration);
+    std::uint64_t count() const;
+
+    // the bucket counting the duration
+    static std::size_t bucket(std::chrono::steady_clock::duration duration);
+
+    // the upper bound of the bucket with the given share (0..1) of the durations. zero if there are none
+    std::chrono::microseconds percentile(double share) const;
+};
+
+/**
+ * @brief An answered request reported to the request observer. see HttpServer::setRequestObserver
+ */
+struct RequestSpan {
+    boost::beast::http::verb method = boost::beast::http::verb::unknown;
+    std::string              target;
+    unsigned                 status = 0;
+    std::string              peer; // see RequestContext::peer
+    TraceContext             trace;
+    RequestTimings           timings;
+};
+
+using RequestObserver = std::function<void(const RequestSpan &)>;
+
+/**
+ * @brief A request observer writing a JSON object per line: the trace ids, the request and the durations
+ * of its phases in microseconds.
+ *
+ * Meant for local testing and for feeding tools which import JSON lines. Copies share the output. Thread-safe.
+ */
+class JsonLinesExporter {
+public:
+    // the stream has to outlive the exporter and its copies
+    explicit JsonLinesExporter(std::ostream &out);
+
+    // appends to the file. Throws std::runtime_error if it can't be opened
+    explicit JsonLinesExporter(const std::string &path);
+
+    void operator()(const RequestSpan &span) const;
+
+private:
+    struct Output;
+
+    std::shared_ptr<Output> output_;
+};
+
+} // namespace restio
@@ -24,6 +24,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "restio_util.hpp"
 
+#ifdef BOOST_ASIO_HAS_IO_URING
+#include <liburing.h>
+#endif
+
 namespace restio {
 
 std::string htmlEscape(const std::string &data)
@@ -55,4 +59,16 @@ std::string htmlEscape(const std::string &data)
     return result;
 }
 
+bool ioBackendAvailable()
+{
+#ifdef BOOST_ASIO_HAS_IO_URING
+    io_uring ring;
+    if (io_uring_queue_init(1, &ring, 0) != 0) {
+        return false;
+    }
+    io_uring_queue_exit(&ring);
+#endif
+    return true;
+}
+
 } // namespace restio
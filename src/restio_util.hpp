@@ -30,4 +30,8 @@ namespace restio {
 
 std::string htmlEscape(const std::string &data);
 
+// false if the I/O backend restio is built with can't run here. Only io_uring (RESTIO_IO_URING) may be unavailable:
+// old kernels, seccomp in containers. io_context construction throws then, so check it before
+bool ioBackendAvailable();
+
 } // namespace restio
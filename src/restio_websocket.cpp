@@ -0,0 +1,65 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "restio_websocket.hpp"
+
+#include "restio_log.hpp"
+
+namespace restio {
+
+WebSocketEndpoint::WebSocketEndpoint(Extractor &&extractor) : WebSocketEndpoint(std::move(extractor), Options()) { }
+
+WebSocketEndpoint::WebSocketEndpoint(Extractor &&extractor, Options options) :
+    extractor_(std::move(extractor)), options_(options)
+{
+}
+
+boost::asio::awaitable<void> WebSocketEndpoint::dispatch(WebSocketConnection &connection, std::string &message) const
+{
+    auto it = handlers_.find(extractor_(message));
+    if (it == handlers_.end()) {
+        it = handlers_.find(std::string());
+        if (it == handlers_.end()) {
+            RESTIO_WARN("No handler for websocket message: " << message.substr(0, 64));
+            return {};
+        }
+    }
+    return it->second(connection, message);
+}
+
+void WebSocketEndpoint::opened(WebSocketConnection &connection) const
+{
+    if (opened_) {
+        opened_(connection);
+    }
+}
+
+void WebSocketEndpoint::closed(WebSocketConnection &connection) const
+{
+    if (closed_) {
+        closed_(connection);
+    }
+}
+
+} // namespace restio
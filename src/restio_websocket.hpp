@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_common.hpp"
+
+#include <boost/asio/awaitable.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+namespace restio {
+
+/**
+ * @brief An accepted WebSocket connection.
+ *
+ * Thread-safe. Messages are queued and written in order by the connection's own writer, so senders never wait
+ * for the client. Keep a shared_ptr (shared_from_this()) to send from outside of message handlers.
+ */
+class WebSocketConnection : public std::enable_shared_from_this<WebSocketConnection> {
+public:
+    virtual ~WebSocketConnection() = default;
+
+    // the message may be shared by many connections, e.g. on broadcast
+    virtual void send(std::shared_ptr<const std::string> message, bool binary = false) = 0;
+
+    inline void send(std::string message, bool binary = false)
+    {
+        send(std::make_shared<const std::string>(std::move(message)), binary);
+    }
+
+    // sends close frame after the queued messages
+    virtual void close() = 0;
+};
+
+/**
+ * @brief Routes messages of WebSocket connections to handlers.
+ *
+ * The extractor returns the key of a message (e.g. "type" field of a JSON message). The handler registered with
+ * the key is called then. Handlers of a connection are called one by one in the order of messages.
+ *
+ * Example:
+ *   auto endpoint = std::make_shared<WebSocketEndpoint>([](std::string_view message) { return typeOf(message); });
+ *   endpoint->on("ping", [](WebSocketConnection &connection, std::string &) { connection.send("pong"); });
+ *   server.websocket("events", std::move(endpoint));
+ */
+class WebSocketEndpoint {
+public:
+    struct Options {
+        bool                 permessageDeflate = true;
+        std::size_t          maxMessageSize    = 1024 * 1024;
+        std::size_t          maxQueuedMessages = 1024; // the connection is closed if a client can't keep up
+        std::chrono::seconds idleTimeout { 300 };      // pings are sent to idle clients. closed if no pong
+    };
+
+    using Extractor = Function<std::string(std::string_view message)>;
+    using Handler   = Function<boost::asio::awaitable<void>(WebSocketConnection &connection, std::string &message)>;
+    using Observer  = Function<void(WebSocketConnection &connection)>;
+
+    explicit WebSocketEndpoint(Extractor &&extractor);
+    WebSocketEndpoint(Extractor &&extractor, Options options);
+
+    /**
+     * @brief set the handler of messages with the key
+     *
+     * The handler returns either void or awaitable<void>. Messages without a handler are passed to the one
+     * with the empty key, if any.
+     */
+    template <typename HandlerType> inline WebSocketEndpoint &on(std::string &&key, HandlerType &&handler)
+    {
+        using Result = std::invoke_result_t<HandlerType &, WebSocketConnection &, std::string &>;
+        if constexpr (std::is_void_v<Result>) {
+            handlers_[std::move(key)]
+                = [handler = std::forward<HandlerType>(handler)](WebSocketConnection &connection,
+                                                                 std::string &message) mutable
+                -> boost::asio::awaitable<void> {
+                handler(connection, message);
+                return {};
+            };
+        } else {
+            handlers_[std::move(key)] = std::forward<HandlerType>(handler);
+        }
+        return *this;
+    }
+
+    inline WebSocketEndpoint &onOpen(Observer &&observer)
+    {
+        opened_ = std::move(observer);
+        return *this;
+    }
+
+    inline WebSocketEndpoint &onClose(Observer &&observer)
+    {
+        closed_ = std::move(observer);
+        return *this;
+    }
+
+    inline const Options &options() const { return options_; }
+
+    // Not a coroutine. Returns empty awaitable if the message was handled synchronously.
+    boost::asio::awaitable<void> dispatch(WebSocketConnection &connection, std::string &message) const;
+
+    void opened(WebSocketConnection &connection) const;
+    void closed(WebSocketConnection &connection) const;
+
+private:
+    Extractor                                extractor_;
+    Options                                  options_;
+    std::unordered_map<std::string, Handler> handlers_;
+    Observer                                 opened_;
+    Observer                                 closed_;
+};
+
+} // namespace restio
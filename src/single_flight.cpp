@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "single_flight.hpp"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <stop_token>
+
+namespace restio {
+
+namespace http = boost::beast::http;
+
+std::string SingleFlight::makeKey(std::string_view requestKey, const Request &request)
+{
+    std::string key(requestKey);
+    for (auto field : { http::field::authorization, http::field::cookie }) {
+        key += '\n';
+        auto it = request.find(field);
+        if (it != request.end()) {
+            key.append(it->value().data(), it->value().size());
+        }
+    }
+    return key;
+}
+
+std::pair<std::shared_ptr<SingleFlight::Flight>, bool> SingleFlight::join(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto [it, inserted] = flights_.try_emplace(key);
+    if (inserted) {
+        it->second = std::make_shared<Flight>();
+    }
+    return { it->second, inserted };
+}
+
+void SingleFlight::finish(const std::string &key, Flight &flight, const Response *response)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = flights_.find(key);
+        if (it != flights_.end() && it->second.get() == &flight) {
+            flights_.erase(it); // requests from now on start a new flight
+        }
+    }
+    std::vector<std::shared_ptr<boost::asio::steady_timer>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(flight.mutex_);
+        flight.done_ = true;
+        if (response && response->find(http::field::set_cookie) == response->end()) {
+            flight.header_ = response->base();
+            flight.body_   = std::make_shared<const std::string>(response->body());
+        }
+        waiters.swap(flight.waiters_);
+    }
+    for (auto &timer : waiters) {
+        boost::asio::post(timer->get_executor(), [timer]() { timer->cancel(); });
+    }
+}
+
+boost::asio::awaitable<bool>
+SingleFlight::wait(std::shared_ptr<Flight> flight, Response &response, const RequestContext &context)
+{
+    auto timer = std::make_shared<boost::asio::steady_timer>(co_await boost::asio::this_coro::executor,
+                                                             boost::asio::steady_timer::time_point::max());
+    bool waiting;
+    {
+        std::lock_guard<std::mutex> lock(flight->mutex_);
+        waiting = !flight->done_;
+        if (waiting) {
+            flight->waiters_.push_back(timer);
+        }
+    }
+    if (waiting) {
+        std::stop_callback cancel(context.stopToken, [&timer]() { timer->cancel(); });
+        if (!context.cancelled()) {
+            boost::system::error_code ec;
+            co_await timer->async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        }
+    }
+
+    std::shared_ptr<const std::string> body;
+    {
+        std::lock_guard<std::mutex> lock(flight->mutex_);
+        if (!flight->done_ || !flight->header_ || context.cancelled()) {
+            co_return false;
+        }
+        auto version    = response.version();
+        auto keep_alive = response.keep_alive();
+        response.base() = *flight->header_;
+        response.version(version);
+        response.keep_alive(keep_alive);
+        body = flight->body_;
+    }
+    response.body() = *body;
+    co_return true;
+}
+
+} // namespace restio
@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_common.hpp"
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace restio {
+
+/**
+ * @brief Coalesces concurrent identical requests.
+ *
+ * The first request with a key becomes the leader and runs the handler. Requests arriving with the same key
+ * meanwhile wait for the leader and get a copy of its response instead of running the handler.
+ * Responses setting cookies are not shared, the followers run the handler themselves then.
+ */
+class SingleFlight {
+public:
+    class Flight {
+        friend class SingleFlight;
+
+        std::mutex                                              mutex_;
+        bool                                                    done_ = false;
+        std::optional<Response::header_type>                    header_; // empty if the leader failed
+        std::shared_ptr<const std::string>                      body_;
+        std::vector<std::shared_ptr<boost::asio::steady_timer>> waiters_;
+    };
+
+    // the request key plus the credentials of the request (Authorization, Cookie), so users never share responses
+    static std::string makeKey(std::string_view requestKey, const Request &request);
+
+    // returns the flight and true if the caller is its leader
+    std::pair<std::shared_ptr<Flight>, bool> join(const std::string &key);
+
+    // publishes the leader's response to the followers. nullptr response - the leader failed.
+    // Responses with Set-Cookie are handled as failed, they belong to the leader's client only
+    void finish(const std::string &key, Flight &flight, const Response *response);
+
+    /**
+     * @brief waits for the leader of the flight and copies its response
+     *
+     * Has to be awaited on a strand or a single-threaded executor.
+     * @return false if the leader failed or the request was cancelled. The response is untouched then.
+     */
+    static boost::asio::awaitable<bool>
+    wait(std::shared_ptr<Flight> flight, Response &response, const RequestContext &context);
+
+private:
+    std::mutex                                               mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+};
+
+} // namespace restio
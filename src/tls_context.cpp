@@ -0,0 +1,111 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tls_context.hpp"
+
+#include <boost/asio/buffer.hpp>
+
+#include <openssl/ssl.h>
+
+#include <stdexcept>
+
+namespace restio {
+
+TlsContext::TlsContext(const HttpServer::TlsOptions &options) : context_(boost::asio::ssl::context::tls_server)
+{
+    namespace ssl = boost::asio::ssl;
+
+    context_.set_options(ssl::context::default_workarounds | ssl::context::no_sslv2 | ssl::context::no_sslv3
+                         | ssl::context::no_tlsv1 | ssl::context::no_tlsv1_1 | ssl::context::single_dh_use);
+
+    if (!options.certificateChainFile.empty()) {
+        context_.use_certificate_chain_file(options.certificateChainFile);
+    } else if (!options.certificateChain.empty()) {
+        context_.use_certificate_chain(boost::asio::buffer(options.certificateChain));
+    } else {
+        throw std::invalid_argument("TLS certificate is not set");
+    }
+    if (!options.privateKeyFile.empty()) {
+        context_.use_private_key_file(options.privateKeyFile, ssl::context::pem);
+    } else if (!options.privateKey.empty()) {
+        context_.use_private_key(boost::asio::buffer(options.privateKey), ssl::context::pem);
+    } else {
+        throw std::invalid_argument("TLS private key is not set");
+    }
+
+    auto handle = context_.native_handle();
+    if (!options.ciphers.empty() && SSL_CTX_set_cipher_list(handle, options.ciphers.c_str()) != 1) {
+        throw std::invalid_argument("Invalid TLS cipher list: " + options.ciphers);
+    }
+    if (!options.cipherSuites.empty() && SSL_CTX_set_ciphersuites(handle, options.cipherSuites.c_str()) != 1) {
+        throw std::invalid_argument("Invalid TLS 1.3 cipher suites: " + options.cipherSuites);
+    }
+
+    // resumption: session tickets for TLS 1.3 and stateless 1.2 clients, session cache for the others
+    if (!options.sessionTickets) {
+        SSL_CTX_set_options(handle, SSL_OP_NO_TICKET);
+    }
+    if (options.sessionCacheSize) {
+        static const unsigned char sessionIdContext[] = "restio";
+        SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(handle, long(options.sessionCacheSize));
+        SSL_CTX_set_session_id_context(handle, sessionIdContext, sizeof(sessionIdContext) - 1);
+    } else {
+        SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_OFF);
+    }
+
+    for (auto const &protocol : options.alpn) {
+        if (protocol.empty() || protocol.size() > 255) {
+            throw std::invalid_argument("Invalid ALPN protocol: " + protocol);
+        }
+        alpn_ += char(protocol.size());
+        alpn_ += protocol;
+    }
+    if (!alpn_.empty()) {
+        SSL_CTX_set_alpn_select_cb(handle, &TlsContext::selectAlpn, this);
+    }
+}
+
+int TlsContext::selectAlpn(SSL *,
+                           const unsigned char **out,
+                           unsigned char        *outlen,
+                           const unsigned char  *in,
+                           unsigned int          inlen,
+                           void                 *arg)
+{
+    auto const &alpn     = static_cast<TlsContext *>(arg)->alpn_;
+    auto        selected = const_cast<unsigned char **>(out);
+    if (SSL_select_next_proto(selected,
+                              outlen,
+                              reinterpret_cast<const unsigned char *>(alpn.data()),
+                              unsigned(alpn.size()),
+                              in,
+                              inlen)
+        != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_ALERT_FATAL; // no protocol in common
+    }
+    return SSL_TLSEXT_ERR_OK;
+}
+
+} // namespace restio
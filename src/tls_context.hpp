@@ -0,0 +1,58 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_http_server.hpp"
+
+#include <boost/asio/ssl/context.hpp>
+
+#include <string>
+
+namespace restio {
+
+/**
+ * @brief Server side OpenSSL context built from HttpServer::TlsOptions.
+ *
+ * Shared by all the TLS sessions of a server. Throws boost::system::system_error on invalid options.
+ */
+class TlsContext {
+public:
+    explicit TlsContext(const HttpServer::TlsOptions &options);
+
+    inline boost::asio::ssl::context &context() { return context_; }
+
+private:
+    static int selectAlpn(SSL                  *ssl,
+                          const unsigned char **out,
+                          unsigned char        *outlen,
+                          const unsigned char  *in,
+                          unsigned int          inlen,
+                          void                 *arg);
+
+    boost::asio::ssl::context context_;
+    std::string               alpn_; // supported protocols in the wire format
+};
+
+} // namespace restio
@@ -0,0 +1,200 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "restio_log.hpp"
+#include "restio_websocket.hpp"
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <deque>
+
+namespace restio {
+
+/**
+ * @brief WebSocket connection over the stream of an http session.
+ *
+ * Everything runs on the executor of the session which has to be a strand. The stream has to outlive run().
+ */
+template <typename Stream> class WebSocketSession : public WebSocketConnection {
+public:
+    WebSocketSession(Stream                                  &stream,
+                     std::shared_ptr<const WebSocketEndpoint> endpoint,
+                     boost::asio::any_io_executor             executor) :
+        ws_(stream),
+        endpoint_(std::move(endpoint)), executor_(executor), signal_(executor), writerDone_(executor)
+    {
+    }
+
+    void send(std::shared_ptr<const std::string> message, bool binary = false) override
+    {
+        boost::asio::post(executor_,
+                          [self = shared_from_this(), message = std::move(message), binary]() mutable {
+                              static_cast<WebSocketSession &>(*self).enqueue({ std::move(message), binary });
+                          });
+    }
+
+    void close() override
+    {
+        boost::asio::post(executor_, [self = shared_from_this()]() {
+            auto &session    = static_cast<WebSocketSession &>(*self);
+            session.closing_ = true;
+            session.signal_.cancel();
+        });
+    }
+
+    // completes the handshake and serves the connection till it's closed
+    boost::asio::awaitable<void> run(const Request &request)
+    {
+        namespace websocket = boost::beast::websocket;
+        using boost::asio::use_awaitable;
+
+        auto const &options = endpoint_->options();
+        auto        timeout = websocket::stream_base::timeout::suggested(boost::beast::role_type::server);
+        timeout.idle_timeout     = options.idleTimeout;
+        timeout.keep_alive_pings = true;
+        ws_.set_option(timeout);
+        websocket::permessage_deflate deflate;
+        deflate.server_enable = options.permessageDeflate;
+        ws_.set_option(deflate);
+        ws_.read_message_max(options.maxMessageSize);
+        ws_.auto_fragment(false); // a message is written as a single frame
+        ws_.set_option(websocket::stream_base::decorator(
+            [](websocket::response_type &response) { response.set(http::field::server, "Restio/" RESTIO_VERSION); }));
+
+        boost::system::error_code ec;
+        co_await ws_.async_accept(request, boost::asio::redirect_error(use_awaitable, ec));
+        if (ec) {
+            RESTIO_DEBUG("WebSocket handshake failed: " << ec.message());
+            co_return;
+        }
+
+        auto self = shared_from_this();
+        writing_  = true;
+        boost::asio::co_spawn(executor_, writeLoop(self), boost::asio::detached);
+        endpoint_->opened(*this);
+
+        boost::beast::flat_buffer buffer;
+        for (;;) {
+            co_await ws_.async_read(buffer, boost::asio::redirect_error(use_awaitable, ec));
+            if (ec) {
+                if (ec != websocket::error::closed) {
+                    RESTIO_DEBUG("WebSocket read failed: " << ec.message());
+                }
+                break;
+            }
+            auto message = boost::beast::buffers_to_string(buffer.data());
+            buffer.consume(buffer.size());
+            try {
+                auto pending = endpoint_->dispatch(*this, message);
+                if (pending.valid()) {
+                    co_await std::move(pending);
+                }
+            } catch (std::exception &e) {
+                RESTIO_ERROR("WebSocket message handler failed: " << e.what());
+            }
+        }
+
+        closed_ = true;
+        endpoint_->closed(*this);
+        if (writing_) { // the stream must stay till the writer is done with it
+            signal_.cancel();
+            boost::beast::get_lowest_layer(ws_.next_layer()).cancel(); // a write may wait for the gone client
+            writerDone_.expires_at(boost::asio::steady_timer::time_point::max());
+            co_await writerDone_.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+        }
+    }
+
+private:
+    struct Outgoing {
+        std::shared_ptr<const std::string> data;
+        bool                               binary;
+    };
+
+    void enqueue(Outgoing &&message)
+    {
+        if (closed_ || closing_) {
+            return;
+        }
+        if (queue_.size() >= endpoint_->options().maxQueuedMessages) {
+            RESTIO_WARN("WebSocket client doesn't keep up with messages. Closing");
+            queue_.clear();
+            closing_ = true;
+        } else {
+            queue_.push_back(std::move(message));
+        }
+        signal_.cancel();
+    }
+
+    // drains the queue one frame per write on each wake-up, then waits for more
+    boost::asio::awaitable<void> writeLoop(std::shared_ptr<WebSocketConnection> /* self */)
+    {
+        using boost::asio::use_awaitable;
+        boost::system::error_code ec;
+        while (!closed_) {
+            while (!queue_.empty() && !closed_) {
+                auto message = std::move(queue_.front());
+                queue_.pop_front();
+                ws_.binary(message.binary);
+                co_await ws_.async_write(boost::asio::buffer(*message.data),
+                                         boost::asio::redirect_error(use_awaitable, ec));
+                if (ec) {
+                    closed_ = true;
+                }
+            }
+            if (closing_ && !closed_) {
+                co_await ws_.async_close(boost::beast::websocket::close_code::normal,
+                                         boost::asio::redirect_error(use_awaitable, ec));
+                break;
+            }
+            if (!closed_) {
+                signal_.expires_at(boost::asio::steady_timer::time_point::max());
+                co_await signal_.async_wait(boost::asio::redirect_error(use_awaitable, ec));
+            }
+        }
+        writing_ = false;
+        writerDone_.cancel();
+    }
+
+    boost::beast::websocket::stream<Stream &> ws_;
+    std::shared_ptr<const WebSocketEndpoint>  endpoint_;
+    boost::asio::any_io_executor              executor_;
+    boost::asio::steady_timer                 signal_;     // wakes up the writer
+    boost::asio::steady_timer                 writerDone_; // wakes up run() when the writer exits
+    std::deque<Outgoing>                      queue_;
+    bool                                      writing_ = false;
+    bool                                      closing_ = false;
+    bool                                      closed_  = false;
+};
+
+} // namespace restio
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include "restio_access_log.hpp"
+#include "test_server.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+using namespace restio;
+using AccessLogServerTest = ServerTest;
+
+namespace {
+
+std::string logPath(const char *name)
+{
+    auto path = std::filesystem::temp_directory_path() / (std::string(name) + "." + std::to_string(::getpid()));
+    std::filesystem::remove(path);
+    return path.string();
+}
+
+AccessLogRecord makeRecord(std::uint16_t status)
+{
+    AccessLogRecord record {};
+    record.status = status;
+    return record;
+}
+
+} // namespace
+
+// the oldest records are overwritten, the rest survive reopening
+TEST(AccessLogTest, Ring)
+{
+    auto path = logPath("restio_ring.log");
+    {
+        AccessLog log(path, 4);
+        for (std::uint16_t i = 0; i < 6; i++) {
+            log.write(makeRecord(200 + i));
+        }
+    }
+    auto records = AccessLog::read(path);
+    ASSERT_EQ(records.size(), 4);
+    EXPECT_EQ(records.front().sequence, 3);
+    EXPECT_EQ(records.front().status, 202);
+    EXPECT_EQ(records.back().sequence, 6);
+
+    {
+        AccessLog log(path, 4);
+        log.write(makeRecord(300));
+    }
+    records = AccessLog::read(path);
+    ASSERT_EQ(records.size(), 4);
+    EXPECT_EQ(records.back().sequence, 7);
+    EXPECT_EQ(records.back().status, 300);
+
+    {
+        AccessLog log(path, 8); // another capacity starts over
+    }
+    EXPECT_TRUE(AccessLog::read(path).empty());
+    std::filesystem::remove(path);
+}
+
+// records being written while the log is read are either complete or skipped. the writers lap the ring
+TEST(AccessLogTest, ConcurrentRead)
+{
+    auto                     path = logPath("restio_concurrent.log");
+    AccessLog                log(path, 2);
+    std::atomic<bool>        done = false;
+    std::vector<std::thread> writers;
+    for (std::uint32_t writer = 0; writer < 4; writer++) {
+        writers.emplace_back([&, writer]() {
+            for (std::uint32_t i = writer + 1; !done; i += 4) {
+                AccessLogRecord record {};
+                record.requestBytes = record.responseBytes = record.handlerMicros = i;
+                std::memset(record.target, char(i), sizeof(record.target));
+                log.write(record);
+            }
+        });
+    }
+    auto check = [](const AccessLogRecord &record) {
+        ASSERT_EQ(record.requestBytes, record.responseBytes);
+        ASSERT_EQ(record.requestBytes, record.handlerMicros);
+        ASSERT_EQ(record.target[0], record.target[sizeof(record.target) - 1]);
+        ASSERT_EQ(record.target[0], char(record.requestBytes));
+    };
+    for (int i = 0; i < 2000; i++) {
+        for (auto const &record : AccessLog::read(path)) {
+            check(record);
+        }
+    }
+    done = true;
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    auto records = AccessLog::read(path);
+    EXPECT_EQ(records.size(), 2);
+    for (auto const &record : records) {
+        check(record);
+    }
+    std::filesystem::remove(path);
+}
+
+// the disk space is taken up front, the log doesn't run out of it while mapped
+TEST(AccessLogTest, Allocated)
+{
+    auto        path = logPath("restio_allocated.log");
+    AccessLog   log(path, 1024);
+    struct stat st;
+    ASSERT_EQ(::stat(path.c_str(), &st), 0);
+    EXPECT_GE(std::size_t(st.st_blocks) * 512, 1025 * sizeof(AccessLogRecord));
+    std::filesystem::remove(path);
+}
+
+TEST_F(AccessLogServerTest, Records)
+{
+    auto path = logPath("restio_server.log");
+    server.setAccessLog(std::make_shared<AccessLog>(path, 16));
+    server.route("hello", [](std::string_view, Request &, Response &response) { response.body() = "hi"; });
+    start();
+
+    auto socket = connect();
+    for (auto target : { "/hello/world", "/unknown" }) {
+        roundTrip(socket, makeRequest(http::verb::post, target, {}, "ping"));
+    }
+    // records are written once the responses are
+    std::vector<AccessLogRecord> records;
+    EXPECT_TRUE(eventually([&]() {
+        records = AccessLog::read(path);
+        return records.size() == 2;
+    }));
+    stop();
+
+    ASSERT_EQ(records.size(), 2);
+    auto &hello = records[0];
+    EXPECT_EQ(hello.status, 200);
+    EXPECT_EQ(hello.method, std::uint8_t(http::verb::post));
+    EXPECT_EQ(hello.version, 11);
+    EXPECT_EQ(hello.routeId, AccessLog::routeId("/hello"));
+    EXPECT_EQ(hello.requestBytes, 4);
+    EXPECT_EQ(hello.responseBytes, 2);
+    EXPECT_EQ(std::string(hello.target, std::strlen("/hello/world")), "/hello/world");
+    std::uint8_t localhost[16];
+    AccessLog::encodePeer("127.0.0.1", localhost);
+    EXPECT_EQ(std::memcmp(hello.peer, localhost, 16), 0);
+    EXPECT_EQ(records[1].status, 404);
+    EXPECT_EQ(records[1].routeId, 0);
+    std::filesystem::remove(path);
+}
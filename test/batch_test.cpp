@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include "restio_api_mapper.hpp"
+#include "restio_rest_handler.hpp"
+#include "test_server.hpp"
+
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <utility>
+
+using namespace restio;
+using namespace restio::api;
+using Dummy = API::Method::Dummy;
+
+namespace {
+
+class BatchTest : public ServerTest {
+protected:
+    void SetUp() override
+    {
+        API api(1);
+        api.get<Dummy>("hello", "", "", [](Request &, Response &response, const Properties &) {
+            RestHandler::makeOkResponse(response, std::string("hi"), "text/plain");
+        });
+        api.post<Dummy, Dummy>(
+            "echo", "", "", [](Request &request, Response &response, const Properties &) {
+                RestHandler::makeOkResponse(response, std::string(request.body()));
+                response.set("X-Token", request["X-Token"]);
+            });
+        api.get<Dummy>("sleep/<int:ms>", "", "", [](Request &, Response &response, const Properties &p) {
+            return sleep(*p.value<int>("ms"), response);
+        });
+        api.get<Dummy>("meet", "", "", [this](Request &, Response &response, const Properties &) {
+            return meet(response);
+        });
+        api.get<Dummy>("secret", "", "", [](Request &, Response &response, const Properties &) {
+            RestHandler::makeOkResponse(response, std::string("classified"), "text/plain");
+        });
+        restHandler.registerAPI(std::move(api));
+        start();
+    }
+
+    static boost::asio::awaitable<void> sleep(int ms, Response &response)
+    {
+        boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor, std::chrono::milliseconds(ms));
+        co_await timer.async_wait(boost::asio::use_awaitable);
+        RestHandler::makeOkResponse(response, nlohmann::json { { "slept", ms } });
+    }
+
+    // the first call waits for the second one. 10s is only a bound for a broken server
+    boost::asio::awaitable<void> meet(Response &response)
+    {
+        if (std::exchange(waiting, true)) {
+            gate.cancel();
+            RestHandler::makeOkResponse(response, nlohmann::json { { "met", true } });
+            co_return;
+        }
+        gate.expires_after(std::chrono::seconds(10));
+        boost::system::error_code ec;
+        co_await gate.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        auto met = ec == boost::asio::error::operation_aborted;
+        RestHandler::makeOkResponse(response, nlohmann::json { { "met", met } });
+    }
+
+    TestResponse batch(const std::string &body)
+    {
+        return send(makeRequest(http::verb::post, "/api/v1/_batch", { { "X-Token", "secret" } }, body));
+    }
+
+    RestHandler               restHandler { server };
+    boost::asio::steady_timer gate { serverContext };
+    bool                      waiting = false;
+};
+
+// forbids everything under "secret"
+struct Guard {
+    bool before(Request &request, Response &response, RequestContext &)
+    {
+        if (request.target().find("/secret") == boost::beast::string_view::npos) {
+            return true;
+        }
+        response.result(http::status::forbidden);
+        return false;
+    }
+    void after(Request &, Response &response, RequestContext &) { response.set("X-Guarded", "1"); }
+};
+
+class GuardedBatchTest : public BatchTest {
+protected:
+    void SetUp() override
+    {
+        server.use(Guard {});
+        server.setRateLimit({ { 1, 5 }, {} });
+        BatchTest::SetUp();
+    }
+};
+
+} // namespace
+
+TEST_F(BatchTest, Dispatch)
+{
+    auto response = batch(R"([{"method": "GET", "uri": "hello"},
+                              {"method": "POST", "uri": "/echo", "body": {"a": 1}},
+                              {"method": "GET", "uri": "missing"},
+                              {"method": "GET"},
+                              {"method": "POST", "uri": "_batch", "body": []}])");
+    ASSERT_EQ(response.result(), http::status::ok);
+    auto results = nlohmann::json::parse(response.body());
+    ASSERT_EQ(results.size(), 5);
+    EXPECT_EQ(results[0]["status"], 200);
+    EXPECT_EQ(results[0]["body"], "hi");
+    EXPECT_EQ(results[1]["status"], 200);
+    EXPECT_EQ(results[1]["body"], nlohmann::json({ { "a", 1 } }));
+    EXPECT_EQ(results[1]["headers"]["X-Token"], "secret"); // inherited from the batch
+    EXPECT_EQ(results[2]["status"], 404);
+    EXPECT_EQ(results[3]["status"], 400);
+    EXPECT_EQ(results[4]["status"], 400); // not nested
+
+    EXPECT_EQ(batch("{}").result(), http::status::bad_request);
+}
+
+// the calls suspending run concurrently: the first one waits for the last one
+TEST_F(BatchTest, Concurrent)
+{
+    auto response = batch(R"([{"method": "GET", "uri": "meet"},
+                              {"method": "GET", "uri": "hello"},
+                              {"method": "GET", "uri": "meet"}])");
+    auto results  = nlohmann::json::parse(response.body());
+    ASSERT_EQ(results.size(), 3);
+    EXPECT_EQ(results[0]["body"]["met"], true);
+    EXPECT_EQ(results[1]["body"], "hi");
+    EXPECT_EQ(results[2]["body"]["met"], true);
+}
+
+// the calls can't act as another client
+TEST_F(BatchTest, Credentials)
+{
+    auto response = batch(R"([{"method": "GET", "uri": "hello", "headers": {"Authorization": "Bearer admin"}},
+                              {"method": "GET", "uri": "hello", "headers": {"cookie": "session=admin"}},
+                              {"method": "GET", "uri": "hello", "headers": {"X-Custom": "1"}}])");
+    auto results  = nlohmann::json::parse(response.body());
+    ASSERT_EQ(results.size(), 3);
+    EXPECT_EQ(results[0]["status"], 400);
+    EXPECT_EQ(results[1]["status"], 400);
+    EXPECT_EQ(results[2]["status"], 200);
+}
+
+// every call passes the middleware and the rate limit of the server
+TEST_F(GuardedBatchTest, ServerChecks)
+{
+    EXPECT_EQ(get("/api/v1/secret").result(), http::status::forbidden);
+
+    auto response = batch(R"([{"method": "GET", "uri": "hello"},
+                              {"method": "GET", "uri": "secret"},
+                              {"method": "GET", "uri": "sleep/10"},
+                              {"method": "GET", "uri": "hello"}])");
+    ASSERT_EQ(response.result(), http::status::ok);
+    auto results = nlohmann::json::parse(response.body());
+    ASSERT_EQ(results.size(), 4);
+    EXPECT_EQ(results[0]["status"], 200);
+    EXPECT_EQ(results[0]["headers"]["X-Guarded"], "1");
+    EXPECT_EQ(results[1]["status"], 403);
+    EXPECT_NE(results[1]["body"], "classified");
+    EXPECT_EQ(results[2]["status"], 200);
+    EXPECT_EQ(results[2]["headers"]["X-Guarded"], "1");
+    EXPECT_EQ(results[3]["status"], 429); // the burst of 5 is used up by the requests and the calls before
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "buffer_pool.hpp"
+#include "test_server.hpp"
+
+using namespace restio;
+using BufferPoolServerTest = ServerTest;
+
+TEST(BufferPoolTest, ReuseBySize)
+{
+    auto before = BufferPool::stats();
+    auto small  = BufferPool::borrow(100);
+    auto large  = BufferPool::borrow(20000);
+    EXPECT_GE(small.capacity(), 4096);
+    EXPECT_GE(large.capacity(), 20000);
+    EXPECT_EQ(BufferPool::stats().borrowed, before.borrowed + 2);
+
+    auto smallMemory = small.prepare(1).data();
+    auto largeMemory = large.prepare(1).data();
+    BufferPool::release(small);
+    BufferPool::release(large);
+    EXPECT_EQ(small.capacity(), 0);
+    auto pooled = BufferPool::stats();
+    EXPECT_EQ(pooled.borrowed, before.borrowed);
+    EXPECT_EQ(pooled.pooled, before.pooled + 2);
+
+    // the smallest one fitting
+    auto reused = BufferPool::borrow(10000);
+    EXPECT_EQ(reused.prepare(1).data(), largeMemory);
+    auto again = BufferPool::borrow(1);
+    EXPECT_EQ(again.prepare(1).data(), smallMemory);
+
+    // too large to be cached
+    auto huge = BufferPool::borrow(1 << 20);
+    BufferPool::release(huge);
+    BufferPool::release(reused);
+    BufferPool::release(again);
+    EXPECT_EQ(BufferPool::stats().pooled, before.pooled + 2);
+}
+
+// idle keep-alive connections don't hold read buffers
+TEST_F(BufferPoolServerTest, IdleConnection)
+{
+    server.route("hello", [](std::string_view, Request &, Response &response) { response.body() = "hi"; });
+    start();
+
+    auto socket = connect();
+    for (int i = 0; i < 2; i++) {
+        auto response = roundTrip(socket, makeRequest(http::verb::get, "/hello"));
+        EXPECT_EQ(response.body(), "hi");
+        EXPECT_TRUE(response.keep_alive());
+    }
+    HttpServer::Stats stats;
+    EXPECT_TRUE(eventually([&]() {
+        stats = server.takeStats();
+        return stats.readBuffersInUse == 0;
+    }));
+    EXPECT_GE(stats.readBuffersPooled, 1);
+}
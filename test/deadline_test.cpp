@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include "restio_api_mapper.hpp"
+#include "restio_rest_handler.hpp"
+#include "test_server.hpp"
+
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <chrono>
+#include <future>
+#include <stop_token>
+
+using namespace restio;
+using namespace std::chrono_literals;
+
+namespace {
+
+class DeadlineTest : public ServerTest {
+protected:
+    void SetUp() override
+    {
+        auto sleep = [this](Request &, Response &response, const Properties &p, RequestContext &context) {
+            return onSleep(response, std::chrono::milliseconds(*p.value<int>("ms")), context);
+        };
+        api::API api(1);
+        api.get<api::API::Method::Dummy>("sleep/<int:ms>", "", "", sleep);
+        api.get<api::API::Method::Dummy>("short/<int:ms>", "", "", sleep).timeout(100ms);
+        restHandler.registerAPI(std::move(api));
+    }
+
+    // the tests don't rely on the time it sleeps, they wait for the handler. ms is how long it may take at most
+    boost::asio::awaitable<void> onSleep(Response &response, std::chrono::milliseconds ms, RequestContext &context)
+    {
+        boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor, ms);
+        std::stop_callback        cancel(context.stopToken, [&timer]() { timer.cancel(); });
+        entered.set_value();
+        boost::system::error_code ec;
+        co_await timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        finished.set_value(context.cancelled());
+        response.body() = "slept";
+    }
+
+    // sends the request and goes away once the handler is suspended
+    void sendAndClose(const std::string &target)
+    {
+        auto socket = connect();
+        http::write(socket, makeRequest(http::verb::get, target));
+        entered.get_future().wait();
+        socket.close();
+    }
+
+    std::promise<void> entered;
+    std::promise<bool> finished; // whether the handler was stopped
+    RestHandler        restHandler { server };
+};
+
+} // namespace
+
+TEST_F(DeadlineTest, ServerTimeout)
+{
+    server.setRequestTimeout(100ms);
+    start();
+
+    EXPECT_EQ(get("/api/v1/sleep/10000").result(), http::status::gateway_timeout);
+    EXPECT_TRUE(finished.get_future().get()); // stopped
+    EXPECT_EQ(server.takeStats().timeouts, 1);
+
+    entered  = {};
+    finished = {};
+    EXPECT_EQ(get("/api/v1/sleep/0").body(), "slept"); // in time
+}
+
+TEST_F(DeadlineTest, MethodTimeout)
+{
+    server.setRequestTimeout(10s);
+    start();
+
+    EXPECT_EQ(get("/api/v1/short/10000").result(), http::status::gateway_timeout);
+    EXPECT_TRUE(finished.get_future().get());
+}
+
+TEST_F(DeadlineTest, CancelOnDisconnect)
+{
+    start();
+
+    sendAndClose("/api/v1/sleep/10000");
+    EXPECT_TRUE(finished.get_future().get());
+    EXPECT_EQ(server.takeStats().disconnects, 1);
+}
+
+TEST_F(DeadlineTest, KeepOnDisconnect)
+{
+    server.setCancelOnDisconnect(false);
+    start();
+
+    sendAndClose("/api/v1/sleep/300");
+    EXPECT_FALSE(finished.get_future().get());
+    EXPECT_EQ(server.takeStats().disconnects, 0);
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include "test_server.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <future>
+#include <stop_token>
+
+using namespace restio;
+namespace beast = boost::beast;
+using tcp       = boost::asio::ip::tcp;
+
+namespace {
+
+class DrainTest : public ServerTest {
+protected:
+    void SetUp() override
+    {
+        // waits for the given number of milliseconds unless stopped or released
+        server.route("sleep", [this](std::string_view ms, Request &, Response &response, RequestContext &context) {
+            return sleep(std::stoi(std::string(ms.substr(1))), response, context);
+        });
+        server.route("quick", [](std::string_view, Request &, Response &response) { response.body() = "quick"; });
+        start();
+    }
+
+    // the tests wait for the handler, ms is only how long it may take at most
+    boost::asio::awaitable<void> sleep(int ms, Response &response, RequestContext &context)
+    {
+        release.expires_after(std::chrono::milliseconds(ms));
+        std::stop_callback cancel(context.stopToken, [this]() { release.cancel(); });
+        entered.set_value();
+        boost::system::error_code ec;
+        co_await release.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        finished.set_value(context.cancelled());
+        response.body() = "slept";
+    }
+
+    std::future<bool> drain(std::chrono::milliseconds timeout)
+    {
+        auto promise = std::make_shared<std::promise<bool>>();
+        boost::asio::co_spawn(
+            serverContext,
+            [this, promise, timeout]() -> boost::asio::awaitable<void> {
+                promise->set_value(co_await server.drain(std::chrono::steady_clock::now() + timeout));
+            },
+            boost::asio::detached);
+        return promise->get_future();
+    }
+
+    void writeRequest(tcp::socket &socket, const std::string &target)
+    {
+        http::write(socket, makeRequest(http::verb::get, target));
+    }
+
+    std::promise<void>        entered;
+    std::promise<bool>        finished; // whether the handler was stopped
+    boost::asio::steady_timer release { serverContext };
+};
+
+bool closedByServer(tcp::socket &socket)
+{
+    char                      c;
+    boost::system::error_code ec;
+    socket.read_some(boost::asio::buffer(&c, 1), ec);
+    return ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset;
+}
+
+} // namespace
+
+// the request in progress is answered with "Connection: close", the idle connection is closed at once
+TEST_F(DrainTest, InFlightAndIdle)
+{
+    auto port = server.port();
+    auto idle = connect();
+    writeRequest(idle, "/quick");
+    beast::flat_buffer                buffer;
+    http::response<http::string_body> response;
+    http::read(idle, buffer, response);
+    ASSERT_TRUE(response.keep_alive());
+
+    auto busy = connect();
+    writeRequest(busy, "/sleep/10000");
+    entered.get_future().wait();
+    auto drained = drain(std::chrono::seconds(5));
+    EXPECT_TRUE(closedByServer(idle));
+    boost::asio::post(serverContext, [this]() { release.cancel(); });
+
+    http::response<http::string_body> last;
+    buffer.clear();
+    http::read(busy, buffer, last);
+    EXPECT_EQ(last.body(), "slept");
+    EXPECT_FALSE(last.keep_alive());
+    EXPECT_TRUE(closedByServer(busy));
+    ASSERT_EQ(drained.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+    EXPECT_TRUE(drained.get());
+    EXPECT_FALSE(finished.get_future().get()); // released
+
+    tcp::socket               late(ioc);
+    boost::system::error_code ec;
+    late.connect(tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port), ec);
+    EXPECT_TRUE(ec); // not listening anymore
+}
+
+// whatever is left at the deadline is closed and stopped
+TEST_F(DrainTest, Deadline)
+{
+    auto busy = connect();
+    writeRequest(busy, "/sleep/10000");
+    entered.get_future().wait();
+    auto start   = std::chrono::steady_clock::now();
+    auto drained = drain(std::chrono::milliseconds(200));
+    ASSERT_EQ(drained.wait_for(std::chrono::seconds(2)), std::future_status::ready);
+    EXPECT_FALSE(drained.get());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(200));
+    EXPECT_TRUE(closedByServer(busy));
+    auto stopped = finished.get_future();
+    ASSERT_EQ(stopped.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_TRUE(stopped.get());
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include "event_subscriber.hpp"
+#include "restio_event_hub.hpp"
+#include "test_server.hpp"
+
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+
+using namespace restio;
+using EventHubServerTest = ServerTest;
+
+TEST(EventHubTest, Serialize)
+{
+    EXPECT_EQ(EventHub::serialize("a\nb", "update", "7"), "id: 7\nevent: update\ndata: a\ndata: b\n\n");
+    EXPECT_EQ(EventHub::serialize("", {}, {}), "data: \n\n");
+    EXPECT_EQ(EventHub::serialize("a\r\nb\rc\n\nd", {}, {}), "data: a\ndata: b\ndata: c\ndata: \ndata: d\n\n");
+    EXPECT_EQ(EventHub::serialize("x", "update\r\ndata: forged", "1\n\nid: 2"),
+              "id: 1id: 2\nevent: updatedata: forged\ndata: x\n\n");
+}
+
+TEST(EventHubTest, SlowSubscriberEvicted)
+{
+    boost::asio::io_context ioc;
+    auto                    subscriber = std::make_shared<EventSubscriber>(ioc.get_executor(), 2);
+    auto                    event      = std::make_shared<const std::string>("data: x\n\n");
+    EXPECT_TRUE(subscriber->push(event));
+    EXPECT_TRUE(subscriber->push(event));
+    EXPECT_EQ(subscriber->take().size(), 2);
+    EXPECT_TRUE(subscriber->push(event));
+    EXPECT_TRUE(subscriber->push(event));
+    EXPECT_TRUE(subscriber->push(event)); // over the limit
+    EXPECT_TRUE(subscriber->evicted());
+    EXPECT_FALSE(subscriber->push(event));
+    EXPECT_TRUE(subscriber->take().empty());
+}
+
+TEST_F(EventHubServerTest, StreamWithHistory)
+{
+    EventHub::Options options;
+    options.historySize = 2;
+    auto hub            = std::make_shared<EventHub>(options);
+    server.events("events", hub);
+    hub->publish("one", {}, "1");
+    hub->publish("two", {}, "2");
+    hub->publish("three", {}, "3");
+    start();
+
+    auto        socket  = connect();
+    std::string request = "GET /events HTTP/1.1\r\nHost: localhost\r\nLast-Event-ID: 2\r\n\r\n";
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    std::string received;
+    boost::asio::read_until(socket, boost::asio::dynamic_buffer(received), "data: three\n\n");
+    EXPECT_NE(received.find("Content-Type: text/event-stream"), std::string::npos);
+    EXPECT_EQ(received.find("data: two"), std::string::npos);
+
+    while (hub->subscribers() == 0) {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(hub->publish("four"), 1);
+    received.clear();
+    boost::asio::read_until(socket, boost::asio::dynamic_buffer(received), "data: four\n\n");
+
+    socket.close();
+    while (hub->subscribers() != 0) {
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include "restio_function.hpp"
+
+#include <array>
+#include <memory>
+
+using namespace restio;
+
+TEST(FunctionTest, EmptyFunction)
+{
+    Function<int(int)> f;
+    EXPECT_FALSE(bool(f));
+    EXPECT_THROW(f(1), std::bad_function_call);
+
+    Function<int(int)> g = nullptr;
+    EXPECT_FALSE(bool(g));
+}
+
+TEST(FunctionTest, InlineCallable)
+{
+    int                base = 10;
+    Function<int(int)> f    = [&base](int v) { return base + v; };
+    EXPECT_TRUE(bool(f));
+    EXPECT_EQ(f(5), 15);
+
+    auto g = std::move(f);
+    EXPECT_FALSE(bool(f));
+    EXPECT_EQ(g(1), 11);
+}
+
+TEST(FunctionTest, HeapCallable)
+{
+    std::array<std::uint64_t, 16> big {};
+    big[15] = 7;
+
+    Function<int(int)> f = [big](int v) { return int(big[15]) + v; };
+    EXPECT_EQ(f(1), 8);
+
+    Function<int(int)> g;
+    g = std::move(f);
+    EXPECT_FALSE(bool(f));
+    EXPECT_EQ(g(2), 9);
+}
+
+TEST(FunctionTest, MoveOnlyCapture)
+{
+    auto value = std::make_unique<int>(42);
+    auto alive = std::weak_ptr<int>();
+    {
+        auto            shared = std::make_shared<int>(1);
+        Function<int()> f      = [value = std::move(value), shared]() { return *value + *shared; };
+        alive                  = shared;
+        shared.reset();
+        EXPECT_EQ(f(), 43);
+        EXPECT_FALSE(alive.expired());
+        f = nullptr;
+        EXPECT_TRUE(alive.expired());
+    }
+}
+
+TEST(FunctionTest, FunctionPointer)
+{
+    int (*fptr)(int)     = [](int v) { return v * 2; };
+    Function<int(int)> f = fptr;
+    EXPECT_EQ(f(4), 8);
+
+    int (*null_fptr)(int) = nullptr;
+    Function<int(int)> g  = null_fptr;
+    EXPECT_FALSE(bool(g));
+}
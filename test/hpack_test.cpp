@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include "hpack.hpp"
+
+using namespace restio;
+using Result = HpackDecoder::Result;
+
+namespace {
+
+std::string fromHex(std::string_view hex)
+{
+    std::string out;
+    for (std::size_t i = 0; i + 1 < hex.size(); i += 2) {
+        out += char(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16));
+    }
+    return out;
+}
+
+} // namespace
+
+// RFC 7541 C.4: requests with Huffman coding sharing the dynamic table
+TEST(HpackTest, DecodeRequests)
+{
+    HpackDecoder             decoder;
+    std::vector<HeaderField> fields;
+
+    ASSERT_EQ(Result::Ok, decoder.decode(fromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), fields, 4096));
+    std::vector<HeaderField> expected { { ":method", "GET" },
+                                        { ":scheme", "http" },
+                                        { ":path", "/" },
+                                        { ":authority", "www.example.com" } };
+    EXPECT_EQ(fields, expected);
+
+    ASSERT_EQ(Result::Ok, decoder.decode(fromHex("828684be5886a8eb10649cbf"), fields, 4096));
+    expected.emplace_back("cache-control", "no-cache");
+    EXPECT_EQ(fields, expected);
+
+    ASSERT_EQ(Result::Ok, decoder.decode(fromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"), fields, 4096));
+    expected = { { ":method", "GET" },
+                 { ":scheme", "https" },
+                 { ":path", "/index.html" },
+                 { ":authority", "www.example.com" },
+                 { "custom-key", "custom-value" } };
+    EXPECT_EQ(fields, expected);
+
+    auto block = fromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf");
+    EXPECT_EQ(Result::TooLarge, decoder.decode(block, fields, 100));
+    EXPECT_TRUE(fields.empty());
+    EXPECT_EQ(Result::Malformed, decoder.decode(fromHex("ff"), fields, 4096)); // truncated index
+    EXPECT_EQ(Result::Malformed, decoder.decode(fromHex("c5"), fields, 4096)); // not in the table
+}
+
+TEST(HpackTest, Huffman)
+{
+    std::string out;
+    EXPECT_TRUE(huffmanDecode(fromHex("f1e3c2e5f23a6ba0ab90f4ff"), out));
+    EXPECT_EQ(out, "www.example.com");
+    out.clear();
+    EXPECT_FALSE(huffmanDecode(fromHex("f1e3c2e5f23a6ba0ab90f4fe"), out)); // padding is not EOS prefix
+    out.clear();
+    EXPECT_FALSE(huffmanDecode(fromHex("ffffffff"), out)); // EOS
+}
+
+TEST(HpackTest, EncodeResponse)
+{
+    std::string block;
+    HpackEncoder::encodeStatus(200, block);
+    HpackEncoder::encodeStatus(418, block);
+    HpackEncoder::encode("content-type", "application/json", block);
+    HpackEncoder::encode("x-custom", std::string(200, 'x'), block);
+
+    HpackDecoder             decoder;
+    std::vector<HeaderField> fields;
+    ASSERT_EQ(Result::Ok, decoder.decode(block, fields, 4096));
+    std::vector<HeaderField> expected { { ":status", "200" },
+                                        { ":status", "418" },
+                                        { "content-type", "application/json" },
+                                        { "x-custom", std::string(200, 'x') } };
+    EXPECT_EQ(fields, expected);
+}
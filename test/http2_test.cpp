@@ -0,0 +1,388 @@
+#include <gtest/gtest.h>
+
+#include "hpack.hpp"
+#include "test_server.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+
+#include <chrono>
+#include <future>
+#include <map>
+#include <stop_token>
+
+using namespace restio;
+using namespace std::chrono_literals;
+using tcp       = boost::asio::ip::tcp;
+using Http2Test = ServerTest;
+
+namespace {
+
+std::string frame(std::uint8_t type, std::uint8_t flags, std::uint32_t streamId, std::string_view payload)
+{
+    auto        length = payload.size();
+    std::string out { char(length >> 16), char(length >> 8), char(length), char(type), char(flags) };
+    out += { char(streamId >> 24), char(streamId >> 16), char(streamId >> 8), char(streamId) };
+    out += payload;
+    return out;
+}
+
+std::string uint32(std::uint32_t value)
+{
+    return { char(value >> 24), char(value >> 16), char(value >> 8), char(value) };
+}
+
+std::string headers(std::uint32_t   streamId,
+                    std::string_view path,
+                    const TestHeaders &fields    = {},
+                    bool               endStream = true)
+{
+    std::string block;
+    HpackEncoder::encode(":method", endStream ? "GET" : "POST", block);
+    HpackEncoder::encode(":scheme", "http", block);
+    HpackEncoder::encode(":path", path, block);
+    HpackEncoder::encode(":authority", "localhost", block);
+    for (auto const &[name, value] : fields) {
+        HpackEncoder::encode(name, value, block);
+    }
+    return frame(0x1, (endStream ? 0x1 : 0) | 0x4, streamId, block); // END_STREAM | END_HEADERS
+}
+
+std::uint32_t readUint32(std::string_view data)
+{
+    return std::uint32_t(std::uint8_t(data[0])) << 24 | std::uint8_t(data[1]) << 16 | std::uint8_t(data[2]) << 8
+         | std::uint8_t(data[3]);
+}
+
+const std::string preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+struct Frame {
+    std::uint8_t  type;
+    std::uint8_t  flags;
+    std::uint32_t streamId;
+    std::string   payload;
+
+    // of RST_STREAM and GOAWAY
+    std::uint32_t errorCode() const { return readUint32(std::string_view(payload).substr(type == 0x7 ? 4 : 0)); }
+};
+
+Frame readFrame(tcp::socket &socket)
+{
+    unsigned char header[9];
+    boost::asio::read(socket, boost::asio::buffer(header));
+    Frame frame { header[3],
+                  header[4],
+                  std::uint32_t(header[5] << 24 | header[6] << 16 | header[7] << 8 | header[8]) & 0x7fffffff,
+                  std::string((header[0] << 16) | (header[1] << 8) | header[2], '\0') };
+    boost::asio::read(socket, boost::asio::buffer(frame.payload));
+    return frame;
+}
+
+// skips the frames before the one of the type
+Frame readFrame(tcp::socket &socket, std::uint8_t type)
+{
+    for (;;) {
+        auto frame = readFrame(socket);
+        if (frame.type == type) {
+            return frame;
+        }
+    }
+}
+
+// "wait" answers after 300ms unless stopped, "hold" once released. the first stream signals when it waits and when
+// it's done
+class Http2StreamTest : public ServerTest {
+protected:
+    void SetUp() override
+    {
+        server.route("wait", [this](std::string_view, Request &, Response &response, RequestContext &context) {
+            return wait(response, context);
+        });
+        server.route("hold", [this](std::string_view, Request &, Response &, RequestContext &context) {
+            return hold(context);
+        });
+    }
+
+    boost::asio::awaitable<void> wait(Response &response, RequestContext &context)
+    {
+        bool                      first = waiting++ == 0;
+        boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor, 300ms);
+        std::stop_callback        cancel(context.stopToken, [&timer]() { timer.cancel(); });
+        if (first) {
+            entered.set_value();
+        }
+        boost::system::error_code ec;
+        co_await timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        if (first) {
+            finished.set_value(context.cancelled());
+        }
+        response.body() = "waited";
+    }
+
+    // ignores the stop
+    boost::asio::awaitable<void> hold(RequestContext &context)
+    {
+        bool first = waiting++ == 0;
+        if (first) {
+            entered.set_value();
+        }
+        boost::system::error_code ec;
+        co_await release.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        if (first) {
+            finished.set_value(context.cancelled());
+        }
+    }
+
+    // the connection with the settings acknowledged
+    tcp::socket open(const std::string &frames = {})
+    {
+        auto socket = connect();
+        auto settings = frame(0x4, 0, 0, {}) + frame(0x4, 0x1, 0, {}); // and the ack of the server's ones
+        boost::asio::write(socket, boost::asio::buffer(preface + settings + frames));
+        return socket;
+    }
+
+    int                       waiting = 0; // the handlers run on the server thread
+    std::promise<void>        entered;
+    std::promise<bool>        finished; // whether it was stopped
+    boost::asio::steady_timer release { serverContext, boost::asio::steady_timer::time_point::max() };
+};
+
+} // namespace
+
+// two streams over one connection: the quick one isn't blocked by the slow one, flow control is respected
+TEST_F(Http2Test, Multiplexing)
+{
+    server.route("slow", [](std::string_view, Request &, Response &response) -> boost::asio::awaitable<void> {
+        boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor, std::chrono::milliseconds(200));
+        co_await timer.async_wait(boost::asio::use_awaitable);
+        response.body() = "slow";
+    });
+    server.route("big", [](std::string_view, Request &, Response &response) {
+        response.set(http::field::content_type, "text/plain");
+        response.body() = std::string(200000, 'x');
+    });
+    start();
+
+    auto        socket        = connect();
+    std::string initialWindow = std::string { 0, 4 } + uint32(1000); // tiny window of streams
+    boost::asio::write(socket,
+                       boost::asio::buffer("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + frame(0x4, 0, 0, initialWindow)
+                                           + headers(1, "/slow") + headers(3, "/big")));
+
+    HpackDecoder               decoder;
+    std::map<int, std::string> bodies;
+    std::map<int, std::string> statuses;
+    std::vector<int>           finished;
+    std::vector<HeaderField>   fields;
+    bool                       settingsAcked = false;
+    while (finished.size() < 2) {
+        unsigned char header[9];
+        boost::asio::read(socket, boost::asio::buffer(header));
+        std::string payload((header[0] << 16) | (header[1] << 8) | header[2], '\0');
+        boost::asio::read(socket, boost::asio::buffer(payload));
+        auto type     = header[3];
+        auto flags    = header[4];
+        int  streamId = (header[5] << 24 | header[6] << 16 | header[7] << 8 | header[8]) & 0x7fffffff;
+        ASSERT_LE(payload.size(), 16384);
+        if (type == 0x4 && flags & 0x1) {
+            settingsAcked = true;
+        } else if (type == 0x1) {
+            ASSERT_EQ(decoder.decode(payload, fields, 4096), HpackDecoder::Result::Ok);
+            statuses[streamId] = fields.at(0).second;
+        } else if (type == 0x0) {
+            ASSERT_TRUE(settingsAcked);
+            ASSERT_LE(payload.size(), 1000);
+            bodies[streamId] += payload;
+            if (!payload.empty()) {
+                boost::asio::write(socket,
+                                   boost::asio::buffer(frame(0x8, 0, streamId, uint32(payload.size()))
+                                                       + frame(0x8, 0, 0, uint32(payload.size()))));
+            }
+        } else {
+            ASSERT_NE(type, 0x7) << "GOAWAY";
+            ASSERT_NE(type, 0x3) << "RST_STREAM";
+        }
+        if ((type == 0x0 || type == 0x1) && flags & 0x1) {
+            finished.push_back(streamId);
+        }
+    }
+    EXPECT_EQ(finished, std::vector<int>({ 3, 1 }));
+    EXPECT_EQ(statuses[1], "200");
+    EXPECT_EQ(statuses[3], "200");
+    EXPECT_EQ(bodies[1], "slow");
+    EXPECT_EQ(bodies[3], std::string(200000, 'x'));
+}
+
+// the values the peers would reject in SETTINGS
+TEST_F(Http2StreamTest, InvalidOptions)
+{
+    HttpServer::Http2Options options;
+    options.maxFrameSize = 1024;
+    EXPECT_THROW(server.setHttp2Options(options), std::invalid_argument);
+    options.maxFrameSize = 1 << 24;
+    EXPECT_THROW(server.setHttp2Options(options), std::invalid_argument);
+    options.maxFrameSize      = 1 << 20;
+    options.initialWindowSize = 1u << 31;
+    EXPECT_THROW(server.setHttp2Options(options), std::invalid_argument);
+    options.initialWindowSize = (1u << 31) - 1;
+    EXPECT_NO_THROW(server.setHttp2Options(options));
+}
+
+TEST_F(Http2StreamTest, ResetStopsHandler)
+{
+    start();
+    auto socket = open(headers(1, "/wait"));
+    entered.get_future().wait();
+    boost::asio::write(socket, boost::asio::buffer(frame(0x3, 0, 1, uint32(0x8)))); // CANCEL
+    auto stopped = finished.get_future();
+    ASSERT_EQ(stopped.wait_for(5s), std::future_status::ready);
+    EXPECT_TRUE(stopped.get());
+}
+
+TEST_F(Http2StreamTest, RefusedBeyondConcurrency)
+{
+    HttpServer::Http2Options options;
+    options.maxConcurrentStreams = 1;
+    server.setHttp2Options(options);
+    start();
+
+    auto socket = open(headers(1, "/wait") + headers(3, "/wait"));
+    auto reset  = readFrame(socket, 0x3);
+    EXPECT_EQ(reset.streamId, 3);
+    EXPECT_EQ(reset.errorCode(), 0x7); // REFUSED_STREAM
+    auto response = readFrame(socket, 0x1);
+    EXPECT_EQ(response.streamId, 1);
+}
+
+TEST_F(Http2StreamTest, GoAwayOnDrain)
+{
+    start();
+    auto socket = open(headers(1, "/hold"));
+    entered.get_future().wait();
+    boost::asio::co_spawn(
+        serverContext,
+        [this]() -> boost::asio::awaitable<void> { co_await server.drain(std::chrono::steady_clock::now() + 5s); },
+        boost::asio::detached);
+
+    auto goAway = readFrame(socket, 0x7);
+    EXPECT_EQ(readUint32(goAway.payload), 1); // the last stream
+    EXPECT_EQ(goAway.errorCode(), 0);         // NO_ERROR
+    boost::asio::write(socket, boost::asio::buffer(headers(3, "/wait")));
+
+    // the new stream is refused, the open one is answered once released
+    auto reset = readFrame(socket, 0x3);
+    EXPECT_EQ(reset.streamId, 3);
+    EXPECT_EQ(reset.errorCode(), 0x7); // REFUSED_STREAM
+    boost::asio::post(serverContext, [this]() { release.cancel(); });
+    EXPECT_EQ(readFrame(socket, 0x1).streamId, 1);
+    EXPECT_FALSE(finished.get_future().get());
+}
+
+TEST_F(Http2StreamTest, ConnectionSpecificHeaders)
+{
+    start();
+    auto socket = open(headers(1, "/wait", { { "connection", "keep-alive" } })
+                       + headers(3, "/wait", { { "te", "gzip" } }) + headers(5, "/wait", { { "te", "trailers" } }));
+    std::map<std::uint32_t, std::uint32_t> resets;
+    while (resets.size() < 2) {
+        auto frame = readFrame(socket);
+        ASSERT_NE(frame.type, 0x1) << "stream " << frame.streamId << " answered";
+        if (frame.type == 0x3) {
+            resets[frame.streamId] = frame.errorCode();
+        }
+    }
+    EXPECT_EQ(resets[1], 0x1); // PROTOCOL_ERROR
+    EXPECT_EQ(resets[3], 0x1);
+    EXPECT_EQ(readFrame(socket, 0x1).streamId, 5);
+}
+
+TEST_F(Http2StreamTest, StreamWindow)
+{
+    HttpServer::Http2Options options;
+    options.initialWindowSize = 10000; // the connection window stays 65535
+    server.setHttp2Options(options);
+    start();
+
+    auto socket = open(headers(1, "/wait", {}, false) + frame(0x0, 0x1, 1, std::string(12000, 'x')));
+    auto reset  = readFrame(socket, 0x3);
+    EXPECT_EQ(reset.streamId, 1);
+    EXPECT_EQ(reset.errorCode(), 0x3); // FLOW_CONTROL_ERROR
+}
+
+TEST_F(Http2StreamTest, InitialWindowOverflow)
+{
+    start();
+    auto socket = open(headers(1, "/wait"));
+    auto        largest       = frame(0x8, 0, 1, uint32(0x7fffffff - 65535)); // the window of the open stream
+    std::string initialWindow = std::string { 0, 4 } + uint32(65536);             // one more than the default
+    boost::asio::write(socket, boost::asio::buffer(largest + frame(0x4, 0, 0, initialWindow)));
+    auto goAway = readFrame(socket, 0x7);
+    EXPECT_EQ(goAway.errorCode(), 0x3); // FLOW_CONTROL_ERROR
+}
+
+// the body and the trailers of a request answered early are ignored, the connection goes on
+TEST_F(Http2StreamTest, TrailersAfterResponse)
+{
+    HttpServer::Http2Options options;
+    options.maxHeaderListSize = 1000;
+    server.setHttp2Options(options);
+    start();
+
+    TestHeaders fields(100, { "x", "y" }); // too large with 32 bytes of overhead each
+    auto        socket = open(headers(1, "/wait", fields, false));
+    auto        answer = readFrame(socket, 0x1);
+    EXPECT_EQ(answer.streamId, 1);
+    EXPECT_EQ(answer.flags & 0x1, 0x1); // the response is complete before the request
+
+    std::string block;
+    HpackEncoder::encode("x-checksum", "1", block);
+    auto trailers = frame(0x1, 0x5, 1, block); // END_STREAM | END_HEADERS
+    boost::asio::write(socket, boost::asio::buffer(frame(0x0, 0, 1, "body") + trailers + headers(3, "/wait")));
+    for (;;) {
+        auto next = readFrame(socket);
+        ASSERT_NE(next.type, 0x7) << "GOAWAY " << next.errorCode();
+        if (next.type == 0x1) {
+            EXPECT_EQ(next.streamId, 3);
+            break;
+        }
+    }
+}
+
+// the handlers of reset streams still run till they notice it, new streams are refused meanwhile
+TEST_F(Http2StreamTest, RapidReset)
+{
+    HttpServer::Http2Options options;
+    options.maxConcurrentStreams = 2;
+    server.setHttp2Options(options);
+    start();
+
+    auto cancel = [](std::uint32_t streamId) { return frame(0x3, 0, streamId, uint32(0x8)); };
+    auto socket = open(headers(1, "/hold") + cancel(1) + headers(3, "/hold") + cancel(3) + headers(5, "/hold"));
+    auto reset  = readFrame(socket, 0x3);
+    EXPECT_EQ(reset.streamId, 5);
+    EXPECT_EQ(reset.errorCode(), 0x7); // REFUSED_STREAM
+}
+
+TEST_F(Http2StreamTest, TooManyResets)
+{
+    HttpServer::Http2Options options;
+    options.maxResetsPerSecond = 5;
+    server.setHttp2Options(options);
+    start();
+
+    std::string frames;
+    for (std::uint32_t streamId = 1; streamId < 20; streamId += 2) {
+        frames += headers(streamId, "/wait") + frame(0x3, 0, streamId, uint32(0x8));
+    }
+    auto socket = open(frames);
+    auto goAway = readFrame(socket, 0x7);
+    EXPECT_EQ(goAway.errorCode(), 0xb); // ENHANCE_YOUR_CALM
+}
@@ -9,10 +9,10 @@ static int calledId = -1;
 
 RequestHandler makeCallback(int id)
 {
-    return [id](std::string_view, Request &, Response &) -> boost::asio::awaitable<void> {
+    return makeRequestHandler([id](std::string_view, Request &, Response &) -> boost::asio::awaitable<void> {
         calledId = id;
         return {};
-    };
+    });
 }
 
 http::request<http::string_body> makeRequest(std::string &&path, http::verb verb)
@@ -35,8 +35,9 @@ TEST(HandlerStoreTest, RegisterAndLookupOne)
     EXPECT_TRUE(bool(result));
     auto const &[path, handler] = *result;
     EXPECT_EQ(path, std::string_view("/ggg?hello"));
-    Response response;
-    std::ignore = handler(path, request, response);
+    Response       response;
+    RequestContext context;
+    std::ignore = handler(path, request, response, context);
     EXPECT_EQ(calledId, 1);
 }
 
@@ -56,8 +57,9 @@ TEST(HandlerStoreTest, ConflictingRoutes)
         EXPECT_TRUE(bool(result));
         auto const &[path, handler] = *result;
         EXPECT_EQ(path, std::string_view("/ggg?hello"));
-        Response response;
-        std::ignore = handler(path, get_request, response);
+        Response       response;
+        RequestContext context;
+        std::ignore = handler(path, get_request, response, context);
         EXPECT_EQ(calledId, 4);
     }
     {
@@ -66,8 +68,9 @@ TEST(HandlerStoreTest, ConflictingRoutes)
         EXPECT_TRUE(bool(result));
         auto const &[path, handler] = *result;
         EXPECT_EQ(path, std::string_view("/ggg?hello"));
-        Response response;
-        std::ignore = handler(path, post_request, response);
+        Response       response;
+        RequestContext context;
+        std::ignore = handler(path, post_request, response, context);
         EXPECT_EQ(calledId, 3);
     }
     {
@@ -76,8 +79,9 @@ TEST(HandlerStoreTest, ConflictingRoutes)
         EXPECT_TRUE(bool(result));
         auto const &[path, handler] = *result;
         EXPECT_EQ(path, std::string_view("/aggg?hello"));
-        Response response;
-        std::ignore = handler(path, get_request, response);
+        Response       response;
+        RequestContext context;
+        std::ignore = handler(path, get_request, response, context);
         EXPECT_EQ(calledId, 4);
     }
     {
@@ -86,8 +90,9 @@ TEST(HandlerStoreTest, ConflictingRoutes)
         EXPECT_TRUE(bool(result));
         auto const &[path, handler] = *result;
         EXPECT_EQ(path, std::string_view("/ggg?hello"));
-        Response response;
-        std::ignore = handler(path, get_request, response);
+        Response       response;
+        RequestContext context;
+        std::ignore = handler(path, get_request, response, context);
         EXPECT_EQ(calledId, 5);
     }
 }
@@ -104,8 +109,9 @@ TEST(HandlerStoreTest, RouteRemoval)
         EXPECT_TRUE(bool(result));
         auto const &[path, handler] = *result;
         EXPECT_EQ(path, std::string_view("/ggg?hello"));
-        Response response;
-        std::ignore = handler(path, get_request, response);
+        Response       response;
+        RequestContext context;
+        std::ignore = handler(path, get_request, response, context);
         EXPECT_EQ(calledId, 2);
     }
     store.remove(http::verb::get, "test/a/b/c");
@@ -115,8 +121,9 @@ TEST(HandlerStoreTest, RouteRemoval)
         EXPECT_TRUE(bool(result));
         auto const &[path, handler] = *result;
         EXPECT_EQ(path, std::string_view("/ggg?hello"));
-        Response response;
-        std::ignore = handler(path, get_request, response);
+        Response       response;
+        RequestContext context;
+        std::ignore = handler(path, get_request, response, context);
         EXPECT_EQ(calledId, 1);
     }
     store.remove("test/a/b/c");
@@ -126,3 +133,45 @@ TEST(HandlerStoreTest, RouteRemoval)
         EXPECT_FALSE(bool(result));
     }
 }
+
+TEST(HandlerStoreTest, SnapshotSurvivesModification)
+{
+    HttpHandlerStore store;
+
+    store.add("test/a", makeCallback(1));
+    auto snapshot = store.snapshot();
+    store.add("test/b", makeCallback(2));
+    store.remove("test/a");
+
+    auto get_request = makeRequest("/test/a/ggg", http::verb::get);
+    EXPECT_FALSE(bool(store.lookup(get_request)));
+    auto result = snapshot->lookup(get_request);
+    EXPECT_TRUE(bool(result));
+    auto const &[path, handler] = *result;
+    EXPECT_EQ(path, std::string_view("/ggg"));
+    Response       response;
+    RequestContext context;
+    std::ignore = handler(path, get_request, response, context);
+    EXPECT_EQ(calledId, 1);
+
+    EXPECT_FALSE(bool(snapshot->lookup(makeRequest("/test/b", http::verb::get))));
+    EXPECT_TRUE(bool(store.lookup(makeRequest("/test/b", http::verb::get))));
+}
+
+TEST(HandlerStoreTest, SynchronousHandler)
+{
+    HttpHandlerStore store;
+
+    store.add("sync", makeRequestHandler([](std::string_view, Request &, Response &response) {
+                  response.result(http::status::accepted);
+              }));
+    auto request = makeRequest("/sync", http::verb::get);
+    auto result  = store.lookup(request);
+    EXPECT_TRUE(bool(result));
+    auto const &[path, handler] = *result;
+    Response       response;
+    RequestContext context;
+    auto           pending = handler(path, request, response, context);
+    EXPECT_FALSE(pending.valid());
+    EXPECT_EQ(response.result(), http::status::accepted);
+}
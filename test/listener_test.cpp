@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include "test_server.hpp"
+
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace restio;
+using tcp   = boost::asio::ip::tcp;
+using local = boost::asio::local::stream_protocol;
+
+namespace {
+
+class ListenerTest : public ServerTest {
+protected:
+    ListenerTest() : ServerTest("") { } // the listeners are up to the tests
+
+    void SetUp() override
+    {
+        server.route("hello", [](std::string_view, Request &, Response &response) { response.body() = "hi"; });
+    }
+
+    template <typename Socket> static std::string get(Socket &socket)
+    {
+        return roundTrip(socket, makeRequest(http::verb::get, "/hello")).body();
+    }
+};
+
+} // namespace
+
+TEST_F(ListenerTest, UnixSocket)
+{
+    auto path     = "/tmp/restio_listener_test_" + std::to_string(::getpid()) + ".sock";
+    auto abstract = "restio_listener_test_" + std::to_string(::getpid());
+    server.listenUnix(path);
+    server.listenUnix("@" + abstract);
+    EXPECT_EQ(server.port(), 0);
+    start();
+
+    local::socket socket(ioc);
+    socket.connect(local::endpoint(path));
+    EXPECT_EQ(get(socket), "hi");
+
+    local::socket abstractSocket(ioc);
+    abstractSocket.connect(local::endpoint(std::string(1, '\0') + abstract));
+    EXPECT_EQ(get(abstractSocket), "hi");
+    ::unlink(path.c_str());
+}
+
+// a socket file left behind is replaced, a listening one isn't
+TEST_F(ListenerTest, UnixSocketInUse)
+{
+    auto stale = "/tmp/restio_listener_test_" + std::to_string(::getpid()) + ".stale.sock";
+    auto live  = "/tmp/restio_listener_test_" + std::to_string(::getpid()) + ".live.sock";
+    local::acceptor(ioc, local::endpoint(stale)).close(); // the file stays
+    local::acceptor other(ioc, local::endpoint(live));
+    EXPECT_THROW(server.listenUnix(live), std::runtime_error);
+    server.listenUnix(stale);
+    start();
+
+    local::socket socket(ioc);
+    socket.connect(local::endpoint(stale));
+    EXPECT_EQ(get(socket), "hi");
+    local::socket otherSocket(ioc);
+    EXPECT_NO_THROW(otherSocket.connect(local::endpoint(live))); // still the other one's
+    ::unlink(stale.c_str());
+    ::unlink(live.c_str());
+}
+
+TEST_F(ListenerTest, AdoptListener)
+{
+    tcp::acceptor acceptor(ioc, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    auto          port = acceptor.local_endpoint().port();
+    server.adoptListener(acceptor.release());
+    EXPECT_EQ(server.port(), port);
+    EXPECT_THROW(server.adoptListener(STDIN_FILENO), std::invalid_argument);
+    start();
+
+    auto socket = connect();
+    EXPECT_EQ(get(socket), "hi");
+}
+
+TEST_F(ListenerTest, SocketOptions)
+{
+    tcp::acceptor acceptor(ioc, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    int           fd = ::dup(acceptor.native_handle()); // the same socket. to look at its options
+    server.adoptListener(acceptor.release());
+    HttpServer::SocketOptions options;
+    options.deferAccept   = 5;
+    options.receiveBuffer = 64 * 1024;
+    options.backlog       = 16;
+    server.setSocketOptions(options);
+    start();
+
+    int       value  = 0;
+    socklen_t length = sizeof(value);
+    ASSERT_EQ(::getsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &value, &length), 0);
+    EXPECT_GT(value, 0); // rounded to retransmits
+    ASSERT_EQ(::getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &value, &length), 0);
+    EXPECT_GE(value, 64 * 1024); // doubled by Linux
+    ::close(fd);
+
+    auto socket = connect();
+    EXPECT_EQ(get(socket), "hi");
+}
+
+TEST_F(ListenerTest, DualStack)
+{
+    try {
+        server.listen("::", 0);
+    } catch (std::runtime_error &e) {
+        GTEST_SKIP() << "no IPv6: " << e.what();
+    }
+    start();
+
+    for (auto address : { "::1", "127.0.0.1" }) {
+        tcp::socket socket(ioc);
+        socket.connect(tcp::endpoint(boost::asio::ip::make_address(address), server.port()));
+        EXPECT_EQ(get(socket), "hi") << address;
+    }
+}
+
+// the successor gets the listeners at 3, 4... and nothing else
+TEST_F(ListenerTest, SpawnSuccessor)
+{
+    auto path = "/tmp/restio_listener_test_" + std::to_string(::getpid()) + ".successor.sock";
+    auto out  = "/tmp/restio_listener_test_" + std::to_string(::getpid()) + ".successor.txt";
+    server.listen("127.0.0.1", 0);
+    server.listenUnix(path);
+    start();
+    auto connection = connect(); // accepted by the server
+    EXPECT_EQ(get(connection), "hi");
+    int leaked = ::socket(AF_INET, SOCK_STREAM, 0); // without FD_CLOEXEC
+
+    auto script = "for f in /proc/$$/fd/*; do case $(readlink $f) in socket:*) echo ${f##*/};; esac; done > " + out
+        + "; echo fds $LISTEN_FDS >> " + out;
+    auto pid    = server.spawnSuccessor({ "/bin/sh", "-c", script });
+    int  status = 0;
+    ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    ::close(leaked);
+
+    std::ifstream    file(out);
+    std::vector<int> sockets;
+    std::string      word;
+    std::string      listenFds;
+    while (file >> word) {
+        if (word == "fds") {
+            file >> listenFds;
+        } else if (auto fd = std::stoi(word); fd > STDERR_FILENO) {
+            sockets.push_back(fd);
+        }
+    }
+    std::sort(sockets.begin(), sockets.end());
+    EXPECT_EQ(listenFds, "2");
+    EXPECT_EQ(sockets, std::vector<int>({ 3, 4 }));
+    ::unlink(out.c_str());
+    ::unlink(path.c_str());
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+
+#include "restio_api_mapper.hpp"
+#include "restio_event_hub.hpp"
+#include "restio_middleware.hpp"
+#include "restio_rest_handler.hpp"
+#include "restio_websocket.hpp"
+#include "test_server.hpp"
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <atomic>
+
+using namespace restio;
+using MiddlewareServerTest = ServerTest;
+
+namespace {
+
+struct Trace {
+    std::string              name;
+    std::vector<std::string> *log;
+    bool                     deny = false;
+
+    bool before(Request &, Response &response, RequestContext &)
+    {
+        log->push_back(name + "+");
+        if (deny) {
+            response.result(http::status::forbidden);
+        }
+        return !deny;
+    }
+    void after(Request &, Response &, RequestContext &) { log->push_back(name + "-"); }
+};
+
+struct OnlyAfter {
+    void after(Request &, Response &response, RequestContext &) { response.set("X-After", "1"); }
+};
+
+struct Auth {
+    bool before(Request &request, Response &response, RequestContext &)
+    {
+        if (request["Authorization"] == "Bearer secret") {
+            return true;
+        }
+        response.result(http::status::unauthorized);
+        return false;
+    }
+};
+
+struct Cors {
+    void after(Request &, Response &response, RequestContext &)
+    {
+        response.set(http::field::access_control_allow_origin, "*");
+    }
+};
+
+struct Count {
+    std::atomic<int> *calls;
+    void              before(Request &, Response &, RequestContext &) { ++*calls; }
+};
+
+const TestHeaders authorized { { "Authorization", "Bearer secret" } };
+
+} // namespace
+
+TEST(MiddlewareTest, Chain)
+{
+    std::vector<std::string> log;
+    MiddlewareChain          chain(Trace { "a", &log }, OnlyAfter {}, Trace { "b", &log }, Trace { "c", &log });
+    Request                  request;
+    Response                 response;
+    RequestContext           context;
+
+    auto passed = chain.before(request, response, context);
+    EXPECT_TRUE(chain.proceeds(passed));
+    chain.after(passed, request, response, context);
+    EXPECT_EQ(log, (std::vector<std::string> { "a+", "b+", "c+", "c-", "b-", "a-" }));
+    EXPECT_EQ(response["X-After"], "1");
+
+    log.clear();
+    MiddlewareChain denying(Trace { "a", &log }, Trace { "b", &log, true }, Trace { "c", &log });
+    passed = denying.before(request, response, context);
+    EXPECT_FALSE(denying.proceeds(passed));
+    denying.after(passed, request, response, context);
+    EXPECT_EQ(log, (std::vector<std::string> { "a+", "b+", "b-", "a-" }));
+    EXPECT_EQ(response.result(), http::status::forbidden);
+}
+
+TEST_F(MiddlewareServerTest, Server)
+{
+    server.use(Cors {}, Auth {});
+    server.route("sleep", [](std::string_view, Request &, Response &response) -> boost::asio::awaitable<void> {
+        boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor, std::chrono::milliseconds(20));
+        co_await timer.async_wait(boost::asio::use_awaitable);
+        response.body() = "slept";
+    });
+    std::atomic<int> calls = 0;
+    RestHandler      restHandler(server);
+    api::API         api(1);
+    api.get<api::API::Method::Dummy>("hello", "", "", [](Request &, Response &response, const Properties &) {
+        response.body() = "hi";
+    });
+    api.use(Count { &calls });
+    restHandler.registerAPI(std::move(api));
+    start();
+
+    auto slept = get("/sleep", authorized);
+    EXPECT_EQ(slept.body(), "slept");
+    EXPECT_EQ(slept[http::field::access_control_allow_origin], "*");
+    auto denied = get("/sleep");
+    EXPECT_EQ(denied.result(), http::status::unauthorized);
+    EXPECT_EQ(denied[http::field::access_control_allow_origin], "*");
+    EXPECT_EQ(get("/missing", authorized)[http::field::access_control_allow_origin], "*");
+
+    EXPECT_EQ(get("/api/v1/hello", authorized).body(), "hi");
+    EXPECT_EQ(get("/api/v1/hello").result(), http::status::unauthorized);
+    EXPECT_EQ(calls, 1); // the request denied by the server never got to the API
+    stop();
+}
+
+// upgrades and event streams go through the middleware as well
+TEST_F(MiddlewareServerTest, Streams)
+{
+    server.use(Cors {}, Auth {});
+    server.websocket("ws", std::make_shared<WebSocketEndpoint>([](std::string_view) { return std::string(); }));
+    server.events("events", std::make_shared<EventHub>());
+    start();
+
+    namespace websocket = boost::beast::websocket;
+    auto denied = get("/ws",
+                      { { "Connection", "Upgrade" },
+                        { "Upgrade", "websocket" },
+                        { "Sec-WebSocket-Key", "dGhlIHNhbXBsZSBub25jZQ==" },
+                        { "Sec-WebSocket-Version", "13" } });
+    EXPECT_EQ(denied.result(), http::status::unauthorized);
+    EXPECT_EQ(denied[http::field::access_control_allow_origin], "*");
+
+    websocket::stream<boost::asio::ip::tcp::socket> allowed(connect());
+    allowed.set_option(websocket::stream_base::decorator(
+        [](websocket::request_type &request) { request.set(http::field::authorization, "Bearer secret"); }));
+    boost::beast::error_code ec;
+    allowed.handshake("localhost", "/ws", ec);
+    EXPECT_FALSE(ec);
+
+    EXPECT_EQ(get("/events").result(), http::status::unauthorized);
+    stop();
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "restio_api_mapper.hpp"
+#include "restio_rest_handler.hpp"
+#include "test_server.hpp"
+
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+using namespace restio;
+using namespace std::chrono_literals;
+using OffloadServerTest = ServerTest;
+
+namespace {
+
+struct ThreadOf {
+    std::thread::id *thread;
+    void             after(Request &, Response &, RequestContext &) { *thread = std::this_thread::get_id(); }
+};
+
+} // namespace
+
+TEST(OffloadTest, NoMethod)
+{
+    api::API api(1);
+    EXPECT_THROW(api.offload(), std::logic_error);
+    EXPECT_THROW(api.timeout(1s), std::logic_error);
+    EXPECT_THROW(api.coalesce(), std::logic_error);
+    EXPECT_THROW(api.cache(1s), std::logic_error);
+    EXPECT_THROW(api.rateLimit(1, 1), std::logic_error);
+}
+
+TEST_F(OffloadServerTest, RunsOffTheIOThread)
+{
+    std::thread::id    ioThread, handlerThread, resumedThread;
+    std::promise<void> entered, release;
+    auto               released = release.get_future().share();
+
+    api::API api(1);
+    api.use(ThreadOf { &resumedThread });
+    api.get<api::API::Method::Dummy>("slow", "", "", [&](Request &, Response &response, const Properties &) {
+           handlerThread = std::this_thread::get_id();
+           entered.set_value();
+           released.wait();
+           response.body() = "slow";
+       })
+        .offload();
+    api.get<api::API::Method::Dummy>("cheap", "", "", [&](Request &, Response &response, const Properties &) {
+        ioThread        = std::this_thread::get_id();
+        response.body() = "cheap";
+    });
+    RestHandler restHandler(server);
+    restHandler.registerAPI(std::move(api));
+    start();
+
+    auto slow = std::async(std::launch::async, [this]() { return get("/api/v1/slow"); });
+    entered.get_future().wait();
+
+    // answered while the slow handler is blocked. the timeout only keeps a broken server from hanging the test
+    auto cheap = std::async(std::launch::async, [this]() { return get("/api/v1/cheap"); });
+    bool answered = cheap.wait_for(10s) == std::future_status::ready;
+    EXPECT_TRUE(answered);
+    EXPECT_NE(slow.wait_for(0s), std::future_status::ready);
+    release.set_value();
+    EXPECT_EQ(cheap.get().body(), "cheap");
+    EXPECT_EQ(slow.get().body(), "slow");
+
+    EXPECT_NE(ioThread, std::thread::id {});
+    EXPECT_NE(handlerThread, ioThread);
+    EXPECT_EQ(resumedThread, ioThread); // after() of the middleware is back on the session
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include "restio_api_mapper.hpp"
+#include "restio_rest_handler.hpp"
+#include "test_server.hpp"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <chrono>
+#include <future>
+
+using namespace restio;
+using namespace std::chrono_literals;
+
+namespace {
+
+class PipeliningTest : public ServerTest {
+protected:
+    void SetUp() override
+    {
+        api::API api(1);
+        api.get<api::API::Method::Dummy>("n/<int:n>", "", "", [](Request &, Response &response, const Properties &p) {
+            response.body() = std::to_string(*p.value<int>("n"));
+        });
+        api.get<api::API::Method::Dummy>(
+            "slow", "", "", [this](Request &, Response &response, const Properties &) -> boost::asio::awaitable<void> {
+                entered.set_value();
+                boost::system::error_code ec;
+                co_await release.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+                response.body() = "slow";
+            });
+        restHandler.registerAPI(std::move(api));
+        start();
+    }
+
+    // all the requests in a single write
+    void pipeline(boost::asio::ip::tcp::socket &socket, const std::vector<std::string> &targets)
+    {
+        std::string requests;
+        for (auto const &target : targets) {
+            requests += "GET /api/v1/" + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        }
+        boost::asio::write(socket, boost::asio::buffer(requests));
+    }
+
+    std::string readBody(boost::asio::ip::tcp::socket &socket)
+    {
+        TestResponse response;
+        http::read(socket, buffer, response);
+        return response.body();
+    }
+
+    boost::beast::flat_buffer buffer;
+    RestHandler               restHandler { server };
+    // the slow handler sets entered and waits for release
+    std::promise<void>        entered;
+    boost::asio::steady_timer release { serverContext, std::chrono::steady_clock::time_point::max() };
+};
+
+} // namespace
+
+TEST_F(PipeliningTest, Order)
+{
+    auto                     socket = connect();
+    std::vector<std::string> targets;
+    for (int i = 0; i < 40; i++) { // more than a batch takes
+        targets.push_back("n/" + std::to_string(i));
+    }
+    pipeline(socket, targets);
+    for (int i = 0; i < 40; i++) {
+        EXPECT_EQ(readBody(socket), std::to_string(i));
+    }
+}
+
+TEST_F(PipeliningTest, SuspendedHandler)
+{
+    auto socket = connect();
+    pipeline(socket, { "n/1", "n/2", "slow", "n/4", "n/5" });
+
+    // the responses ready before the slow one don't wait for it. it's released once they are read.
+    // the timeout only keeps a broken server from hanging the test
+    auto first = std::async(std::launch::async, [&]() {
+        auto body = readBody(socket);
+        return body + readBody(socket);
+    });
+    bool read  = first.wait_for(10s) == std::future_status::ready;
+    EXPECT_TRUE(read);
+    entered.get_future().wait();
+    boost::asio::post(serverContext, [this]() { release.cancel(); });
+    EXPECT_EQ(first.get(), "12");
+
+    EXPECT_EQ(readBody(socket), "slow");
+    EXPECT_EQ(readBody(socket), "4");
+    EXPECT_EQ(readBody(socket), "5");
+}
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "rate_limiter.hpp"
+#include "restio_api_mapper.hpp"
+#include "restio_rest_handler.hpp"
+#include "test_server.hpp"
+
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <unistd.h>
+
+using namespace restio;
+using namespace std::chrono_literals;
+using RateLimiterServerTest = ServerTest;
+
+TEST(RateLimiterTest, Bucket)
+{
+    RateLimiter limiter(64);
+    RateLimit   limit { 10, 3 };
+    auto        now = RateLimiter::Clock::now();
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(limiter.acquire(1, limit, now), 0ns);
+    }
+    auto wait = limiter.acquire(1, limit, now);
+    EXPECT_GT(wait, 99ms);
+    EXPECT_LE(wait, 100ms);
+    EXPECT_EQ(limiter.acquire(2, limit, now), 0ns); // another client
+    EXPECT_EQ(limiter.acquire(1, limit, now + 100ms), 0ns);
+    EXPECT_NE(limiter.acquire(1, limit, now + 100ms), 0ns);
+    EXPECT_EQ(limiter.acquire(1, { 0, 1 }, now), 0ns); // unlimited
+}
+
+// the bucket used least recently is taken by a new client
+TEST(RateLimiterTest, Eviction)
+{
+    RateLimiter limiter(4);
+    RateLimit   limit { 10, 3 };
+    auto        now = RateLimiter::Clock::now();
+    for (int i = 0; i < 3; i++) {
+        limiter.acquire(1, limit, now);
+    }
+    for (std::uint64_t key = 2; key <= 5; key++) {
+        EXPECT_EQ(limiter.acquire(key, limit, now + 10ms), 0ns);
+    }
+    EXPECT_NE(limiter.acquire(1, limit, now + 10ms), 0ns); // still tracked
+    for (std::uint64_t key = 3; key <= 5; key++) {
+        EXPECT_EQ(limiter.acquire(key, limit, now + 10ms), 0ns);
+        EXPECT_EQ(limiter.acquire(key, limit, now + 10ms), 0ns);
+        EXPECT_NE(limiter.acquire(key, limit, now + 10ms), 0ns);
+    }
+}
+
+TEST_F(RateLimiterServerTest, Limits)
+{
+    server.setRateLimit({ { 1, 3 }, "X-Api-Key" });
+    std::string peer;
+    server.route("hello", [&peer](std::string_view, Request &, Response &response, RequestContext &context) {
+        peer            = context.peer;
+        response.body() = "hi";
+    });
+    start();
+
+    auto socket = connect();
+    auto get    = [&socket](const std::string &target, const std::string &key) {
+        return roundTrip(socket, makeRequest(http::verb::get, target, { { "X-Api-Key", key } }));
+    };
+
+    EXPECT_EQ(get("/hello", "a").result(), http::status::ok);
+    EXPECT_EQ(peer, "127.0.0.1");
+    EXPECT_EQ(get("/hello", "a").result(), http::status::ok);
+    EXPECT_EQ(get("/hello", "a").result(), http::status::ok);
+    auto rejected = get("/hello", "b"); // a fresh key doesn't help, the address is limited
+    EXPECT_EQ(rejected.result(), http::status::too_many_requests);
+    EXPECT_EQ(rejected[http::field::retry_after], "1");
+    EXPECT_EQ(server.takeStats().rateLimited, 1);
+    stop();
+}
+
+TEST_F(RateLimiterServerTest, MethodLimits)
+{
+    RestHandler restHandler(server);
+    api::API    api(1);
+    api.get<api::API::Method::Dummy>("limited", "", "", [](Request &, Response &, const Properties &) { })
+        .rateLimit(1);
+    restHandler.registerAPI(std::move(api));
+    start();
+
+    EXPECT_EQ(get("/api/v1/limited", { { "X-Api-Key", "b" } }).result(), http::status::ok);
+    EXPECT_EQ(get("/api/v1/limited", { { "X-Api-Key", "c" } }).result(), http::status::too_many_requests);
+    stop();
+}
+
+TEST(RateLimiterTest, ClientBuckets)
+{
+    RateLimiter    limiter;
+    RateLimit      limit { 1, 1 };
+    auto           now = RateLimiter::Clock::now();
+    Request        request;
+    RequestContext context; // of a unix domain socket
+    EXPECT_EQ(limiter.acquire(request, context, "X-Api-Key", limit, 0, now), 0ns);
+    EXPECT_EQ(limiter.acquire(request, context, "X-Api-Key", limit, 0, now), 0ns); // not limited
+    request.set("X-Api-Key", "a");
+    EXPECT_EQ(limiter.acquire(request, context, "X-Api-Key", limit, 0, now), 0ns);
+    EXPECT_NE(limiter.acquire(request, context, "X-Api-Key", limit, 0, now), 0ns);
+    EXPECT_EQ(limiter.acquire(request, context, "X-Api-Key", limit, 1, now), 0ns); // another salt
+    request.set("X-Api-Key", "b");
+    EXPECT_EQ(limiter.acquire(request, context, "X-Api-Key", limit, 0, now), 0ns);
+
+    context.peer = "127.0.0.1";
+    request.set("X-Api-Key", "c");
+    EXPECT_EQ(limiter.acquire(request, context, "X-Api-Key", limit, 0, now), 0ns);
+    request.set("X-Api-Key", "d");
+    EXPECT_NE(limiter.acquire(request, context, "X-Api-Key", limit, 0, now), 0ns); // by the address
+    context.peer = "127.0.0.2";
+    request.set("X-Api-Key", "c");
+    EXPECT_NE(limiter.acquire(request, context, "X-Api-Key", limit, 0, now), 0ns); // by the header
+}
+
+// local clients can't be told apart without the header, they aren't limited together
+TEST_F(RateLimiterServerTest, UnixSocket)
+{
+    auto path = "/tmp/restio_rate_limiter_test_" + std::to_string(::getpid()) + ".sock";
+    server.listenUnix(path);
+    server.setRateLimit({ { 1, 1 }, {} });
+    server.route("hello", [](std::string_view, Request &, Response &response) { response.body() = "hi"; });
+    start();
+
+    boost::asio::local::stream_protocol::socket socket(ioc);
+    socket.connect(boost::asio::local::stream_protocol::endpoint(path));
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(roundTrip(socket, makeRequest(http::verb::get, "/hello")).result(), http::status::ok);
+    }
+    EXPECT_EQ(get("/hello").result(), http::status::ok);
+    EXPECT_EQ(get("/hello").result(), http::status::too_many_requests);
+    ::unlink(path.c_str());
+}
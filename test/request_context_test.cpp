@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include "restio_request_context.hpp"
+#include "test_server.hpp"
+
+#include <memory_resource>
+#include <vector>
+
+using namespace restio;
+using RequestContextServerTest = ServerTest;
+
+TEST(RequestContextTest, Arena)
+{
+    RequestArena arena;
+    void        *first;
+    {
+        std::pmr::vector<int> numbers(&arena);
+        numbers.assign(100, 1);
+        first = numbers.data();
+        std::pmr::vector<char> large(RequestArena::initial_size * 4, 'a', &arena); // more blocks
+    }
+    arena.release();
+    std::pmr::vector<int> again(100, 2, &arena);
+    EXPECT_EQ(again.data(), first); // the first block is reused
+
+    RequestArena copy(arena);
+    EXPECT_FALSE(copy.is_equal(arena));
+    std::pmr::vector<int> other(100, 3, &copy);
+    EXPECT_NE(other.data(), first);
+    EXPECT_EQ(again[99], 2);
+}
+
+// the arena is released and reused by the next request of the connection
+TEST_F(RequestContextServerTest, Arena)
+{
+    std::vector<const void *> scratch;
+    std::uint16_t             peerPort = 0;
+    server.route("hello", [&](std::string_view, Request &, Response &response, RequestContext &context) {
+        std::pmr::string greeting("hello from the arena, long enough not to be inline", &context.arena);
+        scratch.push_back(greeting.data());
+        peerPort        = context.peerPort;
+        response.body() = greeting;
+    });
+    start();
+
+    auto socket = connect();
+    for (int i = 0; i < 2; i++) {
+        auto response = roundTrip(socket, makeRequest(http::verb::get, "/hello"));
+        EXPECT_EQ(response.body(), "hello from the arena, long enough not to be inline");
+    }
+    stop();
+
+    ASSERT_EQ(scratch.size(), 2);
+    EXPECT_EQ(scratch[0], scratch[1]);
+    EXPECT_EQ(peerPort, socket.local_endpoint().port());
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+
+#include "response_cache.hpp"
+#include "restio_api_mapper.hpp"
+#include "restio_rest_handler.hpp"
+#include "test_server.hpp"
+
+using namespace restio;
+namespace http                = boost::beast::http;
+using ResponseCacheServerTest = ServerTest;
+
+namespace {
+
+Response makeResponse(std::string body)
+{
+    Response response;
+    response.result(http::status::ok);
+    response.set(http::field::content_type, "text/plain");
+    response.body() = std::move(body);
+    return response;
+}
+
+}
+
+TEST(ResponseCacheTest, NormalizeTarget)
+{
+    EXPECT_EQ(ResponseCache::normalizeTarget("a//b/"), "a/b");
+    EXPECT_EQ(ResponseCache::normalizeTarget("/a/b?y=2&x=1"), "a/b?y=2&x=1");
+    EXPECT_NE(ResponseCache::normalizeTarget("a?tag=a&tag=b"), ResponseCache::normalizeTarget("a?tag=b&tag=a"));
+    EXPECT_EQ(ResponseCache::normalizeTarget(""), "");
+}
+
+TEST(ResponseCacheTest, StoreAndRevalidate)
+{
+    ResponseCache cache;
+    Request       request { http::verb::get, "/api/v1/res/a", 11 };
+    auto          key      = ResponseCache::makeKey(1, request, "res/a", {});
+    auto          response = makeResponse("data");
+    cache.store(std::string(key), 1, "res/a", response, std::chrono::minutes(1), cache.generation());
+    auto etag = std::string(response[http::field::etag]);
+    EXPECT_FALSE(etag.empty());
+
+    auto entry = cache.find(key);
+    ASSERT_TRUE(entry);
+    Response       cached;
+    RequestContext context;
+    ResponseCache::apply(*entry, request, cached, context);
+    EXPECT_TRUE(cached.body().empty());
+    ASSERT_TRUE(context.sharedBody);
+    EXPECT_EQ(context.sharedBody.get(), entry->body.get()); // not copied
+    EXPECT_EQ(*context.sharedBody, "data");
+    EXPECT_EQ(cached[http::field::content_type], "text/plain");
+
+    request.set(http::field::if_none_match, "\"other\", " + etag);
+    Response       revalidated;
+    RequestContext revalidatedContext;
+    ResponseCache::apply(*entry, request, revalidated, revalidatedContext);
+    EXPECT_EQ(revalidated.result(), http::status::not_modified);
+    EXPECT_TRUE(revalidated.body().empty());
+
+    cache.invalidate(1, "res");
+    EXPECT_FALSE(cache.find(key));
+}
+
+TEST(ResponseCacheTest, InvalidateSegments)
+{
+    ResponseCache cache;
+    Request       request { http::verb::get, "/", 11 };
+    auto          store = [&](const std::string &target) {
+        auto response = makeResponse(target);
+        cache.store(ResponseCache::makeKey(1, request, target, {}), 1, std::string(target), response,
+                    std::chrono::minutes(1), cache.generation());
+    };
+    auto cached = [&](const std::string &target) {
+        return bool(cache.find(ResponseCache::makeKey(1, request, target, {})));
+    };
+    for (auto target : { "users/1", "users/1/posts", "users/1?x=y", "users/10", "users" }) {
+        store(target);
+    }
+
+    cache.invalidate(1, "/users/1/");
+    EXPECT_FALSE(cached("users/1"));
+    EXPECT_FALSE(cached("users/1/posts"));
+    EXPECT_FALSE(cached("users/1?x=y"));
+    EXPECT_TRUE(cached("users/10"));
+    EXPECT_TRUE(cached("users"));
+
+    cache.invalidate(0, "");
+    EXPECT_FALSE(cached("users/10"));
+    EXPECT_FALSE(cached("users"));
+}
+
+TEST(ResponseCacheTest, Limits)
+{
+    ResponseCache cache(1024, 2);
+    Request       request { http::verb::get, "/", 11 };
+    for (auto target : { "a", "b", "c" }) {
+        auto response = makeResponse(target);
+        cache.store(ResponseCache::makeKey(1, request, target, {}), 1, target, response, std::chrono::minutes(1),
+                    cache.generation());
+    }
+    EXPECT_FALSE(cache.find(ResponseCache::makeKey(1, request, "a", {})));
+    EXPECT_TRUE(cache.find(ResponseCache::makeKey(1, request, "c", {})));
+
+    auto expired = makeResponse("d");
+    cache.store(ResponseCache::makeKey(1, request, "d", {}), 1, "d", expired, std::chrono::seconds(0),
+                cache.generation());
+    EXPECT_FALSE(cache.find(ResponseCache::makeKey(1, request, "d", {})));
+}
+
+TEST(ResponseCacheTest, Headers)
+{
+    ResponseCache cache;
+    Request       request { http::verb::get, "/", 11 };
+    auto          response = makeResponse("data");
+    response.set(http::field::cache_control, "max-age=60");
+    response.set("X-Custom", "value");
+    cache.store(ResponseCache::makeKey(1, request, "a", {}), 1, "a", response, std::chrono::minutes(1),
+                cache.generation());
+    auto entry = cache.find(ResponseCache::makeKey(1, request, "a", {}));
+    ASSERT_TRUE(entry);
+    Response       cached;
+    RequestContext context;
+    ResponseCache::apply(*entry, request, cached, context);
+    EXPECT_EQ(cached.result(), http::status::ok);
+    EXPECT_EQ(cached[http::field::cache_control], "max-age=60");
+    EXPECT_EQ(cached["X-Custom"], "value");
+    EXPECT_EQ(cached[http::field::etag], entry->etag);
+
+    for (auto control : { "no-store", "private", "Private=\"X-Custom\", max-age=60" }) {
+        auto uncacheable = makeResponse("data");
+        uncacheable.set(http::field::cache_control, control);
+        cache.store(ResponseCache::makeKey(1, request, "b", {}), 1, "b", uncacheable, std::chrono::minutes(1),
+                    cache.generation());
+        EXPECT_FALSE(cache.find(ResponseCache::makeKey(1, request, "b", {}))) << control;
+    }
+}
+
+TEST(ResponseCacheTest, InvalidatedWhileRunning)
+{
+    ResponseCache cache;
+    Request       request { http::verb::get, "/", 11 };
+    auto          generation = cache.generation(); // the handler starts
+    cache.invalidate(1, "a");
+    auto outdated = makeResponse("old");
+    cache.store(ResponseCache::makeKey(1, request, "a", {}), 1, "a", outdated, std::chrono::minutes(1), generation);
+    EXPECT_FALSE(cache.find(ResponseCache::makeKey(1, request, "a", {})));
+
+    auto fresh = makeResponse("new");
+    cache.store(ResponseCache::makeKey(1, request, "a", {}), 1, "a", fresh, std::chrono::minutes(1),
+                cache.generation());
+    EXPECT_TRUE(cache.find(ResponseCache::makeKey(1, request, "a", {})));
+}
+
+TEST_F(ResponseCacheServerTest, Hit)
+{
+    int      calls = 0;
+    api::API api(1);
+    api.get<api::API::Method::Dummy>("res", "", "", [&calls](Request &, Response &response, const Properties &) {
+           ++calls;
+           response.body() = "data";
+       })
+        .cache(std::chrono::minutes(1));
+    RestHandler restHandler(server);
+    restHandler.registerAPI(std::move(api));
+    start();
+
+    auto first = get("/api/v1/res");
+    EXPECT_EQ(first.body(), "data");
+    auto second = get("/api/v1/res");
+    EXPECT_EQ(second.body(), "data");
+    EXPECT_EQ(second[http::field::content_length], "4");
+    EXPECT_EQ(second[http::field::etag], first[http::field::etag]);
+    EXPECT_EQ(calls, 1);
+
+    auto etag = std::string(first[http::field::etag]);
+    EXPECT_EQ(get("/api/v1/res", { { "If-None-Match", etag } }).result(), http::status::not_modified);
+}
+
+TEST_F(ResponseCacheServerTest, PerUser)
+{
+    int      calls = 0;
+    api::API api(1);
+    api.get<api::API::Method::Dummy>("me", "", "", [&calls](Request &request, Response &response, const Properties &) {
+           ++calls;
+           response.body() = std::string(request[http::field::authorization]);
+       })
+        .cache(std::chrono::minutes(1));
+    RestHandler restHandler(server);
+    restHandler.registerAPI(std::move(api));
+    start();
+
+    EXPECT_EQ(get("/api/v1/me", { { "Authorization", "Bearer alice" } }).body(), "Bearer alice");
+    EXPECT_EQ(get("/api/v1/me", { { "Authorization", "Bearer bob" } }).body(), "Bearer bob");
+    EXPECT_EQ(get("/api/v1/me", { { "Authorization", "Bearer alice" } }).body(), "Bearer alice");
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(get("/api/v1/me", { { "Cookie", "session=carol" } }).body(), "");
+    EXPECT_EQ(get("/api/v1/me").body(), "");
+    EXPECT_EQ(calls, 4);
+}
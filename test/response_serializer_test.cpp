@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include "response_serializer.hpp"
+
+using namespace restio;
+namespace http = boost::beast::http;
+
+TEST(ResponseSerializerTest, CommonHeaders)
+{
+    Response response;
+    response.version(11);
+    response.result(http::status::ok);
+    response.set(http::field::content_type, "application/json");
+    response.set(http::field::content_length, "999"); // computed from the body instead
+    response.body() = "{}";
+
+    std::string header;
+    serializeHeader(response, header);
+    EXPECT_EQ(header.rfind("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nServer: Restio/", 0), 0);
+    EXPECT_NE(header.find("\r\nDate: "), std::string::npos);
+    EXPECT_NE(header.find("\r\nContent-Length: 2\r\n\r\n"), std::string::npos);
+    EXPECT_EQ(header.find("999"), std::string::npos);
+}
+
+TEST(ResponseSerializerTest, Batch)
+{
+    ResponseBatch batch;
+    for (auto status : { http::status::ok, http::status::no_content }) {
+        Response response;
+        response.version(11);
+        response.result(status);
+        response.set(http::field::server, "test");
+        response.set(http::field::date, "today");
+        response.body() = "body";
+        batch.add(response);
+        EXPECT_TRUE(response.body().empty());
+    }
+    ASSERT_EQ(batch.size(), 2);
+
+    std::string written;
+    for (auto const &buffer : batch.buffers()) {
+        written.append(static_cast<const char *>(buffer.data()), buffer.size());
+    }
+    EXPECT_EQ(written,
+              "HTTP/1.1 200 OK\r\nServer: test\r\nDate: today\r\nContent-Length: 4\r\n\r\nbody"
+              "HTTP/1.1 204 No Content\r\nServer: test\r\nDate: today\r\n\r\n");
+
+    batch.clear();
+    EXPECT_TRUE(batch.empty());
+    EXPECT_TRUE(batch.buffers().empty());
+}
+
+TEST(ResponseSerializerTest, CustomReason)
+{
+    Response response;
+    response.version(11);
+    response.result(http::status::ok);
+    response.reason("Fine");
+
+    std::string header;
+    serializeHeader(response, header);
+    EXPECT_EQ(header.rfind("HTTP/1.1 200 Fine\r\n", 0), 0);
+
+    response.result(499); // unknown to the table
+    response.reason("Client Closed Request");
+    serializeHeader(response, header);
+    EXPECT_EQ(header.rfind("HTTP/1.1 499 Client Closed Request\r\n", 0), 0);
+
+    response.result(http::status::not_found);
+    response.reason("");
+    serializeHeader(response, header);
+    EXPECT_EQ(header.rfind("HTTP/1.1 404 Not Found\r\n", 0), 0);
+}
+
+TEST(ResponseSerializerTest, HandlerFraming)
+{
+    ResponseBatch batch;
+    Response      response;
+    response.version(11);
+    response.result(http::status::ok);
+    response.body() = "body";
+    response.prepare_payload(); // Content-Length set by the handler, so Beast serializes it
+    batch.add(response);
+
+    std::string written;
+    for (auto const &buffer : batch.buffers()) {
+        written.append(static_cast<const char *>(buffer.data()), buffer.size());
+    }
+    EXPECT_EQ(written.rfind("HTTP/1.1 200 OK\r\n", 0), 0);
+    EXPECT_NE(written.find("\r\nServer: Restio/"), std::string::npos);
+    EXPECT_NE(written.find("\r\nDate: "), std::string::npos);
+    EXPECT_NE(written.find("\r\nContent-Length: 4\r\n"), std::string::npos);
+    EXPECT_EQ(written.substr(written.size() - 4), "body");
+}
+
+TEST(ResponseSerializerTest, SharedBody)
+{
+    auto          shared = std::make_shared<const std::string>("shared");
+    ResponseBatch batch;
+    Response      response;
+    response.version(11);
+    response.result(http::status::ok);
+    batch.add(response, shared);
+
+    std::string written;
+    for (auto const &buffer : batch.buffers()) {
+        if (buffer.data() == shared->data()) {
+            written += "<not copied>";
+        }
+        written.append(static_cast<const char *>(buffer.data()), buffer.size());
+    }
+    EXPECT_NE(written.find("\r\nContent-Length: 6\r\n\r\n<not copied>shared"), std::string::npos);
+    batch.clear();
+    EXPECT_EQ(shared.use_count(), 1);
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include "restio_api_mapper.hpp"
+#include "restio_rest_handler.hpp"
+#include "single_flight.hpp"
+#include "test_server.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+
+using namespace restio;
+using namespace std::chrono_literals;
+namespace http = boost::beast::http;
+
+TEST(SingleFlightTest, FollowerGetsLeaderResponse)
+{
+    boost::asio::io_context ioc;
+    SingleFlight            inFlight;
+
+    auto [flight, leader] = inFlight.join("key");
+    ASSERT_TRUE(leader);
+    auto [sameFlight, secondLeader] = inFlight.join("key");
+    ASSERT_FALSE(secondLeader);
+    EXPECT_EQ(flight, sameFlight);
+
+    Response       followerResponse;
+    RequestContext context;
+    followerResponse.version(10);
+    bool followed = false;
+    boost::asio::co_spawn(
+        ioc,
+        [&]() -> boost::asio::awaitable<void> {
+            followed = co_await SingleFlight::wait(sameFlight, followerResponse, context);
+        },
+        boost::asio::detached);
+
+    Response leaderResponse;
+    leaderResponse.result(http::status::ok);
+    leaderResponse.set(http::field::content_type, "text/plain");
+    leaderResponse.body() = "shared";
+    boost::asio::post(ioc, [&]() { inFlight.finish("key", *flight, &leaderResponse); });
+    ioc.run();
+
+    EXPECT_TRUE(followed);
+    EXPECT_EQ(followerResponse.version(), 10);
+    EXPECT_EQ(followerResponse[http::field::content_type], "text/plain");
+    EXPECT_EQ(followerResponse.body(), "shared");
+    EXPECT_TRUE(inFlight.join("key").second); // the next request starts a new flight
+}
+
+TEST(SingleFlightTest, LeaderFailed)
+{
+    boost::asio::io_context ioc;
+    SingleFlight            inFlight;
+
+    auto flight = inFlight.join("key").first;
+    inFlight.finish("key", *flight, nullptr);
+
+    Response       response;
+    RequestContext context;
+    bool           followed = true;
+    boost::asio::co_spawn(
+        ioc,
+        [&]() -> boost::asio::awaitable<void> { followed = co_await SingleFlight::wait(flight, response, context); },
+        boost::asio::detached);
+    ioc.run();
+    EXPECT_FALSE(followed);
+}
+
+namespace {
+
+class SingleFlightServerTest : public ServerTest {
+protected:
+    // answers the Authorization of the request after a while, so concurrent requests overlap
+    void SetUp() override
+    {
+        auto whoami = [this](Request &request, Response &response, const Properties &) -> boost::asio::awaitable<void> {
+            ++calls;
+            boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor, 200ms);
+            co_await timer.async_wait(boost::asio::use_awaitable);
+            response.body() = std::string(request[http::field::authorization]);
+            if (request.target().ends_with("login")) {
+                response.set(http::field::set_cookie, "session=" + std::to_string(calls));
+            }
+        };
+        api::API api(1);
+        api.get<api::API::Method::Dummy>("whoami", "", "", whoami).coalesce();
+        api.get<api::API::Method::Dummy>("login", "", "", whoami).coalesce();
+        restHandler.registerAPI(std::move(api));
+        start();
+    }
+
+    // the requests are sent at once, each on its connection
+    std::vector<TestResponse> concurrently(const std::string &target, const std::vector<std::string> &users)
+    {
+        std::vector<std::future<TestResponse>> futures;
+        for (auto const &user : users) {
+            futures.push_back(std::async(std::launch::async, [this, target, user]() {
+                return get(target, { { "Authorization", "Bearer " + user } });
+            }));
+        }
+        std::vector<TestResponse> responses;
+        for (auto &future : futures) {
+            responses.push_back(future.get());
+        }
+        return responses;
+    }
+
+    std::atomic<int> calls = 0;
+    RestHandler      restHandler { server };
+};
+
+} // namespace
+
+TEST_F(SingleFlightServerTest, PerUser)
+{
+    auto responses = concurrently("/api/v1/whoami", { "alice", "bob", "alice" });
+    EXPECT_EQ(responses[0].body(), "Bearer alice");
+    EXPECT_EQ(responses[1].body(), "Bearer bob");
+    EXPECT_EQ(responses[2].body(), "Bearer alice");
+    EXPECT_EQ(calls, 2); // alice's requests shared one call
+}
+
+TEST_F(SingleFlightServerTest, SetCookieNotShared)
+{
+    auto responses = concurrently("/api/v1/login", { "alice", "alice" });
+    EXPECT_EQ(calls, 2);
+    EXPECT_NE(responses[0][http::field::set_cookie], responses[1][http::field::set_cookie]);
+}
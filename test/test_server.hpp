@@ -0,0 +1,133 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "restio_http_server.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace restio {
+
+using TestResponse = http::response<http::string_body>;
+using TestHeaders  = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @brief A server listening on a free port of 127.0.0.1 and a thread running it, plus a client of it.
+ *
+ * Set up the server, then start() it. Whatever refers to the server and is declared after it has to be
+ * destroyed after stop(), use ServerTest for that.
+ */
+class TestServer {
+public:
+    // an empty address - no listener, add them to the server
+    explicit TestServer(const std::string &bindAddress = "127.0.0.1", const std::string &basePath = {}) :
+        server(serverContext, basePath)
+    {
+        if (!bindAddress.empty()) {
+            server.listen(bindAddress, 0);
+        }
+    }
+    ~TestServer() { stop(); }
+
+    void start()
+    {
+        thread = std::thread([this]() { serverContext.run(); });
+    }
+
+    void stop()
+    {
+        serverContext.stop();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    boost::asio::ip::tcp::endpoint endpoint() const
+    {
+        return { boost::asio::ip::make_address("127.0.0.1"), server.port() };
+    }
+
+    boost::asio::ip::tcp::socket connect()
+    {
+        boost::asio::ip::tcp::socket socket(ioc);
+        socket.connect(endpoint());
+        return socket;
+    }
+
+    // the request on a new connection
+    TestResponse send(http::request<http::string_body> request)
+    {
+        auto socket = connect();
+        return roundTrip(socket, request);
+    }
+
+    TestResponse get(const std::string &target, const TestHeaders &headers = {})
+    {
+        return send(makeRequest(http::verb::get, target, headers));
+    }
+
+    static http::request<http::string_body>
+    makeRequest(http::verb method, const std::string &target, const TestHeaders &headers = {}, std::string body = {})
+    {
+        http::request<http::string_body> request { method, target, 11 };
+        request.set(http::field::host, "localhost");
+        for (auto const &[name, value] : headers) {
+            request.set(name, value);
+        }
+        if (!body.empty()) {
+            request.body() = std::move(body);
+            request.prepare_payload();
+        }
+        return request;
+    }
+
+    // the request on the connection
+    template <typename Stream>
+    static TestResponse roundTrip(Stream &stream, const http::request<http::string_body> &request)
+    {
+        http::write(stream, request);
+        boost::beast::flat_buffer buffer;
+        TestResponse              response;
+        http::read(stream, buffer, response);
+        return response;
+    }
+
+    // polls the condition till it holds or 10s pass. for what the server does after writing the response
+    template <typename Condition> static bool eventually(Condition condition)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!condition()) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    boost::asio::io_context serverContext;
+    HttpServer              server;
+    boost::asio::io_context ioc; // of the clients
+
+private:
+    std::thread thread;
+};
+
+// stops the server before the members of the test are destroyed
+class ServerTest : public ::testing::Test, public TestServer {
+protected:
+    using TestServer::TestServer;
+
+    void TearDown() override { stop(); }
+};
+
+} // namespace restio
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include "restio_trace.hpp"
+#include "test_server.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <future>
+#include <mutex>
+#include <sstream>
+
+using namespace restio;
+using TraceServerTest = ServerTest;
+
+namespace {
+
+const std::string caller_trace = "4bf92f3577b34da6a3ce929d0e0e4736";
+const std::string caller_span  = "00f067aa0ba902b7";
+
+} // namespace
+
+TEST(TraceTest, Traceparent)
+{
+    auto child = TraceContext::fromHeader("00-" + caller_trace + "-" + caller_span + "-01");
+    EXPECT_EQ(child.traceIdString(), caller_trace);
+    EXPECT_EQ(child.parentIdString(), caller_span);
+    EXPECT_EQ(child.flags, 1);
+    EXPECT_NE(child.spanIdString(), caller_span);
+    EXPECT_EQ(child.traceparent(), "00-" + caller_trace + "-" + child.spanIdString() + "-01");
+
+    // later versions may have more fields
+    EXPECT_TRUE(TraceContext::fromHeader("01-" + caller_trace + "-" + caller_span + "-00-more").hasParent());
+
+    for (auto malformed : { std::string(),
+                            "00-" + caller_trace + "-" + caller_span + "-01-more",
+                            "ff-" + caller_trace + "-" + caller_span + "-01",
+                            "00-4BF92F3577B34DA6A3CE929D0E0E4736-" + caller_span + "-01",
+                            "00-00000000000000000000000000000000-" + caller_span + "-01",
+                            "00-" + caller_trace + "-0000000000000000-01" }) {
+        auto root = TraceContext::fromHeader(malformed);
+        EXPECT_FALSE(root.hasParent()) << malformed;
+        EXPECT_NE(root.traceIdString(), caller_trace) << malformed;
+        EXPECT_NE(root.traceId, decltype(root.traceId) {});
+    }
+}
+
+TEST(TraceTest, Histogram)
+{
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile(0.5).count(), 0);
+    histogram.add(std::chrono::nanoseconds(500));
+    histogram.add(std::chrono::microseconds(3));
+    histogram.add(std::chrono::microseconds(100));
+    histogram.add(std::chrono::hours(1));
+    EXPECT_EQ(histogram.count(), 4);
+    EXPECT_EQ(histogram.buckets[0], 1);
+    EXPECT_EQ(histogram.buckets[2], 1);
+    EXPECT_EQ(histogram.buckets.back(), 1);
+    EXPECT_EQ(histogram.percentile(0.5).count(), 128);
+    EXPECT_EQ(histogram.percentile(0).count(), 1);
+}
+
+// the phases of a request, its trace in the handler and the exported line
+TEST_F(TraceServerTest, Observer)
+{
+    std::ostringstream       exported;
+    JsonLinesExporter        exporter(exported);
+    std::mutex               mutex;
+    std::vector<RequestSpan> spans;
+    std::promise<void>       observed;
+    server.setRequestObserver([&](const RequestSpan &span) {
+        exporter(span);
+        std::lock_guard<std::mutex> lock(mutex);
+        spans.push_back(span);
+        observed.set_value();
+    });
+    server.route("hello", [](std::string_view, Request &, Response &response, RequestContext &context) {
+        response.body() = context.trace.traceparent();
+    });
+    start();
+
+    auto response = get("/hello", { { "traceparent", "00-" + caller_trace + "-" + caller_span + "-01" } });
+    // observed once the response is written
+    ASSERT_EQ(observed.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    stop();
+
+    ASSERT_EQ(spans.size(), 1);
+    auto const &span = spans[0];
+    EXPECT_EQ(span.target, "/hello");
+    EXPECT_EQ(span.status, 200);
+    EXPECT_EQ(span.peer, "127.0.0.1");
+    EXPECT_EQ(span.trace.parentIdString(), caller_span);
+    EXPECT_EQ(response.body(), span.trace.traceparent());
+    auto const &t = span.timings;
+    EXPECT_NE(t.received, RequestTimings::TimePoint {});
+    EXPECT_LE(t.received, t.parsed);
+    EXPECT_LE(t.parsed, t.routed);
+    EXPECT_LE(t.routed, t.handled);
+    EXPECT_LE(t.handled, t.serialized);
+    EXPECT_LE(t.serialized, t.written);
+
+    auto stats = server.takeStats();
+    EXPECT_EQ(stats.readLatency.count(), 1);
+    EXPECT_EQ(stats.handlerLatency.count(), 1);
+    EXPECT_EQ(stats.writeLatency.count(), 1);
+
+    auto line = nlohmann::json::parse(exported.str());
+    EXPECT_EQ(line["traceId"], caller_trace);
+    EXPECT_EQ(line["parentId"], caller_span);
+    EXPECT_EQ(line["spanId"], span.trace.spanIdString());
+    EXPECT_EQ(line["status"], 200);
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include "restio_api_mapper.hpp"
+#include "restio_rest_handler.hpp"
+#include "test_server.hpp"
+
+using namespace restio;
+
+namespace {
+
+api::API makeAPI(int version, const std::string &answer)
+{
+    api::API api(version);
+    api.get<api::API::Method::Dummy>("hello", "", "", [answer](Request &, Response &response, const Properties &) {
+        response.body() = answer;
+    });
+    return api;
+}
+
+class VersioningTest : public ServerTest {
+protected:
+    void SetUp() override
+    {
+        restHandler.registerAPI(makeAPI(1, "v1"));
+        auto v3 = makeAPI(3, "v3");
+        v3.compatibleWith(2);
+        restHandler.registerAPI(std::move(v3));
+        start();
+    }
+
+    TestResponse getVersion(const std::string &version) { return get("/api/hello", { { "Accept-Version", version } }); }
+
+    RestHandler restHandler { server };
+};
+
+} // namespace
+
+TEST_F(VersioningTest, Path)
+{
+    EXPECT_EQ(get("/api/v1/hello").body(), "v1");
+    EXPECT_EQ(get("/api/v3/hello").body(), "v3");
+    EXPECT_EQ(get("/api/v2/hello").result(), http::status::not_found);
+
+    restHandler.registerAPI(makeAPI(1, "v1 again"));
+    EXPECT_EQ(get("/api/v1/hello").body(), "v1 again");
+}
+
+TEST_F(VersioningTest, Negotiation)
+{
+    EXPECT_EQ(get("/api/hello").body(), "v3"); // the newest
+    EXPECT_EQ(getVersion("1").body(), "v1");
+    EXPECT_EQ(getVersion("v3").body(), "v3");
+    EXPECT_EQ(getVersion("2").body(), "v3"); // compatible
+    EXPECT_EQ(getVersion("4").result(), http::status::not_acceptable);
+    EXPECT_EQ(getVersion("x").result(), http::status::not_acceptable);
+    EXPECT_EQ(get("/api/hello", { { "Accept", "application/json; charset=utf-8; version=1" } }).body(), "v1");
+    EXPECT_EQ(get("/api/hello", { { "Accept", "text/plain;subversion=1" } }).body(), "v3");
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "restio_websocket.hpp"
+#include "test_server.hpp"
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+using namespace restio;
+namespace beast     = boost::beast;
+namespace websocket = beast::websocket;
+using tcp           = boost::asio::ip::tcp;
+
+namespace {
+
+// the first word is the key
+std::string command(std::string_view message) { return std::string(message.substr(0, message.find(' '))); }
+
+class WebSocketTest : public ServerTest {
+protected:
+    WebSocketTest() : ServerTest("127.0.0.1", "/base") { }
+};
+
+}
+
+TEST_F(WebSocketTest, Dispatch)
+{
+    auto endpoint = std::make_shared<WebSocketEndpoint>(command);
+    endpoint->on("echo", [](WebSocketConnection &connection, std::string &message) {
+        connection.send(message.substr(5));
+    });
+    endpoint->on("twice",
+                 [](WebSocketConnection &connection, std::string &message) -> boost::asio::awaitable<void> {
+                     auto reply = std::make_shared<const std::string>(message.substr(6));
+                     connection.send(reply);
+                     connection.send(reply);
+                     co_return;
+                 });
+    endpoint->on("bye", [](WebSocketConnection &connection, std::string &) { connection.close(); });
+    server.websocket("ws", std::move(endpoint));
+    start();
+
+    websocket::stream<tcp::socket> ws(connect());
+    websocket::permessage_deflate deflate;
+    deflate.client_enable = true;
+    ws.set_option(deflate);
+    ws.handshake("localhost", "/base/ws?x=1");
+
+    beast::flat_buffer buffer;
+    auto const         receive = [&]() {
+        buffer.consume(buffer.size());
+        ws.read(buffer);
+        return beast::buffers_to_string(buffer.data());
+    };
+    ws.write(boost::asio::buffer(std::string("echo hello")));
+    EXPECT_EQ(receive(), "hello");
+    ws.write(boost::asio::buffer(std::string("unknown message")));
+    ws.write(boost::asio::buffer(std::string("twice hi")));
+    EXPECT_EQ(receive(), "hi");
+    EXPECT_EQ(receive(), "hi");
+
+    ws.write(boost::asio::buffer(std::string("bye")));
+    beast::error_code ec;
+    ws.read(buffer, ec);
+    EXPECT_EQ(ec, websocket::error::closed);
+}
+
+TEST_F(WebSocketTest, BasePathBoundary)
+{
+    server.websocket("ws", std::make_shared<WebSocketEndpoint>(command));
+    start();
+
+    websocket::stream<tcp::socket> ws(connect());
+    beast::error_code              ec;
+    ws.handshake("localhost", "/basews", ec);
+    EXPECT_TRUE(ec); // not upgraded
+}
@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2021, Sergei Ilinykh <rion4ik@gmail.com>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Prints the access log written by HttpServer::setAccessLog as text or JSON lines, from the oldest record
+
+#include "restio_access_log.hpp"
+
+#include <boost/asio/ip/address.hpp>
+#include <boost/beast/http/verb.hpp>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace restio;
+namespace http = boost::beast::http;
+
+namespace {
+
+std::string formatTime(std::uint64_t micros)
+{
+    std::time_t seconds = std::time_t(micros / 1000000);
+    std::tm     tm;
+    ::gmtime_r(&seconds, &tm);
+    char buffer[32];
+    auto n = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+    std::snprintf(buffer + n, sizeof(buffer) - n, ".%06uZ", unsigned(micros % 1000000));
+    return buffer;
+}
+
+std::string formatPeer(const std::uint8_t (&peer)[16])
+{
+    if (std::all_of(std::begin(peer), std::end(peer), [](auto b) { return b == 0; })) {
+        return "-";
+    }
+    boost::asio::ip::address_v6::bytes_type bytes;
+    std::copy(std::begin(peer), std::end(peer), bytes.begin());
+    boost::asio::ip::address_v6 address(bytes);
+    if (address.is_v4_mapped()) {
+        return boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, address).to_string();
+    }
+    return address.to_string();
+}
+
+std::string formatVersion(std::uint8_t version)
+{
+    return version == 20 ? "HTTP/2" : "HTTP/" + std::to_string(version / 10) + "." + std::to_string(version % 10);
+}
+
+char hex(unsigned value) { return "0123456789abcdef"[value & 0xf]; }
+
+std::string formatRoute(std::uint32_t routeId)
+{
+    std::string id(8, '0');
+    for (int i = 7; i >= 0; i--, routeId >>= 4) {
+        id[i] = hex(routeId);
+    }
+    return id;
+}
+
+void printText(const AccessLogRecord &r)
+{
+    std::cout << formatTime(r.timestamp) << ' ' << formatPeer(r.peer) << ' '
+              << http::to_string(http::verb(r.method)) << ' ' << std::string(r.target, strnlen(r.target, 64)) << ' '
+              << formatVersion(r.version) << ' ' << r.status << " route=" << formatRoute(r.routeId)
+              << " read=" << r.readMicros << "us handler=" << r.handlerMicros << "us write=" << r.writeMicros
+              << "us in=" << r.requestBytes << " out=" << r.responseBytes << '\n';
+}
+
+void printJson(const AccessLogRecord &r)
+{
+    nlohmann::json j { { "seq", r.sequence },
+                       { "time", formatTime(r.timestamp) },
+                       { "peer", formatPeer(r.peer) },
+                       { "method", std::string(http::to_string(http::verb(r.method))) },
+                       { "target", std::string(r.target, strnlen(r.target, 64)) },
+                       { "version", formatVersion(r.version) },
+                       { "status", r.status },
+                       { "route", formatRoute(r.routeId) },
+                       { "readUs", r.readMicros },
+                       { "handlerUs", r.handlerMicros },
+                       { "writeUs", r.writeMicros },
+                       { "requestBytes", r.requestBytes },
+                       { "responseBytes", r.responseBytes } };
+    // the target is cut at 64 bytes, possibly in the middle of a UTF-8 sequence
+    std::cout << j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << '\n';
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    bool        json = argc == 3 && std::strcmp(argv[1], "--json") == 0;
+    std::string path = argc == 2 ? argv[1] : json ? argv[2] : "";
+    if (path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--json] <access log file>\n";
+        return 2;
+    }
+    try {
+        for (auto const &record : AccessLog::read(path)) {
+            json ? printJson(record) : printText(record);
+        }
+    } catch (std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
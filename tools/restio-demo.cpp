@@ -27,13 +27,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include "restio_api_mapper.hpp"
+#include "restio_event_hub.hpp"
 #include "restio_http_server.hpp"
 #include "restio_log.hpp"
 #include "restio_properties.hpp"
 #include "restio_rest_handler.hpp"
+#include "restio_util.hpp"
+#include "restio_websocket.hpp"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include <iostream>
@@ -76,6 +85,7 @@ class RESTService {
             response.result(http::status::conflict);
             co_return;
         }
+        events->publish(resAddRequest.name, "added");
         RestHandler::makeOkResponse(response, ResourceAddResponse { "hello " + resAddRequest.name });
     }
 
@@ -87,6 +97,8 @@ class RESTService {
             co_return;
         }
         resources.erase(it);
+        events->publish(*p.value<std::string>("id"), "deleted");
+        restHandler.invalidateCache(1, "resource/" + *p.value<std::string>("id"));
         RestHandler::makeOkResponse(response);
     }
 
@@ -100,48 +112,122 @@ class RESTService {
         RestHandler::makeOkResponse(response, ResourceGetResponse { "It's " + *it });
     }
 
+    // waits for the given number of milliseconds unless the request is cancelled
+    awaitable<void> onSleepRequest(Request &, Response &response, const Properties &p, RequestContext &context)
+    {
+        boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor,
+                                        std::chrono::milliseconds(*p.value<int>("ms")));
+        std::stop_callback        cancel(context.stopToken, [&timer]() { timer.cancel(); });
+        boost::system::error_code ec;
+        co_await timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        if (ec) {
+            RESTIO_INFO("sleep cancelled");
+            co_return;
+        }
+        RestHandler::makeOkResponse(response, ResourceGetResponse { "slept well" });
+    }
+
+    void waitSignal()
+    {
+        signals.async_wait([this](boost::system::error_code ec, int signal) {
+            if (!ec) {
+                onSignal(signal);
+            }
+        });
+    }
+
+    // SIGHUP restarts without refusing anybody: the new process takes over the listeners, this one drains
+    void onSignal(int signal)
+    {
+        if (signal == SIGHUP) {
+            try {
+                server.spawnSuccessor({ "/proc/self/exe" });
+            } catch (std::exception &e) {
+                RESTIO_ERROR("Failed to restart: " << e.what());
+                waitSignal();
+                return;
+            }
+        }
+        shutdown();
+    }
+
+    // the requests in progress are answered first
+    void shutdown()
+    {
+        if (!shuttingDown) {
+            shuttingDown = true;
+            boost::asio::co_spawn(ioc, drainAndStop(), boost::asio::detached);
+        }
+    }
+
+    awaitable<void> drainAndStop()
+    {
+        if (!co_await server.drain(std::chrono::steady_clock::now() + std::chrono::seconds(10))) {
+            RESTIO_WARN("Some connections were closed forcibly");
+        }
+        ioc.stop();
+    }
+
 private:
-    HttpServer            server;
-    RestHandler           restHandler;
-    std::set<std::string> resources;
+    boost::asio::io_context  &ioc;
+    HttpServer                server;
+    RestHandler               restHandler;
+    std::shared_ptr<EventHub> events = std::make_shared<EventHub>(); // resource changes
+    std::set<std::string>     resources;
+    boost::asio::signal_set   signals;
+    bool                      shuttingDown = false;
 
 public:
-    RESTService(boost::asio::io_context &ioc) : server(ioc, "0.0.0.0", 8080), restHandler(server)
+    RESTService(boost::asio::io_context &ioc) :
+        ioc(ioc), server(ioc), restHandler(server), signals(ioc, SIGINT, SIGTERM, SIGHUP)
     {
-        server.route(http::verb::post,
-                     "/shutdown",
-                     [&ioc](std::string_view, Request &, Response &) -> boost::asio::awaitable<void> {
-                         ioc.stop();
-                         co_return;
-                     });
+        if (!server.adoptSystemdListeners()) { // socket activated or restarted otherwise
+            server.listen("0.0.0.0", 8080);
+        }
+        server.route(http::verb::post, "/shutdown", [this](std::string_view, Request &, Response &) { shutdown(); });
+        waitSignal();
+
+        // messages are "<command> <payload>"
+        auto ws = std::make_shared<WebSocketEndpoint>(
+            [](std::string_view message) { return std::string(message.substr(0, message.find(' '))); });
+        ws->on("echo", [](WebSocketConnection &connection, std::string &message) {
+            message.erase(0, 5);
+            connection.send(std::move(message));
+        });
+        server.websocket("ws", std::move(ws));
+        server.events("events", events);
 
-        using namespace std::placeholders;
-#define apiCB(f) std::bind(&RESTService::f, this, _1, _2, _3)
-        using M = API::Method;
+#define apiCB(f)                                                                                                       \
+    [this](Request &request, Response &response, const Properties &p) { return f(request, response, p); }
 
         API api;
         api.version = 1;
         // clang-format off
-        api.methods = {
-            M::post<ResourceAddRequest, ResourceAddResponse>(
+        api.post<ResourceAddRequest, ResourceAddResponse>(
                 "resource",
                 "Add new resource",
                 "200 - added",
-                apiCB(onResoureAddRequest)),
-            M::delete_(
+                apiCB(onResoureAddRequest))
+           .delete_(
                 "resource/<string:id>",
                 "Delete resource",
                 "204 - deleted<br>404 - resource not found",
-                apiCB(onResourceDeleteRequest)),
-            M::get<ResourceGetResponse>(
+                apiCB(onResourceDeleteRequest))
+           .get<ResourceGetResponse>(
                 "resource/<string:id>",
                 "resource info",
                 "200 - ok<br>404 - resource not found",
-                apiCB(onResoureGetRequest)),
-        };
+                apiCB(onResoureGetRequest))
+           .cache(std::chrono::seconds(10));
         api.get<ResourceGetResponse>("hello", "Say Hello", "200 - Hello back", [](Request &, Response &response, const Properties &) {
             RestHandler::makeOkResponse(response, ResourceGetResponse { "hello world" });
         });
+        api.get<ResourceGetResponse>("hello/<string:name>", "Say Hello on the offload pool", "200 - Hello back", [](Request &, Response &response, const Properties &p) {
+            RestHandler::makeOkResponse(response, ResourceGetResponse { "hello " + *p.value<std::string>("name") });
+        }).offload();
+        api.get<ResourceGetResponse>("sleep/<int:ms>", "Sleep for a while, but not longer than a second", "200 - ok<br>504 - timeout", [this](Request &request, Response &response, const Properties &p, RequestContext &context) {
+            return onSleepRequest(request, response, p, context);
+        }).timeout(std::chrono::seconds(1)).coalesce();
         restHandler.registerAPI(std::move(api));
         // clang-format on
 #undef apiCB
@@ -150,6 +236,10 @@ public:
 
 int main()
 {
+    if (!restio::ioBackendAvailable()) {
+        RESTIO_ERROR("io_uring is not available. Run on Linux 5.10+ and allow io_uring in seccomp");
+        return 1;
+    }
     boost::asio::io_context ioc;
     try {
         restio::log.setLevel(boost::log::trivial::severity_level::trace);